@@ -0,0 +1,177 @@
+#include <benchmark/benchmark.h>
+#include "../src/tensor/tensor.h"
+#include "../src/nn/modules.h"
+#include "../src/nn/attention.h"
+#include "../src/nn/models.h"
+
+using namespace blass;
+
+// K/V copied out to every query head, as Qwen2Block did before attention handled groups
+static Tensor<float> broadcast_heads(const Tensor<float>& kv, size_t heads) {
+    size_t batch_size = kv.get_shape(0);
+    size_t len = kv.get_shape(1);
+    size_t kv_heads = kv.get_shape(2);
+    size_t head_dim = kv.get_shape(3);
+    Tensor<float> out = kv.view({(int)batch_size, (int)len, (int)kv_heads, 1, (int)head_dim});
+    out = out.broadcast({batch_size, len, kv_heads, heads / kv_heads, head_dim}).contiguous();
+    return out.view({(int)batch_size, (int)len, (int)heads, (int)head_dim});
+}
+
+// the attention Qwen2Block used before the fused kernel: K/V broadcast to every head, full
+// scores tensor, separate scale, serial causal mask, softmax and a second matmul
+static Tensor<float> composed_attention(Tensor<float> q, Tensor<float> k, Tensor<float> v, size_t past_len) {
+    size_t head_dim = q.get_shape(3);
+    k = broadcast_heads(k, q.get_shape(2));
+    v = broadcast_heads(v, q.get_shape(2));
+    q = q.transpose({0, 2, 1, 3});
+    k = k.transpose({0, 2, 1, 3});
+    v = v.transpose({0, 2, 1, 3});
+
+    Tensor<float> scores = matmul(q, k, true) / sqrt((float)head_dim);
+    for (size_t i = 0; i < scores.size(); i++) {
+        size_t s_q = (i / scores.get_shape(3)) % scores.get_shape(2);
+        size_t s_k = i % scores.get_shape(3);
+        if (s_k > past_len + s_q)
+            scores.get_data()[i] = -std::numeric_limits<float>::infinity();
+    }
+
+    Tensor<float> attn_weights = nn::functional::softmax(scores);
+    Tensor<float> attn_out = matmul(attn_weights, v);
+    return attn_out.transpose({0, 2, 1, 3}).contiguous();
+}
+
+// 4 * d flops per visible (query, key) pair: the q.k dot and the p * v update
+static void set_attention_gflops(benchmark::State& state, size_t heads, size_t head_dim, size_t past_len, size_t seq_len) {
+    double pairs = (double)seq_len * past_len + (double)seq_len * (seq_len + 1) / 2;
+    state.counters["GFLOP/s"] = benchmark::Counter(4.0 * heads * head_dim * pairs * 1e-9, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+static void BM_Attention_Composed(benchmark::State& state) {
+    size_t past_len = state.range(0);
+    size_t seq_len = state.range(1);
+    size_t heads = state.range(2);
+    size_t kv_heads = state.range(3);
+    size_t head_dim = 64;
+    Tensor<float> q = Tensor<float>::fill_random({1, seq_len, heads, head_dim}, -1.0f, 1.0f);
+    Tensor<float> k = Tensor<float>::fill_random({1, past_len + seq_len, kv_heads, head_dim}, -1.0f, 1.0f);
+    Tensor<float> v = Tensor<float>::fill_random({1, past_len + seq_len, kv_heads, head_dim}, -1.0f, 1.0f);
+
+    for (auto _ : state) {
+        Tensor<float> out = composed_attention(q, k, v, past_len);
+        benchmark::DoNotOptimize(out);
+    }
+    set_attention_gflops(state, heads, head_dim, past_len, seq_len);
+}
+
+static void BM_Attention_Fused(benchmark::State& state) {
+    size_t past_len = state.range(0);
+    size_t seq_len = state.range(1);
+    size_t heads = state.range(2);
+    size_t kv_heads = state.range(3);
+    size_t head_dim = 64;
+    Tensor<float> q = Tensor<float>::fill_random({1, seq_len, heads, head_dim}, -1.0f, 1.0f);
+    Tensor<float> k = Tensor<float>::fill_random({1, past_len + seq_len, kv_heads, head_dim}, -1.0f, 1.0f);
+    Tensor<float> v = Tensor<float>::fill_random({1, past_len + seq_len, kv_heads, head_dim}, -1.0f, 1.0f);
+
+    for (auto _ : state) {
+        Tensor<float> out = nn::functional::causal_attention(q, k, v, past_len);
+        benchmark::DoNotOptimize(out);
+    }
+    set_attention_gflops(state, heads, head_dim, past_len, seq_len);
+}
+
+// the fused kernel fed K/V copied out to every head, i.e. without grouped-query support
+static void BM_Attention_FusedBroadcastKV(benchmark::State& state) {
+    size_t past_len = state.range(0);
+    size_t seq_len = state.range(1);
+    size_t heads = state.range(2);
+    size_t kv_heads = state.range(3);
+    size_t head_dim = 64;
+    Tensor<float> q = Tensor<float>::fill_random({1, seq_len, heads, head_dim}, -1.0f, 1.0f);
+    Tensor<float> k = Tensor<float>::fill_random({1, past_len + seq_len, kv_heads, head_dim}, -1.0f, 1.0f);
+    Tensor<float> v = Tensor<float>::fill_random({1, past_len + seq_len, kv_heads, head_dim}, -1.0f, 1.0f);
+
+    for (auto _ : state) {
+        Tensor<float> out = nn::functional::causal_attention(q, broadcast_heads(k, heads), broadcast_heads(v, heads), past_len);
+        benchmark::DoNotOptimize(out);
+    }
+    set_attention_gflops(state, heads, head_dim, past_len, seq_len);
+}
+
+// a Qwen2-0.5B shaped block with random F32 weights
+static std::shared_ptr<models::Qwen2Block> random_block() {
+    auto block = std::make_shared<models::Qwen2Block>();
+    std::vector<std::pair<std::string, std::vector<uint64_t>>> params = {
+        {"attn_q.weight", {896, 896}}, {"attn_q.bias", {896}},
+        {"attn_k.weight", {128, 896}}, {"attn_k.bias", {128}},
+        {"attn_v.weight", {128, 896}}, {"attn_v.bias", {128}},
+        {"attn_output.weight", {896, 896}},
+        {"ffn_gate.weight", {4864, 896}}, {"ffn_up.weight", {4864, 896}},
+        {"ffn_down.weight", {896, 4864}},
+    };
+    for (auto& [name, dims] : params) {
+        Tensor<float> w = Tensor<float>::fill_random(std::vector<size_t>(dims.begin(), dims.end()), -0.06f, 0.06f);
+        block->init_param(name, gguf_loader::tensor_data{gguf_loader::GGML_TYPE_F32, dims, 0, w.get_data()});
+    }
+    return block;
+}
+
+// one decode step of n_seqs sequences with past_len cached positions each, through one block;
+// batched = 0 runs them one after the other, 1 as a single PagedBatch
+static void BM_Qwen2Block_Decode(benchmark::State& state) {
+    size_t n_seqs = state.range(0);
+    size_t past_len = state.range(1);
+    bool batched = state.range(2);
+    auto block = random_block();
+    auto pool = std::make_shared<nn::KVBlockPool<float>>(1, 2, 64);
+
+    std::vector<nn::PagedKVCache<float>> seqs;
+    for (size_t i = 0; i < n_seqs; i++) {
+        seqs.emplace_back(pool);
+        block->forward(Tensor<float>::fill_random({1, past_len, 896}, -1.0f, 1.0f), seqs.back(), 0);
+        seqs.back().advance(past_len);
+    }
+    Tensor<float> tokens = Tensor<float>::fill_random({1, n_seqs, 896}, -1.0f, 1.0f);
+
+    for (auto _ : state) {
+        if (batched) {
+            nn::PagedBatch<float> batch;
+            for (auto& seq : seqs)
+                batch.add(seq, 1);
+            Tensor<float> out = block->forward(tokens, batch, 0);
+            benchmark::DoNotOptimize(out);
+        }
+        else {
+            for (size_t i = 0; i < n_seqs; i++) {
+                Tensor<float> token = Tensor<float>::from_shape({1, 1, 896});
+                std::memcpy(token.get_data(), tokens.get_data() + i * 896, 896 * sizeof(float));
+                Tensor<float> out = block->forward(token, seqs[i], 0);
+                benchmark::DoNotOptimize(out);
+            }
+        }
+        // the step is not committed, so every iteration decodes the same position
+    }
+    state.SetItemsProcessed(state.iterations() * n_seqs);
+}
+
+// prefills of growing length, then single-token decode steps over a long history, with
+// Qwen2-0.5B's 14 query heads over 2 KV heads
+BENCHMARK(BM_Attention_Composed)->Args({0, 128, 14, 2})
+                                  ->Args({0, 512, 14, 2})
+                                  ->Args({0, 1024, 14, 2})
+                                  ->Args({1023, 1, 14, 2})
+                                  ->Args({4095, 1, 14, 2})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Attention_FusedBroadcastKV)->Args({0, 128, 14, 2})
+                                          ->Args({0, 512, 14, 2})
+                                          ->Args({0, 1024, 14, 2})
+                                          ->Args({1023, 1, 14, 2})
+                                          ->Args({4095, 1, 14, 2})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Attention_Fused)->Args({0, 128, 14, 2})
+                               ->Args({0, 512, 14, 2})
+                               ->Args({0, 1024, 14, 2})
+                               ->Args({1023, 1, 14, 2})
+                               ->Args({4095, 1, 14, 2})->Unit(benchmark::kMillisecond)->UseRealTime();
+// 1 to 16 users decoding after a 256-token context, separately and as one batch
+BENCHMARK(BM_Qwen2Block_Decode)->ArgsProduct({{1, 4, 16}, {256}, {0, 1}})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
\ No newline at end of file
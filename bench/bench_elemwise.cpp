@@ -1,5 +1,7 @@
 #include <benchmark/benchmark.h>
 #include "../src/tensor/tensor.h"
+#include "../src/nn/modules.h"
+#include "../src/nn/sampling.h"
 
 using namespace blass;
 
@@ -71,6 +73,151 @@ static void BM_ElemwiseAddNonContiguous(benchmark::State& state) {
     state.SetItemsProcessed(state.iterations() * dim1 * dim2 * dim3);
 }
 
+static void BM_Softmax(benchmark::State& state) {
+    size_t rows = state.range(0);
+    size_t cols = state.range(1);
+    Tensor<float> a = Tensor<float>::fill_random({rows, cols}, -10.0f, 10.0f);
+
+    for (auto _ : state) {
+        Tensor<float> c = nn::functional::softmax(a);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetItemsProcessed(state.iterations() * rows * cols);
+}
+
+static void BM_SoftmaxInPlace(benchmark::State& state) {
+    size_t rows = state.range(0);
+    size_t cols = state.range(1);
+    Tensor<float> a = Tensor<float>::fill_random({rows, cols}, -10.0f, 10.0f);
+
+    for (auto _ : state) {
+        nn::functional::softmax_inplace(a);
+        benchmark::DoNotOptimize(a);
+    }
+    state.SetItemsProcessed(state.iterations() * rows * cols);
+}
+
+static void BM_SiLU(benchmark::State& state) {
+    size_t rows = state.range(0);
+    size_t cols = state.range(1);
+    Tensor<float> a = Tensor<float>::fill_random({rows, cols}, -10.0f, 10.0f);
+    nn::SiLU<float> silu;
+
+    for (auto _ : state) {
+        Tensor<float> c = silu(a);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetItemsProcessed(state.iterations() * rows * cols);
+}
+
+static void BM_SiLUInPlace(benchmark::State& state) {
+    size_t rows = state.range(0);
+    size_t cols = state.range(1);
+    Tensor<float> src = Tensor<float>::fill_random({rows, cols}, -10.0f, 10.0f);
+    Tensor<float> a = src.clone();
+    nn::SiLU<float> silu;
+
+    for (auto _ : state) {
+        // SiLU applied to its own output decays towards subnormals, so start from the same values
+        state.PauseTiming();
+        std::copy(src.get_data(), src.get_data() + src.size(), a.get_data());
+        state.ResumeTiming();
+        silu.apply(a);
+        benchmark::DoNotOptimize(a);
+    }
+    state.SetItemsProcessed(state.iterations() * rows * cols);
+}
+
+static void BM_RMSNorm(benchmark::State& state) {
+    size_t rows = state.range(0);
+    size_t cols = state.range(1);
+    Tensor<float> a = Tensor<float>::fill_random({rows, cols}, -10.0f, 10.0f);
+    nn::RMSNorm<float> norm(cols, 1e-6f);
+
+    for (auto _ : state) {
+        Tensor<float> c = norm(a);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetItemsProcessed(state.iterations() * rows * cols);
+}
+
+// into a preallocated output, as the model reuses its buffers
+static void BM_RMSNormInto(benchmark::State& state) {
+    size_t rows = state.range(0);
+    size_t cols = state.range(1);
+    Tensor<float> a = Tensor<float>::fill_random({rows, cols}, -10.0f, 10.0f);
+    Tensor<float> c = Tensor<float>::from_shape({rows, cols});
+    nn::RMSNorm<float> norm(cols, 1e-6f);
+
+    for (auto _ : state) {
+        norm.forward(a, c);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetItemsProcessed(state.iterations() * rows * cols);
+}
+
+// token selection over one row of logits, the old way: every (logit, id) pair sorted
+static void BM_TopK_FullSort(benchmark::State& state) {
+    size_t vocab = state.range(0);
+    size_t k = state.range(1);
+    Tensor<float> logits = Tensor<float>::fill_random({vocab}, -20.0f, 20.0f);
+
+    for (auto _ : state) {
+        std::vector<std::pair<float, int>> pairs;
+        for (size_t i = 0; i < vocab; i++)
+            pairs.push_back({logits(i), (int)i});
+        std::sort(pairs.begin(), pairs.end(), std::greater<std::pair<float, int>>());
+        pairs.resize(k);
+        benchmark::DoNotOptimize(pairs);
+    }
+    state.SetItemsProcessed(state.iterations() * vocab);
+}
+
+static void BM_TopK(benchmark::State& state) {
+    size_t vocab = state.range(0);
+    size_t k = state.range(1);
+    Tensor<float> logits = Tensor<float>::fill_random({vocab}, -20.0f, 20.0f);
+
+    for (auto _ : state) {
+        auto best = nn::functional::top_k(logits.get_data(), vocab, k);
+        benchmark::DoNotOptimize(best);
+    }
+    state.SetItemsProcessed(state.iterations() * vocab);
+}
+
+static void BM_Argmax(benchmark::State& state) {
+    size_t vocab = state.range(0);
+    Tensor<float> logits = Tensor<float>::fill_random({vocab}, -20.0f, 20.0f);
+
+    for (auto _ : state) {
+        size_t best = nn::functional::argmax(logits.get_data(), vocab);
+        benchmark::DoNotOptimize(best);
+    }
+    state.SetItemsProcessed(state.iterations() * vocab);
+}
+
+// one Sampler::sample call over Qwen2-like logits (N(0, 3) plus a few clear favourites)
+// with 256 tokens of history, so the repetition penalty touches 256 entries
+static void BM_Sampler(benchmark::State& state, nn::SamplingParams params) {
+    size_t vocab = state.range(0);
+    Tensor<float> logits = Tensor<float>::randn({vocab}, 0.0f, 3.0f);
+    for (size_t i = 0; i < 5; i++)
+        logits(i * 7919) = 15.0f - i;
+    Tensor<float> row = logits.clone();
+    nn::Sampler sampler(params, 1);
+    for (size_t i = 0; i < 256; i++)
+        sampler.accept(i * 577 % vocab);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::copy(logits.get_data(), logits.get_data() + vocab, row.get_data());
+        state.ResumeTiming();
+        size_t token = sampler.sample(row.get_data(), vocab);
+        benchmark::DoNotOptimize(token);
+    }
+    state.SetItemsProcessed(state.iterations() * vocab);
+}
+
 BENCHMARK(BM_ElemwiseAddScalar)->Args({16, 16})
                          ->Args({64, 32})
                          ->Args({32, 64})
@@ -102,4 +249,35 @@ BENCHMARK(BM_ElemwiseAddNonContiguous)->Args({8, 8, 8})
                                     ->Args({200, 200, 200})
                                      ->Args({500, 500, 500})
                                      ->Args({1000, 1000, 1000})->Unit(benchmark::kMillisecond)->Iterations(5)->UseRealTime();
+// attention rows, a full-vocabulary row, FFN activations and hidden states of Qwen2-0.5B
+BENCHMARK(BM_Softmax)->Args({14 * 128, 128})
+                      ->Args({14, 4096})
+                      ->Args({1, 151936})->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_SoftmaxInPlace)->Args({14 * 128, 128})
+                             ->Args({14, 4096})
+                             ->Args({1, 151936})->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_SiLU)->Args({1, 4864})
+                   ->Args({128, 4864})->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_SiLUInPlace)->Args({1, 4864})
+                          ->Args({128, 4864})->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_RMSNorm)->Args({1, 896})
+                      ->Args({128, 896})->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_RMSNormInto)->Args({1, 896})
+                          ->Args({128, 896})->Unit(benchmark::kMicrosecond)->UseRealTime();
+// Qwen2's 151936-token vocabulary
+BENCHMARK(BM_TopK_FullSort)->Args({151936, 10})->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_TopK)->Args({151936, 10})
+                  ->Args({151936, 40})
+                  ->Args({151936, 1000})->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_Argmax)->Args({151936})->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_Sampler, Greedy, nn::SamplingParams{.temperature = 0.0f, .repetition_penalty = 1.1f})
+    ->Args({151936})->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_Sampler, Temperature, nn::SamplingParams{.temperature = 0.8f, .top_k = 0, .repetition_penalty = 1.1f})
+    ->Args({151936})->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_Sampler, TopKTopP, nn::SamplingParams{.temperature = 0.7f, .top_k = 40, .top_p = 0.9f, .repetition_penalty = 1.1f})
+    ->Args({151936})->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_Sampler, TopP, nn::SamplingParams{.temperature = 1.0f, .top_k = 0, .top_p = 0.95f, .repetition_penalty = 1.1f})
+    ->Args({151936})->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_Sampler, MinP, nn::SamplingParams{.temperature = 1.0f, .top_k = 0, .min_p = 0.05f, .frequency_penalty = 0.2f})
+    ->Args({151936})->Unit(benchmark::kMicrosecond)->UseRealTime();
 BENCHMARK_MAIN();
\ No newline at end of file
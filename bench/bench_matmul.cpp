@@ -1,8 +1,43 @@
 #include <benchmark/benchmark.h>
 #include "../src/tensor/tensor.h"
+#include "../src/nn/ffn.h"
 
 using namespace blass;
 
+// Previous matmul_2d: one independent SIMD dot product per output against a transposed copy of B.
+// Kept here only as a baseline for the packed GEMM.
+static Tensor<float> matmul_2d_dot(const Tensor<float>& a_raw, const Tensor<float>& b) {
+    Tensor<float> a = a_raw.contiguous();
+    size_t m = a.get_shape(0);
+    size_t n = a.get_shape(1);
+    size_t p = b.get_shape(1);
+
+    Tensor<float> result = Tensor<float>::from_shape({m, p});
+    Tensor<float> b_transposed = b.transpose();
+
+    float* ptr_a = a.get_data();
+    float* ptr_b = b_transposed.get_data();
+    float* ptr_res = result.get_data();
+
+    #pragma omp parallel for
+    for (size_t i = 0; i < m; ++i) {
+        for (size_t j = 0; j < p; ++j) {
+            float sum = 0;
+
+            #pragma omp simd reduction(+:sum)
+            for (size_t k = 0; k < n; ++k)
+                sum += ptr_a[i * n + k] * ptr_b[j * n + k];
+
+            ptr_res[i * p + j] = sum;
+        }
+    }
+    return result;
+}
+
+static void set_gflops(benchmark::State& state, double flops_per_iter) {
+    state.counters["GFLOP/s"] = benchmark::Counter(flops_per_iter * 1e-9, benchmark::Counter::kIsIterationInvariantRate);
+}
+
 static void BM_Matmul2D_Square(benchmark::State& state) {
     size_t N = state.range(0);
     Tensor<float> a = Tensor<float>::fill_random({N, N}, 0.0f, 1.0f);
@@ -13,6 +48,20 @@ static void BM_Matmul2D_Square(benchmark::State& state) {
         benchmark::DoNotOptimize(c);
     }
     state.SetItemsProcessed(state.iterations() * N * N * N);
+    set_gflops(state, 2.0 * N * N * N);
+}
+
+static void BM_Matmul2D_Square_Dot(benchmark::State& state) {
+    size_t N = state.range(0);
+    Tensor<float> a = Tensor<float>::fill_random({N, N}, 0.0f, 1.0f);
+    Tensor<float> b = Tensor<float>::fill_random({N, N}, 0.0f, 1.0f);
+
+    for (auto _ : state) {
+        Tensor<float> c = matmul_2d_dot(a, b);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetItemsProcessed(state.iterations() * N * N * N);
+    set_gflops(state, 2.0 * N * N * N);
 }
 
 static void BM_Matmul2D_Rectangular(benchmark::State& state) {
@@ -27,6 +76,232 @@ static void BM_Matmul2D_Rectangular(benchmark::State& state) {
         benchmark::DoNotOptimize(c);
     }
     state.SetItemsProcessed(state.iterations() * M * K * N);
+    set_gflops(state, 2.0 * M * K * N);
+}
+
+static void BM_Matmul2D_Rectangular_Dot(benchmark::State& state) {
+    size_t M = state.range(0);
+    size_t K = state.range(1);
+    size_t N = state.range(2);
+    Tensor<float> a = Tensor<float>::fill_random({M, K}, 0.0f, 1.0f);
+    Tensor<float> b = Tensor<float>::fill_random({K, N}, 0.0f, 1.0f);
+
+    for (auto _ : state) {
+        Tensor<float> c = matmul_2d_dot(a, b);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetItemsProcessed(state.iterations() * M * K * N);
+    set_gflops(state, 2.0 * M * K * N);
+}
+
+static void BM_Matmul2D_SplitK(benchmark::State& state) {
+    size_t M = state.range(0);
+    size_t K = state.range(1);
+    size_t N = state.range(2);
+    Tensor<float> a = Tensor<float>::fill_random({M, K}, 0.0f, 1.0f);
+    Tensor<float> b = Tensor<float>::fill_random({N, K}, 0.0f, 1.0f);
+    Tensor<float> c = Tensor<float>::from_shape({M, N});
+
+    for (auto _ : state) {
+        kernel::gemm_split_k(M, N, K, a.get_data(), K, 1, b.get_data(), 1, K, c.get_data(), N);
+        benchmark::DoNotOptimize(c.get_data());
+    }
+    state.SetBytesProcessed(state.iterations() * (M + N) * K * sizeof(float));
+    set_gflops(state, 2.0 * M * K * N);
+}
+
+static void BM_Matmul2D_SplitK_Gemv(benchmark::State& state) {
+    size_t M = state.range(0);
+    size_t K = state.range(1);
+    size_t N = state.range(2);
+    Tensor<float> a = Tensor<float>::fill_random({M, K}, 0.0f, 1.0f);
+    Tensor<float> b = Tensor<float>::fill_random({N, K}, 0.0f, 1.0f);
+    Tensor<float> c = Tensor<float>::from_shape({M, N});
+
+    for (auto _ : state) {
+        kernel::gemv_rows(M, N, K, a.get_data(), K, b.get_data(), K, c.get_data(), N);
+        benchmark::DoNotOptimize(c.get_data());
+    }
+    state.SetBytesProcessed(state.iterations() * (M + N) * K * sizeof(float));
+    set_gflops(state, 2.0 * M * K * N);
+}
+
+static void BM_Matmul2D_Rank1(benchmark::State& state) {
+    size_t M = state.range(0);
+    size_t N = state.range(1);
+    Tensor<float> a = Tensor<float>::fill_random({M, 1}, 0.0f, 1.0f);
+    Tensor<float> b = Tensor<float>::fill_random({1, N}, 0.0f, 1.0f);
+    Tensor<float> c = Tensor<float>::from_shape({M, N});
+
+    for (auto _ : state) {
+        kernel::gemm_rank1(M, N, a.get_data(), 1, b.get_data(), 1, c.get_data(), N);
+        benchmark::DoNotOptimize(c.get_data());
+    }
+    state.SetBytesProcessed(state.iterations() * M * N * sizeof(float));
+}
+
+static void BM_Matmul2D_Rank1_Gemm(benchmark::State& state) {
+    size_t M = state.range(0);
+    size_t N = state.range(1);
+    Tensor<float> a = Tensor<float>::fill_random({M, 1}, 0.0f, 1.0f);
+    Tensor<float> b = Tensor<float>::fill_random({1, N}, 0.0f, 1.0f);
+    Tensor<float> c = Tensor<float>::from_shape({M, N});
+
+    for (auto _ : state) {
+        kernel::gemm_packed(M, N, 1, a.get_data(), 1, 1, b.get_data(), N, 1, c.get_data(), N);
+        benchmark::DoNotOptimize(c.get_data());
+    }
+    state.SetBytesProcessed(state.iterations() * M * N * sizeof(float));
+}
+
+static void BM_Matmul_Weight(benchmark::State& state) {
+    // activation [M, K] against a weight stored as [N, K], as in every projection of a transformer block
+    size_t M = state.range(0);
+    size_t K = state.range(1);
+    size_t N = state.range(2);
+    Tensor<float> x = Tensor<float>::fill_random({M, K}, 0.0f, 1.0f);
+    Tensor<float> w = Tensor<float>::fill_random({N, K}, 0.0f, 1.0f);
+
+    for (auto _ : state) {
+        Tensor<float> c = matmul(x, w, true);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetItemsProcessed(state.iterations() * M * K * N);
+    set_gflops(state, 2.0 * M * K * N);
+}
+
+static void BM_Matmul_WeightPrepacked(benchmark::State& state) {
+    size_t M = state.range(0);
+    size_t K = state.range(1);
+    size_t N = state.range(2);
+    Tensor<float> x = Tensor<float>::fill_random({M, K}, 0.0f, 1.0f);
+    PackedMatrix<float> w = PackedMatrix<float>::from_tensor(Tensor<float>::fill_random({N, K}, 0.0f, 1.0f), true);
+
+    for (auto _ : state) {
+        Tensor<float> c = matmul(x, w);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetItemsProcessed(state.iterations() * M * K * N);
+    set_gflops(state, 2.0 * M * K * N);
+}
+
+static void BM_Matmul_WeightPrepackedF16(benchmark::State& state) {
+    // same as BM_Matmul_WeightPrepacked with the weight kept in F16, widened inside the micro-kernel
+    size_t M = state.range(0);
+    size_t K = state.range(1);
+    size_t N = state.range(2);
+    Tensor<float> x = Tensor<float>::fill_random({M, K}, 0.0f, 1.0f);
+    auto w = PackedMatrix<float, kernel::f16>::from_tensor(Tensor<float>::fill_random({N, K}, 0.0f, 1.0f), true);
+
+    for (auto _ : state) {
+        Tensor<float> c = matmul(x, w);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetItemsProcessed(state.iterations() * M * K * N);
+    set_gflops(state, 2.0 * M * K * N);
+}
+
+static void BM_Gemv_Decode(benchmark::State& state) {
+    // single decode-step activation against a [N, K] weight; bandwidth bound, so report bytes/s
+    size_t K = state.range(0);
+    size_t N = state.range(1);
+    Tensor<float> x = Tensor<float>::fill_random({1, K}, 0.0f, 1.0f);
+    Tensor<float> w = Tensor<float>::fill_random({N, K}, 0.0f, 1.0f);
+
+    for (auto _ : state) {
+        Tensor<float> c = matmul(x, w, true);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetBytesProcessed(state.iterations() * N * K * sizeof(float));
+    set_gflops(state, 2.0 * K * N);
+}
+
+static void BM_Gemv_DecodePrepacked(benchmark::State& state) {
+    size_t K = state.range(0);
+    size_t N = state.range(1);
+    Tensor<float> x = Tensor<float>::fill_random({1, K}, 0.0f, 1.0f);
+    PackedMatrix<float> w = PackedMatrix<float>::from_tensor(Tensor<float>::fill_random({N, K}, 0.0f, 1.0f), true);
+
+    for (auto _ : state) {
+        Tensor<float> c = matmul(x, w);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetBytesProcessed(state.iterations() * N * K * sizeof(float));
+    set_gflops(state, 2.0 * K * N);
+}
+
+static void BM_Gemv_DecodePrepackedF16(benchmark::State& state) {
+    size_t K = state.range(0);
+    size_t N = state.range(1);
+    Tensor<float> x = Tensor<float>::fill_random({1, K}, 0.0f, 1.0f);
+    auto w = PackedMatrix<float, kernel::f16>::from_tensor(Tensor<float>::fill_random({N, K}, 0.0f, 1.0f), true);
+
+    for (auto _ : state) {
+        Tensor<float> c = matmul(x, w);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetBytesProcessed(state.iterations() * N * K * sizeof(kernel::f16));
+    set_gflops(state, 2.0 * K * N);
+}
+
+static void BM_Gemv_DecodeGemmPath(benchmark::State& state) {
+    // the same product forced through the packed GEMM, for comparison
+    size_t K = state.range(0);
+    size_t N = state.range(1);
+    Tensor<float> x = Tensor<float>::fill_random({1, K}, 0.0f, 1.0f);
+    Tensor<float> w = Tensor<float>::fill_random({N, K}, 0.0f, 1.0f);
+
+    for (auto _ : state) {
+        Tensor<float> c = Tensor<float>::from_shape({1, N});
+        kernel::gemm_packed(1, N, K, x.get_data(), K, 1, w.get_data(), 1, K, c.get_data(), N);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetBytesProcessed(state.iterations() * N * K * sizeof(float));
+    set_gflops(state, 2.0 * K * N);
+}
+
+static void BM_Matmul_Quantized(benchmark::State& state) {
+    // [M, K] x quantized [N, K]^T, type: 0 = Q8_0, 1 = Q4_0, 2 = Q4_K; bytes are the weight bytes streamed
+    size_t M = state.range(0);
+    size_t K = state.range(1);
+    size_t N = state.range(2);
+    kernel::quant_type type = (kernel::quant_type)state.range(3);
+    Tensor<float> x = Tensor<float>::fill_random({M, K}, 0.0f, 1.0f);
+    QuantizedMatrix w = QuantizedMatrix::quantize(Tensor<float>::fill_random({N, K}, -1.0f, 1.0f), type);
+
+    for (auto _ : state) {
+        Tensor<float> c = matmul(x, w);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetBytesProcessed(state.iterations() * N * w.row_bytes());
+    set_gflops(state, 2.0 * M * K * N);
+}
+
+static void BM_Matmul_WeightIsa(benchmark::State& state) {
+    // same as BM_Matmul_WeightPrepacked with the kernels forced to one variant
+    // (0 = generic, 1 = sse42, 2 = avx2, 3 = avx512)
+    size_t M = state.range(0);
+    size_t K = state.range(1);
+    size_t N = state.range(2);
+    kernel::isa target = static_cast<kernel::isa>(state.range(3));
+    if (target > kernel::detect_isa()) {
+        state.SkipWithError("instruction set not supported by this CPU");
+        return;
+    }
+
+    kernel::isa saved = kernel::active_isa();
+    kernel::set_isa(target);
+    Tensor<float> x = Tensor<float>::fill_random({M, K}, 0.0f, 1.0f);
+    PackedMatrix<float> w = PackedMatrix<float>::from_tensor(Tensor<float>::fill_random({N, K}, 0.0f, 1.0f), true);
+
+    for (auto _ : state) {
+        Tensor<float> c = matmul(x, w);
+        benchmark::DoNotOptimize(c);
+    }
+    kernel::set_isa(saved);
+    state.SetLabel(kernel::isa_name(target));
+    state.SetItemsProcessed(state.iterations() * M * K * N);
+    set_gflops(state, 2.0 * M * K * N);
 }
 
 static void BM_Matmul_Broadcast(benchmark::State& state) {
@@ -42,6 +317,81 @@ static void BM_Matmul_Broadcast(benchmark::State& state) {
         benchmark::DoNotOptimize(c);
     }
     state.SetItemsProcessed(state.iterations() * batch_size * M * K * N);
+    set_gflops(state, 2.0 * batch_size * M * K * N);
+}
+
+// attention-shaped batches: per-head Q x K^T with many small products
+static void BM_Matmul_BatchedHeads(benchmark::State& state) {
+    size_t heads = state.range(0);
+    size_t seq_q = state.range(1);
+    size_t seq_k = state.range(2);
+    size_t head_dim = state.range(3);
+    Tensor<float> q = Tensor<float>::fill_random({heads, seq_q, head_dim}, 0.0f, 1.0f);
+    Tensor<float> k = Tensor<float>::fill_random({heads, seq_k, head_dim}, 0.0f, 1.0f);
+
+    for (auto _ : state) {
+        Tensor<float> scores = matmul(q, k, true);
+        benchmark::DoNotOptimize(scores);
+    }
+    set_gflops(state, 2.0 * heads * seq_q * seq_k * head_dim);
+}
+
+// Qwen2 FFN (silu(x W_gate) * (x W_up)) W_down + x, unfused vs with GEMM epilogues
+static void BM_Ffn_Unfused(benchmark::State& state) {
+    size_t M = state.range(0);
+    size_t H = state.range(1);
+    size_t F = state.range(2);
+    Tensor<float> x = Tensor<float>::fill_random({M, H}, -1.0f, 1.0f);
+    PackedMatrix<float> w_gate = PackedMatrix<float>::from_tensor(Tensor<float>::fill_random({F, H}, -0.1f, 0.1f), true);
+    PackedMatrix<float> w_up = PackedMatrix<float>::from_tensor(Tensor<float>::fill_random({F, H}, -0.1f, 0.1f), true);
+    PackedMatrix<float> w_down = PackedMatrix<float>::from_tensor(Tensor<float>::fill_random({H, F}, -0.1f, 0.1f), true);
+
+    for (auto _ : state) {
+        Tensor<float> gate = matmul(x, w_gate);
+        Tensor<float> up = matmul(x, w_up);
+        for (size_t i = 0; i < gate.size(); i++)
+            gate.get_data()[i] = gate.get_data()[i] / (1.0f + std::exp(-gate.get_data()[i]));
+        Tensor<float> out = matmul(gate * up, w_down) + x;
+        benchmark::DoNotOptimize(out);
+    }
+    set_gflops(state, 6.0 * M * H * F);
+}
+
+static void BM_Ffn_Fused(benchmark::State& state) {
+    size_t M = state.range(0);
+    size_t H = state.range(1);
+    size_t F = state.range(2);
+    Tensor<float> x = Tensor<float>::fill_random({M, H}, -1.0f, 1.0f);
+    PackedMatrix<float> w_gate = PackedMatrix<float>::from_tensor(Tensor<float>::fill_random({F, H}, -0.1f, 0.1f), true);
+    PackedMatrix<float> w_up = PackedMatrix<float>::from_tensor(Tensor<float>::fill_random({F, H}, -0.1f, 0.1f), true);
+    PackedMatrix<float> w_down = PackedMatrix<float>::from_tensor(Tensor<float>::fill_random({H, F}, -0.1f, 0.1f), true);
+
+    for (auto _ : state) {
+        Tensor<float> gate = matmul(x, w_gate, Epilogue<float>{.act = kernel::activation::silu});
+        Tensor<float> activated = matmul(x, w_up, Epilogue<float>{.mul = gate});
+        Tensor<float> out = x.clone();
+        gemm(activated, w_down, out, 1.0f, 1.0f);
+        benchmark::DoNotOptimize(out);
+    }
+    set_gflops(state, 6.0 * M * H * F);
+}
+
+// the same FFN through nn::SwiGLU: one GEMM against the concatenated gate/up weight per row tile
+static void BM_Ffn_SwiGLU(benchmark::State& state) {
+    size_t M = state.range(0);
+    size_t H = state.range(1);
+    size_t F = state.range(2);
+    Tensor<float> x = Tensor<float>::fill_random({M, H}, -1.0f, 1.0f);
+    PackedMatrix<float> w_gate_up = PackedMatrix<float>::from_tensor(Tensor<float>::fill_random({2 * F, H}, -0.1f, 0.1f), true);
+    PackedMatrix<float> w_down = PackedMatrix<float>::from_tensor(Tensor<float>::fill_random({H, F}, -0.1f, 0.1f), true);
+    nn::SwiGLU<float, PackedMatrix<float>> ffn(w_gate_up, w_down);
+
+    for (auto _ : state) {
+        Tensor<float> out = x.clone();
+        ffn.forward(x, out, 1.0f);
+        benchmark::DoNotOptimize(out);
+    }
+    set_gflops(state, 6.0 * M * H * F);
 }
 
 BENCHMARK(BM_Matmul2D_Square)->Args({8})
@@ -50,16 +400,97 @@ BENCHMARK(BM_Matmul2D_Square)->Args({8})
                                  ->Args({512})
                                  ->Args({1024})
                                  ->Args({2048})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Matmul2D_Square_Dot)->Args({8})
+                                 ->Args({16})
+                                 ->Args({256})
+                                 ->Args({512})
+                                 ->Args({1024})
+                                 ->Args({2048})->Unit(benchmark::kMillisecond)->UseRealTime();
 BENCHMARK(BM_Matmul2D_Rectangular)->Args({8, 4, 8})
                                     ->Args({16, 8, 32})
                                     ->Args({256, 512, 128})
                                     ->Args({512, 256, 1024})
                                     ->Args({1024, 512, 2048})
                                     ->Args({2048, 1024, 4096})
+                                    ->Args({896, 896, 4864})
+                                    ->Args({1, 100000000, 1})
+                                    ->Args({10000, 1, 10000})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Matmul2D_Rectangular_Dot)->Args({8, 4, 8})
+                                    ->Args({16, 8, 32})
+                                    ->Args({256, 512, 128})
+                                    ->Args({512, 256, 1024})
+                                    ->Args({1024, 512, 2048})
+                                    ->Args({2048, 1024, 4096})
+                                    ->Args({896, 896, 4864})
                                     ->Args({1, 100000000, 1})
                                     ->Args({10000, 1, 10000})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Matmul2D_SplitK)->Args({1, 100000000, 1})
+                               ->Args({1, 16777216, 4})
+                               ->Args({4, 4194304, 4})
+                               ->Args({8, 1048576, 8})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Matmul2D_SplitK_Gemv)->Args({1, 100000000, 1})
+                                    ->Args({1, 16777216, 4})
+                                    ->Args({4, 4194304, 4})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Matmul2D_Rank1)->Args({10000, 10000})
+                              ->Args({4096, 4096})
+                              ->Args({100000, 64})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Matmul2D_Rank1_Gemm)->Args({10000, 10000})
+                                   ->Args({4096, 4096})
+                                   ->Args({100000, 64})->Unit(benchmark::kMillisecond)->UseRealTime();
 BENCHMARK(BM_Matmul_Broadcast)->Args({4, 8, 4, 8})
                                 ->Args({10, 256, 512, 128})
                                 ->Args({20, 512, 256, 1024})
                                 ->Args({30, 1024, 512, 2048})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Matmul_BatchedHeads)->Args({14, 1, 128, 64})
+                                   ->Args({14, 16, 16, 64})
+                                   ->Args({14, 128, 128, 64})
+                                   ->Args({64, 32, 32, 32})
+                                   ->Args({2, 512, 512, 64})->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(BM_Matmul_Weight)->Args({16, 896, 896})
+                             ->Args({16, 896, 4864})
+                             ->Args({16, 4864, 896})
+                             ->Args({128, 896, 4864})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Matmul_WeightPrepacked)->Args({16, 896, 896})
+                                     ->Args({16, 896, 4864})
+                                     ->Args({16, 4864, 896})
+                                     ->Args({128, 896, 4864})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Matmul_WeightPrepackedF16)->Args({16, 896, 896})
+                                        ->Args({16, 896, 4864})
+                                        ->Args({16, 4864, 896})
+                                        ->Args({128, 896, 4864})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Ffn_Unfused)->Args({1, 896, 4864})
+                           ->Args({16, 896, 4864})
+                           ->Args({128, 896, 4864})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Ffn_Fused)->Args({1, 896, 4864})
+                         ->Args({16, 896, 4864})
+                         ->Args({128, 896, 4864})
+                         ->Args({512, 896, 4864})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Ffn_SwiGLU)->Args({1, 896, 4864})
+                          ->Args({16, 896, 4864})
+                          ->Args({128, 896, 4864})
+                          ->Args({512, 896, 4864})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Gemv_Decode)->Args({896, 896})
+                           ->Args({896, 4864})
+                           ->Args({4864, 896})
+                           ->Args({896, 151936})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Gemv_DecodePrepacked)->Args({896, 896})
+                                   ->Args({896, 4864})
+                                   ->Args({4864, 896})
+                                   ->Args({896, 151936})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Gemv_DecodePrepackedF16)->Args({896, 896})
+                                      ->Args({896, 4864})
+                                      ->Args({4864, 896})
+                                      ->Args({896, 151936})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Gemv_DecodeGemmPath)->Args({896, 896})
+                                  ->Args({896, 4864})
+                                  ->Args({4864, 896})
+                                  ->Args({896, 151936})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Matmul_Quantized)->Args({1, 896, 4864, 0})
+                                ->Args({1, 896, 4864, 1})
+                                ->Args({1, 4864, 896, 2})
+                                ->Args({1, 896, 151936, 0})
+                                ->Args({128, 896, 4864, 0})
+                                ->Args({128, 4864, 896, 2})->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_Matmul_WeightIsa)->ArgsProduct({{1, 128}, {896}, {4864}, {0, 1, 2, 3}})
+                                ->Unit(benchmark::kMillisecond)->UseRealTime();
 BENCHMARK_MAIN();
\ No newline at end of file
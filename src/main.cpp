@@ -117,11 +117,15 @@ int main() {
     std::cin >> ans_len;
     answer = prompt;
 
+    // the prompt goes through the model once, every later step only feeds the token it picked
     auto start = std::chrono::steady_clock::now();
-    for (int _ = 0; _ < ans_len; _++) {
-        auto res = qwen_model.tk.encode(answer);
-        std::string model_output = qwen_model.run_inference(res);
-        answer += model_output;
+    if (ans_len > 0) {
+        int token = qwen_model.prefill(qwen_model.tk.encode(prompt));
+        for (int i = 0; i < ans_len; i++) {
+            answer += qwen_model.tk.get_token(token);
+            if (i + 1 < ans_len)
+                token = qwen_model.decode(token);
+        }
     }
     auto end = std::chrono::steady_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
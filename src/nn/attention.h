@@ -0,0 +1,289 @@
+#pragma once
+
+#include "../tensor/tensor.h"
+#include "../tensor/vmath.h"
+#include "kv_cache.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace blass {
+    namespace nn {
+        namespace functional {
+            // queries and keys per tile of causal_attention: a 64-key tile of K and V is 32 KiB
+            // at head_dim 64, so it stays in L1 while the 16 query rows stream past it
+            constexpr size_t ATTN_BLOCK_Q = 16;
+            constexpr size_t ATTN_BLOCK_K = 64;
+
+            /**
+            * Causal softmax(q k^T / sqrt(head_dim)) v for q: [batch, seq, heads, head_dim] at
+            * positions past_len .. past_len + seq - 1 and k, v: [batch, past_len + seq,
+            * kv_heads, head_dim], without materialising the scores. Query head h reads KV head
+            * h / (heads / kv_heads) (grouped-query attention), and a task covers one query
+            * tile of every head in a group, so each K/V tile is loaded once for the whole
+            * group. The tile streams the key/value tiles it can see, keeping a running max and
+            * sum per row (online softmax), so tiles entirely above the diagonal are never
+            * touched and the extra memory is O(tile) per thread. Any strides as long as
+            * head_dim is contiguous. Returns [batch, seq, heads, head_dim].
+            */
+            template <typename T>
+            Tensor<T> causal_attention(const Tensor<T>& q_raw, const Tensor<T>& k_raw, const Tensor<T>& v_raw, size_t past_len = 0) {
+                const std::vector<size_t>& shape = q_raw.get_shape();
+                const std::vector<size_t>& kv_shape = k_raw.get_shape();
+                if (shape.size() != 4 || kv_shape.size() != 4 || v_raw.get_shape() != kv_shape || kv_shape[0] != shape[0] ||
+                    kv_shape[1] != past_len + shape[1] || kv_shape[2] == 0 || shape[2] % kv_shape[2] != 0 || kv_shape[3] != shape[3]) {
+                    throw std::invalid_argument("Cannot attend with queries of shape " + utils::to_string_vec(shape) + " at position " +
+                                                std::to_string(past_len) + " over keys of shape " + utils::to_string_vec(kv_shape) +
+                                                " and values of shape " + utils::to_string_vec(v_raw.get_shape()));
+                }
+
+                Tensor<T> q = q_raw.get_stride(3) == 1 ? q_raw : q_raw.contiguous();
+                Tensor<T> k = k_raw.get_stride(3) == 1 ? k_raw : k_raw.contiguous();
+                Tensor<T> v = v_raw.get_stride(3) == 1 ? v_raw : v_raw.contiguous();
+
+                size_t batch_size = shape[0];
+                size_t seq_len = shape[1];
+                size_t n_heads = shape[2];
+                size_t n_kv_heads = kv_shape[2];
+                size_t group = n_heads / n_kv_heads;
+                size_t head_dim = shape[3];
+                size_t n_tiles = (seq_len + ATTN_BLOCK_Q - 1) / ATTN_BLOCK_Q;
+                T scale = T(1) / std::sqrt(T(head_dim));
+
+                Tensor<T> out = Tensor<T>::from_shape({batch_size, seq_len, n_heads, head_dim});
+                const T* q_data = q.get_data();
+                const T* k_data = k.get_data();
+                const T* v_data = v.get_data();
+                T* out_data = out.get_data();
+
+                #pragma omp parallel
+                {
+                    // rows of the task: query i of head g * group + r is row r * ATTN_BLOCK_Q + i - i0
+                    std::vector<T> acc(group * ATTN_BLOCK_Q * head_dim);
+                    std::vector<T> row_max(group * ATTN_BLOCK_Q);
+                    std::vector<T> row_sum(group * ATTN_BLOCK_Q);
+                    std::vector<T> scores(ATTN_BLOCK_K);
+
+                    // later tiles see more keys, so hand them out dynamically
+                    #pragma omp for collapse(3) schedule(dynamic)
+                    for (size_t b = 0; b < batch_size; b++) {
+                        for (size_t g = 0; g < n_kv_heads; g++) {
+                            for (size_t tile = 0; tile < n_tiles; tile++) {
+                                size_t i0 = tile * ATTN_BLOCK_Q;
+                                size_t i1 = std::min(seq_len, i0 + ATTN_BLOCK_Q);
+                                const T* k_head = k_data + b * k.get_stride(0) + g * k.get_stride(2);
+                                const T* v_head = v_data + b * v.get_stride(0) + g * v.get_stride(2);
+
+                                kernel::run_isa([&] {
+                                    std::fill(acc.begin(), acc.end(), T(0));
+                                    std::fill(row_max.begin(), row_max.end(), -std::numeric_limits<T>::infinity());
+                                    std::fill(row_sum.begin(), row_sum.end(), T(0));
+
+                                    // the last query of the tile sees keys up to past_len + i1 - 1
+                                    size_t key_end = past_len + i1;
+                                    for (size_t j0 = 0; j0 < key_end; j0 += ATTN_BLOCK_K) {
+                                        size_t j1 = std::min(key_end, j0 + ATTN_BLOCK_K);
+
+                                        for (size_t r = 0; r < group; r++) {
+                                            const T* q_head = q_data + b * q.get_stride(0) + (g * group + r) * q.get_stride(2);
+
+                                            for (size_t i = i0; i < i1; i++) {
+                                                size_t limit = std::min(j1, past_len + i + 1);
+                                                if (limit <= j0)
+                                                    continue;
+
+                                                size_t row = r * ATTN_BLOCK_Q + i - i0;
+                                                const T* __restrict__ q_row = q_head + i * q.get_stride(1);
+                                                T* __restrict__ acc_row = acc.data() + row * head_dim;
+                                                T tile_max = -std::numeric_limits<T>::infinity();
+                                                for (size_t j = j0; j < limit; j++) {
+                                                    const T* __restrict__ k_row = k_head + j * k.get_stride(1);
+                                                    T dot = 0;
+                                                    #pragma omp simd reduction(+:dot)
+                                                    for (size_t d = 0; d < head_dim; d++)
+                                                        dot += q_row[d] * k_row[d];
+                                                    scores[j - j0] = dot * scale;
+                                                    tile_max = std::max(tile_max, scores[j - j0]);
+                                                }
+
+                                                // rescale what was accumulated against the old max
+                                                T new_max = std::max(row_max[row], tile_max);
+                                                T correction = kernel::fast_exp(row_max[row] - new_max);
+                                                row_sum[row] *= correction;
+                                                #pragma omp simd
+                                                for (size_t d = 0; d < head_dim; d++)
+                                                    acc_row[d] *= correction;
+
+                                                for (size_t j = j0; j < limit; j++) {
+                                                    const T* __restrict__ v_row = v_head + j * v.get_stride(1);
+                                                    T p = kernel::fast_exp(scores[j - j0] - new_max);
+                                                    row_sum[row] += p;
+                                                    #pragma omp simd
+                                                    for (size_t d = 0; d < head_dim; d++)
+                                                        acc_row[d] += p * v_row[d];
+                                                }
+                                                row_max[row] = new_max;
+                                            }
+                                        }
+                                    }
+
+                                    for (size_t r = 0; r < group; r++) {
+                                        for (size_t i = i0; i < i1; i++) {
+                                            size_t row = r * ATTN_BLOCK_Q + i - i0;
+                                            T* __restrict__ out_row = out_data + ((b * seq_len + i) * n_heads + g * group + r) * head_dim;
+                                            const T* __restrict__ acc_row = acc.data() + row * head_dim;
+                                            T inv_sum = T(1) / row_sum[row];
+                                            #pragma omp simd
+                                            for (size_t d = 0; d < head_dim; d++)
+                                                out_row[d] = acc_row[d] * inv_sum;
+                                        }
+                                    }
+                                });
+                            }
+                        }
+                    }
+                }
+                return out;
+            }
+
+            /**
+            * Causal attention of ragged rows over paged caches: q is [1, rows, heads, head_dim]
+            * and the next lengths[s] rows belong to sequence s, at positions past_lens[s] ..
+            * past_lens[s] + lengths[s] - 1, whose keys and values one layer of the pool holds
+            * in the blocks of tables[s]. Query head h uses KV head h / (heads / kv_heads), and
+            * all heads of a group are scored against a K/V row while it is in cache. One task
+            * per (row, KV head) across all sequences, so a batch of single-token decode steps
+            * still spreads over every thread. Returns [1, rows, heads, head_dim].
+            */
+            template <typename T>
+            Tensor<T> paged_attention(const Tensor<T>& q_raw, const KVBlockPool<T>& pool, const std::vector<const std::vector<uint32_t>*>& tables,
+                                      const std::vector<size_t>& past_lens, const std::vector<size_t>& lengths, size_t layer) {
+                const std::vector<size_t>& shape = q_raw.get_shape();
+                size_t n_rows = 0;
+                bool fits = tables.size() == past_lens.size() && tables.size() == lengths.size();
+                for (size_t s = 0; fits && s < tables.size(); s++) {
+                    n_rows += lengths[s];
+                    fits = past_lens[s] + lengths[s] <= tables[s]->size() * pool.get_block_size();
+                }
+                if (shape.size() != 4 || shape[0] != 1 || shape[1] != n_rows || shape[3] != pool.get_head_dim() ||
+                    shape[2] % pool.num_kv_heads() != 0 || !fits) {
+                    throw std::invalid_argument("Cannot attend with queries of shape " + utils::to_string_vec(shape) + " over " +
+                                                std::to_string(tables.size()) + " paged sequences of " + std::to_string(n_rows) +
+                                                " new positions with " + std::to_string(pool.num_kv_heads()) + " heads of " +
+                                                std::to_string(pool.get_head_dim()));
+                }
+
+                Tensor<T> q = q_raw.contiguous();
+                size_t n_heads = shape[2];
+                size_t head_dim = shape[3];
+                size_t group = n_heads / pool.num_kv_heads();
+                size_t block_size = pool.get_block_size();
+                size_t row = pool.num_kv_heads() * head_dim;
+                T scale = T(1) / std::sqrt(T(head_dim));
+
+                // sequence and position of every row
+                std::vector<size_t> row_seq(n_rows), row_pos(n_rows);
+                size_t max_keys = 0;
+                for (size_t s = 0, i = 0; s < tables.size(); s++) {
+                    for (size_t t = 0; t < lengths[s]; t++, i++) {
+                        row_seq[i] = s;
+                        row_pos[i] = past_lens[s] + t;
+                    }
+                    max_keys = std::max(max_keys, past_lens[s] + lengths[s]);
+                }
+
+                Tensor<T> out = Tensor<T>::from_shape({1, n_rows, n_heads, head_dim});
+                const T* q_data = q.get_data();
+                T* out_data = out.get_data();
+
+                #pragma omp parallel
+                {
+                    // scores of head g * group + r at row r
+                    std::vector<T> scores(group * max_keys);
+                    size_t ld_scores = max_keys;
+
+                    // one task per (query, KV head): every K/V row is read once for the whole group
+                    #pragma omp for collapse(2)
+                    for (size_t i = 0; i < n_rows; i++) {
+                        for (size_t g = 0; g < pool.num_kv_heads(); g++) {
+                            const uint32_t* table = tables[row_seq[i]]->data();
+                            const T* q_rows = q_data + (i * n_heads + g * group) * head_dim;
+                            T* out_rows = out_data + (i * n_heads + g * group) * head_dim;
+                            size_t kv_offset = g * head_dim;
+                            size_t n_keys = row_pos[i] + 1;
+
+                            kernel::run_isa([&] {
+                                for (size_t pos = 0; pos < n_keys; pos += block_size) {
+                                    const T* keys = pool.keys(table[pos / block_size], layer) + kv_offset;
+                                    size_t run = std::min(block_size, n_keys - pos);
+                                    for (size_t t = 0; t < run; t++) {
+                                        const T* __restrict__ k_row = keys + t * row;
+                                        for (size_t r = 0; r < group; r++) {
+                                            const T* __restrict__ q_row = q_rows + r * head_dim;
+                                            T dot = 0;
+                                            #pragma omp simd reduction(+:dot)
+                                            for (size_t d = 0; d < head_dim; d++)
+                                                dot += q_row[d] * k_row[d];
+                                            scores[r * ld_scores + pos + t] = dot * scale;
+                                        }
+                                    }
+                                }
+
+                                // normalised up front, so the V pass needs no final scaling
+                                for (size_t r = 0; r < group; r++)
+                                    kernel::softmax_row(scores.data() + r * ld_scores, scores.data() + r * ld_scores, n_keys);
+
+                                for (size_t d = 0; d < group * head_dim; d++)
+                                    out_rows[d] = 0;
+                                for (size_t pos = 0; pos < n_keys; pos += block_size) {
+                                    const T* values = pool.values(table[pos / block_size], layer) + kv_offset;
+                                    size_t run = std::min(block_size, n_keys - pos);
+                                    for (size_t t = 0; t < run; t++) {
+                                        const T* __restrict__ v_row = values + t * row;
+                                        for (size_t r = 0; r < group; r++) {
+                                            T* __restrict__ out_row = out_rows + r * head_dim;
+                                            T p = scores[r * ld_scores + pos + t];
+                                            #pragma omp simd
+                                            for (size_t d = 0; d < head_dim; d++)
+                                                out_row[d] += p * v_row[d];
+                                        }
+                                    }
+                                }
+                            });
+                        }
+                    }
+                }
+                return out;
+            }
+
+            /**
+            * Causal attention of q ([1, seq, heads, head_dim], at positions past_len ..
+            * past_len + seq - 1) over the keys and values one layer of a paged cache holds.
+            */
+            template <typename T>
+            Tensor<T> paged_attention(const Tensor<T>& q, const PagedKVCache<T>& cache, size_t layer, size_t past_len) {
+                size_t seq_len = q.get_shape().size() == 4 ? q.get_shape(1) : 0;
+                return paged_attention(q, cache.get_pool(), {&cache.get_block_table()}, {past_len}, {seq_len}, layer);
+            }
+
+            /**
+            * Attention of one step of a PagedBatch, after its keys and values were appended
+            * and before it advanced.
+            */
+            template <typename T>
+            Tensor<T> paged_attention(const Tensor<T>& q, const PagedBatch<T>& batch, size_t layer) {
+                std::vector<const std::vector<uint32_t>*> tables;
+                std::vector<size_t> past_lens, lengths;
+                for (size_t s = 0; s < batch.num_sequences(); s++) {
+                    tables.push_back(&batch.sequence(s).get_block_table());
+                    past_lens.push_back(batch.sequence(s).size());
+                    lengths.push_back(batch.length(s));
+                }
+                if (tables.empty())
+                    throw std::invalid_argument("Cannot attend over an empty batch");
+                return paged_attention(q, batch.sequence(0).get_pool(), tables, past_lens, lengths, layer);
+            }
+        }
+    }
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "../tensor/tensor.h"
+#include "../tensor/vmath.h"
+#include "modules.h"
+#include <algorithm>
+#include <memory>
+#include <variant>
+
+namespace blass {
+    namespace nn {
+        // rows of input per SwiGLU tile. Every tile streams all three weights again, so
+        // smaller tiles (a gate/up block that fits L2) lose more in weight traffic than they
+        // save; 128 rows bounds the scratch at 1.5 MiB per 1024 ffn channels
+        constexpr size_t SWIGLU_BLOCK_ROWS = 128;
+
+        /**
+        * The SwiGLU feed-forward (silu(x W_gate) * (x W_up)) W_down with gate and up held as
+        * one [hidden, 2 * ffn_dim] matrix, gate columns first, so both come out of a single
+        * pass over x. Runs a tile of rows at a time through the gate/up GEMM, the silu * up
+        * combine and the down GEMM, reusing the same two scratch blocks for every tile.
+        * W is a matrix type with a gemm overload (PackedMatrix, QuantizedMatrix) or a
+        * std::variant of them.
+        */
+        template <typename T, typename W>
+        class SwiGLU : public Module<T> {
+            W gate_up;
+            W down;
+
+            static size_t cols(const W& w) {
+                if constexpr (requires { w.cols(); })
+                    return w.cols();
+                else
+                    return std::visit([](const auto& m) { return m.cols(); }, w);
+            }
+
+            // c = a * w^T + beta * c
+            static void product(const Tensor<T>& a, const W& w, Tensor<T>& c, T beta) {
+                if constexpr (requires { w.cols(); })
+                    gemm(a, w, c, T(1), beta);
+                else
+                    std::visit([&](const auto& m) { gemm(a, m, c, T(1), beta); }, w);
+            }
+
+            // rows [begin, end) of a contiguous [rows, width] tensor, sharing its storage
+            static Tensor<T> row_block(const Tensor<T>& x, size_t begin, size_t end, size_t width) {
+                std::shared_ptr<T[]> block(x.get_data_ptr(), x.get_data() + begin * width);
+                return Tensor<T>(block, {end - begin, width});
+            }
+
+        public:
+            SwiGLU() {}
+
+            SwiGLU(W gate_up_, W down_) {
+                load_gate_up(std::move(gate_up_));
+                load_down(std::move(down_));
+            }
+
+            void load_gate_up(W w) {
+                if (cols(w) % 2 != 0)
+                    throw std::invalid_argument("SwiGLU gate/up matrix needs an even number of columns, got " + std::to_string(cols(w)));
+                gate_up = std::move(w);
+            }
+
+            void load_down(W w) {
+                down = std::move(w);
+            }
+
+            const W& get_gate_up() const {
+                return gate_up;
+            }
+
+            const W& get_down() const {
+                return down;
+            }
+
+            size_t get_ffn_dim() const {
+                return cols(gate_up) / 2;
+            }
+
+            /**
+            * out = beta * out + swiglu(input) over the last dimension; out must be a contiguous
+            * tensor of input's shape. beta = 1 adds the result onto out, e.g. a residual.
+            */
+            void forward(const Tensor<T>& input, Tensor<T>& out, T beta) {
+                size_t ffn_dim = get_ffn_dim();
+                size_t hidden = input.get_shape().back();
+                if (out.get_shape() != input.get_shape() || !out.is_contiguous()) {
+                    throw std::invalid_argument("SwiGLU output must be a contiguous tensor of shape " + utils::to_string_vec(input.get_shape()) +
+                                                ", got " + utils::to_string_vec(out.get_shape()));
+                }
+                if (cols(down) != hidden) {
+                    throw std::invalid_argument("SwiGLU down projection has " + std::to_string(cols(down)) +
+                                                " outputs for an input of width " + std::to_string(hidden));
+                }
+
+                Tensor<T> x = input.contiguous();
+                size_t n_rows = hidden == 0 ? 0 : x.size() / hidden;
+                size_t block_rows = std::min(n_rows, SWIGLU_BLOCK_ROWS);
+                Tensor<T> gate_up_block = Tensor<T>::from_shape({block_rows, 2 * ffn_dim});
+                Tensor<T> activated_block = Tensor<T>::from_shape({block_rows, ffn_dim});
+
+                for (size_t r0 = 0; r0 < n_rows; r0 += SWIGLU_BLOCK_ROWS) {
+                    size_t rows = std::min(SWIGLU_BLOCK_ROWS, n_rows - r0);
+                    Tensor<T> gu = row_block(gate_up_block, 0, rows, 2 * ffn_dim);
+                    Tensor<T> activated = row_block(activated_block, 0, rows, ffn_dim);
+                    Tensor<T> out_rows = row_block(out, r0, r0 + rows, hidden);
+
+                    product(row_block(x, r0, r0 + rows, hidden), gate_up, gu, T(0));
+
+                    const T* gu_data = gu.get_data();
+                    T* act_data = activated.get_data();
+                    #pragma omp parallel for if (rows * ffn_dim >= (1 << 14))
+                    for (size_t i = 0; i < rows; i++) {
+                        kernel::run_isa([&] {
+                            const T* __restrict__ g = gu_data + i * 2 * ffn_dim;
+                            const T* __restrict__ u = g + ffn_dim;
+                            T* __restrict__ h = act_data + i * ffn_dim;
+                            #pragma omp simd
+                            for (size_t j = 0; j < ffn_dim; j++)
+                                h[j] = kernel::fast_silu(g[j]) * u[j];
+                        });
+                    }
+
+                    product(activated, down, out_rows, beta);
+                }
+            }
+
+            Tensor<T> forward(const Tensor<T>& input) override {
+                Tensor<T> out = Tensor<T>::from_shape(input.get_shape());
+                forward(input, out, T(0));
+                return out;
+            }
+        };
+    }
+}
@@ -1,10 +1,15 @@
 #pragma once
 
 #include <iostream>
-#include <variant>
+#include <chrono>
+#include <sstream>
 #include <cstdint>
 #include <vector>
 #include <cstring>
+#include <memory>
+#include <cassert>
+#include <string_view>
+#include <type_traits>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -38,9 +43,29 @@ namespace blass {
                     throw std::runtime_error("mmap failed");
                 }
             }
+
+            // unmapped exactly once, by whoever holds the last reference
+            MemoryMappedFile(const MemoryMappedFile&) = delete;
+            MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+            /**
+            * madvise over the pages covering [ptr, ptr + bytes) of the mapping, e.g.
+            * MADV_WILLNEED to read a tensor ahead or MADV_DONTNEED to drop the pages of one
+            * that was copied out. Only a hint: failures are ignored.
+            */
+            void advise(const void* ptr, size_t bytes, int advice) {
+                size_t page = sysconf(_SC_PAGESIZE);
+                uintptr_t begin = (uintptr_t)ptr / page * page;
+                uintptr_t end = (uintptr_t)ptr + bytes;
+                uintptr_t map_end = (uintptr_t)data + size;
+                end = std::min(end, map_end);
+                if (bytes == 0 || begin < (uintptr_t)data || end <= begin)
+                    return;
+                madvise((void*)begin, end - begin, advice);
+            }
             
             template<typename T>
-            T read_at(size_t offset) {
+            T read_at(size_t offset) const {
                 if (offset + sizeof(T) > size) {
                     throw std::runtime_error("Read out of bounds in MemoryMappedFile");
                 }
@@ -49,11 +74,15 @@ namespace blass {
                 return out;
             }
 
-            std::string read_string_at(size_t offset, size_t length) {
-                if (offset + length > size) {
+            std::string read_string_at(size_t offset, size_t length) const {
+                return std::string(view_at(offset, length));
+            }
+
+            std::string_view view_at(size_t offset, size_t length) const {
+                if (offset > size || length > size - offset) {
                     throw std::runtime_error("Read out of bounds in MemoryMappedFile");
                 }
-                return std::string((char*)data + offset, length);
+                return std::string_view((char*)data + offset, length);
             }
 
             ~MemoryMappedFile() {
@@ -107,18 +136,74 @@ namespace blass {
             GGML_TYPE_COUNT   = 40,
         };
 
-        #define QK_K 256
-        struct block_q4_K {
-            union {
-                struct {
-                    uint16_t d;
-                    uint16_t dmin;
-                };
-            };
+        constexpr uint32_t GGML_MAX_DIMS = 4;
+
+        /**
+        * Elements per block and bytes per block of a tensor type (1 element per block for
+        * the plain types). Returns false for types this reader does not know.
+        */
+        inline bool ggml_type_layout(ggml_type type, uint64_t &block_elems, uint64_t &block_bytes) {
+            switch (type) {
+                case GGML_TYPE_F32:     block_elems = 1;   block_bytes = 4;   return true;
+                case GGML_TYPE_F16:     block_elems = 1;   block_bytes = 2;   return true;
+                case GGML_TYPE_Q4_0:    block_elems = 32;  block_bytes = 18;  return true;
+                case GGML_TYPE_Q4_1:    block_elems = 32;  block_bytes = 20;  return true;
+                case GGML_TYPE_Q5_0:    block_elems = 32;  block_bytes = 22;  return true;
+                case GGML_TYPE_Q5_1:    block_elems = 32;  block_bytes = 24;  return true;
+                case GGML_TYPE_Q8_0:    block_elems = 32;  block_bytes = 34;  return true;
+                case GGML_TYPE_Q8_1:    block_elems = 32;  block_bytes = 36;  return true;
+                case GGML_TYPE_Q2_K:    block_elems = 256; block_bytes = 84;  return true;
+                case GGML_TYPE_Q3_K:    block_elems = 256; block_bytes = 110; return true;
+                case GGML_TYPE_Q4_K:    block_elems = 256; block_bytes = 144; return true;
+                case GGML_TYPE_Q5_K:    block_elems = 256; block_bytes = 176; return true;
+                case GGML_TYPE_Q6_K:    block_elems = 256; block_bytes = 210; return true;
+                case GGML_TYPE_Q8_K:    block_elems = 256; block_bytes = 292; return true;
+                case GGML_TYPE_IQ2_XXS: block_elems = 256; block_bytes = 66;  return true;
+                case GGML_TYPE_IQ2_XS:  block_elems = 256; block_bytes = 74;  return true;
+                case GGML_TYPE_IQ3_XXS: block_elems = 256; block_bytes = 98;  return true;
+                case GGML_TYPE_IQ1_S:   block_elems = 256; block_bytes = 50;  return true;
+                case GGML_TYPE_IQ4_NL:  block_elems = 32;  block_bytes = 18;  return true;
+                case GGML_TYPE_IQ3_S:   block_elems = 256; block_bytes = 110; return true;
+                case GGML_TYPE_IQ2_S:   block_elems = 256; block_bytes = 82;  return true;
+                case GGML_TYPE_IQ4_XS:  block_elems = 256; block_bytes = 136; return true;
+                case GGML_TYPE_I8:      block_elems = 1;   block_bytes = 1;   return true;
+                case GGML_TYPE_I16:     block_elems = 1;   block_bytes = 2;   return true;
+                case GGML_TYPE_I32:     block_elems = 1;   block_bytes = 4;   return true;
+                case GGML_TYPE_I64:     block_elems = 1;   block_bytes = 8;   return true;
+                case GGML_TYPE_F64:     block_elems = 1;   block_bytes = 8;   return true;
+                case GGML_TYPE_IQ1_M:   block_elems = 256; block_bytes = 56;  return true;
+                case GGML_TYPE_BF16:    block_elems = 1;   block_bytes = 2;   return true;
+                case GGML_TYPE_TQ1_0:   block_elems = 256; block_bytes = 54;  return true;
+                case GGML_TYPE_TQ2_0:   block_elems = 256; block_bytes = 66;  return true;
+                case GGML_TYPE_MXFP4:   block_elems = 32;  block_bytes = 17;  return true;
+                default: return false;
+            }
+        }
+
+        /**
+        * Bytes of the data of a tensor of type with dims (innermost last). Throws for unknown
+        * types, rows that are not whole blocks and sizes that do not fit 64 bits.
+        */
+        inline uint64_t ggml_tensor_bytes(const std::string &name, ggml_type type, const std::vector<uint64_t> &dims) {
+            uint64_t block_elems, block_bytes;
+            if (!ggml_type_layout(type, block_elems, block_bytes))
+                throw std::runtime_error("Tensor " + name + " has unsupported type " + std::to_string((uint32_t)type));
+            if (!dims.empty() && dims.back() % block_elems != 0) {
+                throw std::runtime_error("Tensor " + name + " has rows of " + std::to_string(dims.back()) + " elements, not a multiple of its " +
+                                         std::to_string(block_elems) + "-element blocks");
+            }
 
-            uint8_t scales[12];
-            uint8_t qk[QK_K / 2];
-        };
+            uint64_t elems = 1;
+            for (uint64_t d : dims) {
+                if (d != 0 && elems > UINT64_MAX / d)
+                    throw std::runtime_error("Tensor " + name + " has more elements than fit in 64 bits");
+                elems *= d;
+            }
+            uint64_t blocks = elems / block_elems;
+            if (blocks > UINT64_MAX / block_bytes)
+                throw std::runtime_error("Tensor " + name + " has more bytes than fit in 64 bits");
+            return blocks * block_bytes;
+        }
 
         enum gguf_metadata_value_type: uint32_t {
             // The value is a 8-bit unsigned integer.
@@ -153,177 +238,368 @@ namespace blass {
             GGUF_METADATA_VALUE_TYPE_FLOAT64 = 12,
         };
 
-        struct GGUFMetadataValue {
-            gguf_metadata_value_type type;
-            std::variant<
-                uint8_t,
-                int8_t,
-                uint16_t,
-                int16_t,
-                uint32_t,
-                int32_t,
-                float,
-                bool,
-                std::string,
-                std::vector<GGUFMetadataValue>,
-                uint64_t,
-                int64_t,
-                double
-            > value;
+        // bytes of a fixed-size metadata value, 0 for strings and arrays
+        inline size_t metadata_scalar_size(gguf_metadata_value_type type) {
+            switch (type) {
+                case GGUF_METADATA_VALUE_TYPE_UINT8:
+                case GGUF_METADATA_VALUE_TYPE_INT8:
+                case GGUF_METADATA_VALUE_TYPE_BOOL:
+                    return 1;
+                case GGUF_METADATA_VALUE_TYPE_UINT16:
+                case GGUF_METADATA_VALUE_TYPE_INT16:
+                    return 2;
+                case GGUF_METADATA_VALUE_TYPE_UINT32:
+                case GGUF_METADATA_VALUE_TYPE_INT32:
+                case GGUF_METADATA_VALUE_TYPE_FLOAT32:
+                    return 4;
+                case GGUF_METADATA_VALUE_TYPE_UINT64:
+                case GGUF_METADATA_VALUE_TYPE_INT64:
+                case GGUF_METADATA_VALUE_TYPE_FLOAT64:
+                    return 8;
+                default:
+                    return 0;
+            }
+        }
+
+        template <typename T>
+        T load_unaligned(const char* p) {
+            T out;
+            std::memcpy(&out, p, sizeof(T));
+            return out;
+        }
+
+        /**
+        * Bytes taken by a value of type whose payload starts at p, checked against end. Only
+        * strings are walked one by one; arrays of fixed-size elements are sized at once.
+        */
+        inline size_t metadata_payload_size(gguf_metadata_value_type type, const char* p, const char* end) {
+            size_t available = end - p;
+            size_t scalar = metadata_scalar_size(type);
+            if (scalar != 0) {
+                if (available < scalar)
+                    throw std::runtime_error("GGUF metadata value runs past the end of the file");
+                return scalar;
+            }
+
+            if (type == GGUF_METADATA_VALUE_TYPE_STRING) {
+                if (available < 8 || load_unaligned<uint64_t>(p) > available - 8)
+                    throw std::runtime_error("GGUF metadata string runs past the end of the file");
+                return 8 + load_unaligned<uint64_t>(p);
+            }
 
+            if (type == GGUF_METADATA_VALUE_TYPE_ARRAY) {
+                if (available < 12)
+                    throw std::runtime_error("GGUF metadata array runs past the end of the file");
+                gguf_metadata_value_type elem_type = load_unaligned<gguf_metadata_value_type>(p);
+                uint64_t length = load_unaligned<uint64_t>(p + 4);
+                size_t used = 12;
+                size_t elem = metadata_scalar_size(elem_type);
+                if (elem != 0) {
+                    if (length > (available - used) / elem)
+                        throw std::runtime_error("GGUF metadata array runs past the end of the file");
+                    return used + length * elem;
+                }
+                for (uint64_t i = 0; i < length; i++)
+                    used += metadata_payload_size(elem_type, p + used, end);
+                return used;
+            }
+
+            throw std::runtime_error("Unsupported GGUF metadata value type " + std::to_string((uint32_t)type));
+        }
+
+        template <typename T>
+        constexpr gguf_metadata_value_type metadata_type_of() {
+            if constexpr (std::is_same_v<T, uint8_t>) return GGUF_METADATA_VALUE_TYPE_UINT8;
+            else if constexpr (std::is_same_v<T, int8_t>) return GGUF_METADATA_VALUE_TYPE_INT8;
+            else if constexpr (std::is_same_v<T, uint16_t>) return GGUF_METADATA_VALUE_TYPE_UINT16;
+            else if constexpr (std::is_same_v<T, int16_t>) return GGUF_METADATA_VALUE_TYPE_INT16;
+            else if constexpr (std::is_same_v<T, uint32_t>) return GGUF_METADATA_VALUE_TYPE_UINT32;
+            else if constexpr (std::is_same_v<T, int32_t>) return GGUF_METADATA_VALUE_TYPE_INT32;
+            else if constexpr (std::is_same_v<T, float>) return GGUF_METADATA_VALUE_TYPE_FLOAT32;
+            else if constexpr (std::is_same_v<T, bool>) return GGUF_METADATA_VALUE_TYPE_BOOL;
+            else if constexpr (std::is_same_v<T, uint64_t>) return GGUF_METADATA_VALUE_TYPE_UINT64;
+            else if constexpr (std::is_same_v<T, int64_t>) return GGUF_METADATA_VALUE_TYPE_INT64;
+            else {
+                static_assert(std::is_same_v<T, double>, "Not a scalar GGUF metadata type");
+                return GGUF_METADATA_VALUE_TYPE_FLOAT64;
+            }
+        }
+
+        class GGUFArray;
+
+        /**
+        * A metadata value as a view into the mapped file. Parsing only records where the
+        * value lies; scalars decode on get<T>(), strings come back as string_views and
+        * arrays as GGUFArray views, so nothing is copied until the caller asks for it.
+        * Views stay valid while the mapping does.
+        */
+        class GGUFMetadataValue {
+            gguf_metadata_value_type type = GGUF_METADATA_VALUE_TYPE_UINT8;
+            // the payload, after the type tag
+            const char* data = nullptr;
+            size_t bytes = 0;
+
+            friend class GGUFArray;
+
+        public:
             GGUFMetadataValue() {}
-            GGUFMetadataValue(MemoryMappedFile &file, uint64_t &offset, int _type = -1) {
-                if (_type != -1) {
-                    type = (gguf_metadata_value_type)_type;
-                } 
-                else {
-                    type = file.read_at<gguf_metadata_value_type>(offset);
-                    offset += 4;
+
+            GGUFMetadataValue(gguf_metadata_value_type type_, const char* data_, const char* end)
+            : type(type_), data(data_), bytes(metadata_payload_size(type_, data_, end)) {}
+
+            // the tagged value at offset; moves offset past it
+            GGUFMetadataValue(const MemoryMappedFile &file, uint64_t &offset) {
+                type = file.read_at<gguf_metadata_value_type>(offset);
+                offset += 4;
+                data = (const char*)file.data + offset;
+                bytes = metadata_payload_size(type, data, (const char*)file.data + file.size);
+                offset += bytes;
+            }
+
+            gguf_metadata_value_type get_type() const {
+                return type;
+            }
+
+            // bytes of the payload in the file
+            size_t size() const {
+                return bytes;
+            }
+
+            template <typename T>
+            T get() const {
+                if (type != metadata_type_of<T>()) {
+                    throw std::runtime_error("GGUF metadata value has type " + std::to_string((uint32_t)type) + ", not " +
+                                             std::to_string((uint32_t)metadata_type_of<T>()));
                 }
+                if constexpr (std::is_same_v<T, bool>)
+                    return *data != 0;
+                else
+                    return load_unaligned<T>(data);
+            }
 
-                switch (type) {
-                    case GGUF_METADATA_VALUE_TYPE_UINT8: {
-                        value = file.read_at<uint8_t>(offset);
-                        offset += 1;
-                        break;
-                    }
-                    case GGUF_METADATA_VALUE_TYPE_INT8: {
-                        value = file.read_at<int8_t>(offset);
-                        offset += 1;
-                        break;
-                    }
-                    case GGUF_METADATA_VALUE_TYPE_UINT16: {
-                        value = file.read_at<uint16_t>(offset);
-                        offset += 2;
-                        break;
-                    }
-                    case GGUF_METADATA_VALUE_TYPE_INT16: {
-                        value = file.read_at<int16_t>(offset);
-                        offset += 2;
-                        break;
-                    }
-                    case GGUF_METADATA_VALUE_TYPE_UINT32: {
-                        value = file.read_at<uint32_t>(offset);
-                        offset += 4;
-                        break;
-                    }
-                    case GGUF_METADATA_VALUE_TYPE_INT32: {
-                        value = file.read_at<int32_t>(offset);
-                        offset += 4;
-                        break;
-                    }
-                    case GGUF_METADATA_VALUE_TYPE_FLOAT32: {
-                        value = file.read_at<float>(offset);
-                        offset += 4;
-                        break;
-                    }
-                    case GGUF_METADATA_VALUE_TYPE_BOOL: {
-                        value = file.read_at<uint8_t>(offset) != 0;
-                        offset += 1;
-                        break;
-                    }
-                    case GGUF_METADATA_VALUE_TYPE_STRING: {
-                        uint64_t length = file.read_at<uint64_t>(offset);
-                        offset += 8;
-                        value = file.read_string_at(offset, length);
-                        offset += length;
-                        break;
-                    }
-                    case GGUF_METADATA_VALUE_TYPE_UINT64: {
-                        value = file.read_at<uint64_t>(offset);
-                        offset += 8;
-                        break;
-                    }
-                    case GGUF_METADATA_VALUE_TYPE_INT64: {
-                        value = file.read_at<int64_t>(offset);
-                        offset += 8;
-                        break;
-                    }
-                    case GGUF_METADATA_VALUE_TYPE_FLOAT64: {
-                        value = file.read_at<double>(offset);
-                        offset += 8;
-                        break;
-                    }
-                    case GGUF_METADATA_VALUE_TYPE_ARRAY: {
-                        gguf_metadata_value_type elem_type = file.read_at<gguf_metadata_value_type>(offset);
-                        offset += 4;
-
-                        uint64_t length = file.read_at<uint64_t>(offset);
-                        offset += 8;
-
-                        std::vector<GGUFMetadataValue> vec;
-                        vec.reserve(length);
-                        for (uint64_t i = 0; i < length; i++) {
-                            GGUFMetadataValue elem(file, offset, elem_type);
-                            vec.push_back(elem);
-                        }
-                        value = vec;
-                        break;
-                    }
-                    default:
-                        std::cout << "Unsupported GGUF metadata value type: " << (uint32_t)type << std::endl;
-                        throw std::runtime_error("Unsupported GGUF metadata value type");
+            std::string_view get_string() const {
+                if (type != GGUF_METADATA_VALUE_TYPE_STRING)
+                    throw std::runtime_error("GGUF metadata value has type " + std::to_string((uint32_t)type) + ", not a string");
+                return std::string_view(data + 8, bytes - 8);
+            }
+
+            GGUFArray get_array() const;
+
+            std::string to_string() const;
+        };
+
+        /**
+        * The elements of an array value, read from the mapping as they are visited. Fixed-size
+        * elements are random access through get<T>(i); strings and nested arrays iterate in
+        * order, each step skipping one element.
+        */
+        class GGUFArray {
+            gguf_metadata_value_type elem_type = GGUF_METADATA_VALUE_TYPE_UINT8;
+            uint64_t length = 0;
+            const char* elems = nullptr;
+            // one past the last element
+            const char* stop = nullptr;
+
+        public:
+            class iterator {
+                gguf_metadata_value_type type;
+                const char* p;
+                const char* end;
+                uint64_t left;
+                GGUFMetadataValue current;
+
+                void load() {
+                    if (left > 0)
+                        current = GGUFMetadataValue(type, p, end);
                 }
+
+            public:
+                using value_type = GGUFMetadataValue;
+                using difference_type = std::ptrdiff_t;
+
+                iterator() : type(GGUF_METADATA_VALUE_TYPE_UINT8), p(nullptr), end(nullptr), left(0) {}
+
+                iterator(gguf_metadata_value_type type_, const char* p_, const char* end_, uint64_t left_)
+                : type(type_), p(p_), end(end_), left(left_) {
+                    load();
+                }
+
+                const GGUFMetadataValue& operator*() const {
+                    return current;
+                }
+
+                const GGUFMetadataValue* operator->() const {
+                    return &current;
+                }
+
+                iterator& operator++() {
+                    p += current.size();
+                    left--;
+                    load();
+                    return *this;
+                }
+
+                iterator operator++(int) {
+                    iterator before = *this;
+                    ++*this;
+                    return before;
+                }
+
+                bool operator==(const iterator& other) const {
+                    return left == other.left;
+                }
+            };
+
+            GGUFArray() {}
+
+            GGUFArray(const GGUFMetadataValue& value) {
+                if (value.type != GGUF_METADATA_VALUE_TYPE_ARRAY)
+                    throw std::runtime_error("GGUF metadata value has type " + std::to_string((uint32_t)value.type) + ", not an array");
+                elem_type = load_unaligned<gguf_metadata_value_type>(value.data);
+                length = load_unaligned<uint64_t>(value.data + 4);
+                elems = value.data + 12;
+                stop = value.data + value.bytes;
             }
 
-            std::string to_string() {
-                switch (type) {
-                    case GGUF_METADATA_VALUE_TYPE_UINT8:
-                        return std::to_string(std::get<uint8_t>(value));
-                    case GGUF_METADATA_VALUE_TYPE_INT8:
-                        return std::to_string(std::get<int8_t>(value));
-                    case GGUF_METADATA_VALUE_TYPE_UINT16:
-                        return std::to_string(std::get<uint16_t>(value));
-                    case GGUF_METADATA_VALUE_TYPE_INT16:
-                        return std::to_string(std::get<int16_t>(value));
-                    case GGUF_METADATA_VALUE_TYPE_UINT32:
-                        return std::to_string(std::get<uint32_t>(value));
-                    case GGUF_METADATA_VALUE_TYPE_INT32:
-                        return std::to_string(std::get<int32_t>(value));
-                    case GGUF_METADATA_VALUE_TYPE_FLOAT32:
-                        return std::to_string(std::get<float>(value));
-                    case GGUF_METADATA_VALUE_TYPE_BOOL:
-                        return std::get<bool>(value) ? "true" : "false";
-                    case GGUF_METADATA_VALUE_TYPE_STRING:
-                        return std::get<std::string>(value);
-                    case GGUF_METADATA_VALUE_TYPE_UINT64:
-                        return std::to_string(std::get<uint64_t>(value));
-                    case GGUF_METADATA_VALUE_TYPE_INT64:
-                        return std::to_string(std::get<int64_t>(value));
-                    case GGUF_METADATA_VALUE_TYPE_FLOAT64:
-                        return std::to_string(std::get<double>(value));
-                    case GGUF_METADATA_VALUE_TYPE_ARRAY: {
-                        std::string result = "[";
-                        auto vec = std::get<std::vector<GGUFMetadataValue>>(value);
-
-                        bool truncate = vec.size() > 10;
-                        if (truncate) vec.resize(10);
-
-                        for (size_t i = 0; i < vec.size(); i++) {
-                            result += vec[i].to_string();
-                            if (i + 1 < vec.size()) result += ", ";
-                        }
-                        
-                        if (truncate) result += ", ...";
-                        result += "]";
-                        return result;
-                    }
-                    default:
-                        return "Unsupported GGUF metadata value type";
+            gguf_metadata_value_type get_type() const {
+                return elem_type;
+            }
+
+            size_t size() const {
+                return length;
+            }
+
+            template <typename T>
+            T get(size_t i) const {
+                if (elem_type != metadata_type_of<T>()) {
+                    throw std::runtime_error("GGUF metadata array holds type " + std::to_string((uint32_t)elem_type) + ", not " +
+                                             std::to_string((uint32_t)metadata_type_of<T>()));
                 }
+                if (i >= length)
+                    throw std::out_of_range("GGUF metadata array index " + std::to_string(i) + " out of range for length " + std::to_string(length));
+                if constexpr (std::is_same_v<T, bool>)
+                    return elems[i] != 0;
+                else
+                    return load_unaligned<T>(elems + i * sizeof(T));
+            }
+
+            iterator begin() const {
+                return iterator(elem_type, elems, stop, length);
+            }
+
+            iterator end() const {
+                return iterator(elem_type, nullptr, nullptr, 0);
             }
         };
 
+        inline GGUFArray GGUFMetadataValue::get_array() const {
+            return GGUFArray(*this);
+        }
+
+        inline std::string GGUFMetadataValue::to_string() const {
+            switch (type) {
+                case GGUF_METADATA_VALUE_TYPE_UINT8:
+                    return std::to_string(get<uint8_t>());
+                case GGUF_METADATA_VALUE_TYPE_INT8:
+                    return std::to_string(get<int8_t>());
+                case GGUF_METADATA_VALUE_TYPE_UINT16:
+                    return std::to_string(get<uint16_t>());
+                case GGUF_METADATA_VALUE_TYPE_INT16:
+                    return std::to_string(get<int16_t>());
+                case GGUF_METADATA_VALUE_TYPE_UINT32:
+                    return std::to_string(get<uint32_t>());
+                case GGUF_METADATA_VALUE_TYPE_INT32:
+                    return std::to_string(get<int32_t>());
+                case GGUF_METADATA_VALUE_TYPE_FLOAT32:
+                    return std::to_string(get<float>());
+                case GGUF_METADATA_VALUE_TYPE_BOOL:
+                    return get<bool>() ? "true" : "false";
+                case GGUF_METADATA_VALUE_TYPE_STRING:
+                    return std::string(get_string());
+                case GGUF_METADATA_VALUE_TYPE_UINT64:
+                    return std::to_string(get<uint64_t>());
+                case GGUF_METADATA_VALUE_TYPE_INT64:
+                    return std::to_string(get<int64_t>());
+                case GGUF_METADATA_VALUE_TYPE_FLOAT64:
+                    return std::to_string(get<double>());
+                case GGUF_METADATA_VALUE_TYPE_ARRAY: {
+                    // only the first 10 elements are visited
+                    GGUFArray array = get_array();
+                    std::string result = "[";
+                    size_t shown = 0;
+                    for (GGUFArray::iterator it = array.begin(); it != array.end() && shown < 10; ++it, ++shown) {
+                        if (shown > 0) result += ", ";
+                        result += it->to_string();
+                    }
+                    if (array.size() > 10) result += ", ...";
+                    result += "]";
+                    return result;
+                }
+                default:
+                    return "Unsupported GGUF metadata value type";
+            }
+        }
+
         struct tensor_data {
             ggml_type type;
-            std::vector<uint32_t> dims;
-            int offset;
+            // innermost dimension last, as in Tensor shapes
+            std::vector<uint64_t> dims;
+            // of the data from the start of the data section
+            uint64_t offset;
             void* data;
+            // keeps the memory at data alive (the file mapping) so weights can use it in place;
+            // null when the caller owns data, which then has to be copied
+            std::shared_ptr<const void> owner = nullptr;
+        };
+
+        /**
+        * Where the time of a model load went. The header covers the fixed header and the
+        * tensor table, tensors the conversion of every tensor into the model's weights.
+        * A load from a weight cache (from_cache) counts its entries as tensors and maps
+        * them in the tensor phase.
+        */
+        struct LoadReport {
+            int version = 0;
+            uint64_t tensor_count = 0;
+            uint64_t kv_count = 0;
+            double header_ms = 0;
+            double metadata_ms = 0;
+            double tokenizer_ms = 0;
+            double tensors_ms = 0;
+            // bytes of tensor data read, and how many of them are used in place
+            size_t tensor_bytes = 0;
+            size_t borrowed_bytes = 0;
+            int threads = 1;
+            bool from_cache = false;
+
+            double total_ms() const {
+                return header_ms + metadata_ms + tokenizer_ms + tensors_ms;
+            }
+
+            std::string to_string() const {
+                std::ostringstream oss;
+                oss.setf(std::ios::fixed);
+                oss.precision(1);
+                double seconds = tensors_ms / 1000.0;
+                if (from_cache) {
+                    oss << "Loaded weight cache: " << tensor_count << " entries, " << tensor_bytes / 1048576.0 << " MiB mapped in "
+                        << total_ms() << " ms: header " << header_ms << " ms, tokenizer " << tokenizer_ms << " ms, tensors "
+                        << tensors_ms << " ms";
+                    return oss.str();
+                }
+                oss << "Loaded GGUF v" << version << ": " << tensor_count << " tensors, " << kv_count << " metadata keys, "
+                    << tensor_bytes / 1048576.0 << " MiB (" << borrowed_bytes / 1048576.0 << " MiB in place) in " << total_ms()
+                    << " ms: header " << header_ms << " ms, metadata " << metadata_ms << " ms, tokenizer " << tokenizer_ms
+                    << " ms, tensors " << tensors_ms << " ms on " << threads << " threads ("
+                    << (seconds > 0 ? tensor_bytes / 1048576.0 / seconds : 0.0) << " MiB/s)";
+                return oss.str();
+            }
         };
 
         class GGUFModel {
         public:
-            MemoryMappedFile file;
+            // shared with every tensor that borrows from it, so the weights outlive the reader
+            std::shared_ptr<MemoryMappedFile> file;
             int version;
             uint64_t tensor_count;
             uint64_t kv_count;
@@ -332,20 +608,33 @@ namespace blass {
 
             tokenizer::Tokenizer tk;
 
-            std::vector<std::pair<std::string, GGUFMetadataValue>> metadata;
+            // keys and values are views into the mapping, in file order
+            std::vector<std::pair<std::string_view, GGUFMetadataValue>> metadata;
             std::vector<std::pair<std::string, tensor_data>> tensors;
 
+            // parse phases; the caller adds the tensor phase
+            LoadReport report;
+
             uint64_t align_offset(uint64_t offset) {
                 return (offset + alignment - 1) & ~(alignment - 1);
             }
 
             void read_metadata_kv() {
-                uint64_t length = file.read_at<uint64_t>(current_offset);
+                uint64_t length = file->read_at<uint64_t>(current_offset);
                 current_offset += 8;
-                std::string key = file.read_string_at(current_offset, length);
+                std::string_view key = file->view_at(current_offset, length);
                 current_offset += length;
 
-                metadata.push_back({key, GGUFMetadataValue(file, current_offset)});
+                metadata.push_back({key, GGUFMetadataValue(*file, current_offset)});
+            }
+
+            // the value of key, or nullptr when the file does not have it
+            const GGUFMetadataValue* find_metadata(std::string_view key) const {
+                for (const auto& [name, value] : metadata) {
+                    if (name == key)
+                        return &value;
+                }
+                return nullptr;
             }
 
             void load_metadata() {
@@ -358,21 +647,24 @@ namespace blass {
             }
 
             void read_tensor() {
-                uint64_t name_length = file.read_at<uint64_t>(current_offset);
+                uint64_t name_length = file->read_at<uint64_t>(current_offset);
                 current_offset += 8;
-                std::string name = file.read_string_at(current_offset, name_length);
+                std::string name = file->read_string_at(current_offset, name_length);
                 current_offset += name_length;
 
-                uint32_t n_dims = file.read_at<uint32_t>(current_offset);
+                uint32_t n_dims = file->read_at<uint32_t>(current_offset);
                 current_offset += 4;
-                std::vector<uint32_t> dims(n_dims);
+                if (n_dims > GGML_MAX_DIMS)
+                    throw std::runtime_error("Tensor " + name + " has " + std::to_string(n_dims) + " dimensions, at most " +
+                                             std::to_string(GGML_MAX_DIMS) + " are supported");
+                std::vector<uint64_t> dims(n_dims);
 
                 for (uint32_t i = 0; i < n_dims; i++) {
-                    dims[i] = file.read_at<uint64_t>(current_offset);
+                    dims[i] = file->read_at<uint64_t>(current_offset);
                     current_offset += 8;
                 }
 
-                ggml_type type = file.read_at<ggml_type>(current_offset);
+                ggml_type type = file->read_at<ggml_type>(current_offset);
                 current_offset += 4;
                 // std::cout << "Tensor name: " << name << ", dims: [";
                 // for (uint32_t i = 0; i < n_dims; i++) {
@@ -381,7 +673,7 @@ namespace blass {
                 // }
                 // std::cout << "], type: " << (uint32_t)type << std::endl;
 
-                uint64_t offset = file.read_at<uint64_t>(current_offset);
+                uint64_t offset = file->read_at<uint64_t>(current_offset);
                 current_offset += 8;
 
                 // std::cout << "Tensor data offset: " << offset << std::endl;
@@ -402,60 +694,79 @@ namespace blass {
                     read_tensor();
             }
 
-            GGUFModel(const char* filepath) : file(filepath) {
-                if (file.read_string_at(0, 4) != "GGUF")
-                    throw std::runtime_error("Not a GGUF model");
+            GGUFModel(const char* filepath) : file(std::make_shared<MemoryMappedFile>(filepath)) {
+                using clock = std::chrono::steady_clock;
+                auto ms_since = [](clock::time_point t) {
+                    return std::chrono::duration<double, std::milli>(clock::now() - t).count();
+                };
 
-                version = file.read_at<int32_t>(4);
-                tensor_count = file.read_at<uint64_t>(8);
-                kv_count = file.read_at<uint64_t>(16);
+                clock::time_point start = clock::now();
+                if (file->read_string_at(0, 4) != "GGUF")
+                    throw std::runtime_error("Not a GGUF model");
 
-                std::cout << "Loaded GGUF model version " << version 
-                        << " with " << tensor_count << " tensors and " 
-                        << kv_count << " key-value pairs." << std::endl;
+                version = file->read_at<int32_t>(4);
+                tensor_count = file->read_at<uint64_t>(8);
+                kv_count = file->read_at<uint64_t>(16);
+                report.version = version;
+                report.tensor_count = tensor_count;
+                report.kv_count = kv_count;
+                report.header_ms = ms_since(start);
 
+                start = clock::now();
                 load_metadata();
+                report.metadata_ms = ms_since(start);
+
+                start = clock::now();
                 load_tensor();
 
                 current_offset = align_offset(current_offset);
 
                 for (auto &[name, data] : tensors) {
                     assert(data.offset % alignment == 0 && "Tensor data offset is not aligned properly");
-                    data.data = (char*)file.data + data.offset + current_offset;
+                    // subtractions only, so a hostile offset or size cannot wrap around
+                    uint64_t bytes = ggml_tensor_bytes(name, data.type, data.dims);
+                    if (current_offset > file->size || data.offset > file->size - current_offset ||
+                        bytes > file->size - current_offset - data.offset) {
+                        throw std::runtime_error("Data of tensor " + name + " (" + std::to_string(bytes) + " bytes at offset " +
+                                                 std::to_string(data.offset) + ") runs past the end of the " +
+                                                 std::to_string(file->size) + "-byte file");
+                    }
+                    data.data = (char*)file->data + data.offset + current_offset;
+                    data.owner = file;
                 }
-                
+                report.header_ms += ms_since(start);
+
+                start = clock::now();
                 std::vector<std::string> tokens;
                 std::vector<std::pair<std::string, std::string>> merges;
                 std::vector<int> token_type;
-                
-                for (auto &meta : metadata) {
-                    if (meta.first == "tokenizer.ggml.tokens") {
-                        auto& tk_data = std::get<std::vector<GGUFMetadataValue>>(meta.second.value);
-                        tokens.reserve(tk_data.size());
-                        for (auto &t : tk_data) 
-                            tokens.push_back(std::get<std::string>(t.value));
-                    }
-                    else if (meta.first == "tokenizer.ggml.merges") {
-                        auto& mk_data = std::get<std::vector<GGUFMetadataValue>>(meta.second.value);
-                        merges.reserve(mk_data.size());
-                        for (auto &m : mk_data) {
-                            std::string merge_str = std::get<std::string>(m.value);
-                            size_t space_pos = merge_str.find(' ');
-                            if (space_pos != std::string::npos) {
-                                merges.push_back({merge_str.substr(0, space_pos), merge_str.substr(space_pos + 1)});
-                            }
-                        }
-                    }
-                    else if (meta.first == "tokenizer.ggml.token_type") {
-                        auto& tt_data = std::get<std::vector<GGUFMetadataValue>>(meta.second.value);
-                        token_type.reserve(tt_data.size());
-                        for (auto &tt : tt_data) {
-                            token_type.push_back(std::get<int32_t>(tt.value));
-                        }
+
+                // decoded straight from the mapping, one string copy per token or merge half
+                if (const GGUFMetadataValue* value = find_metadata("tokenizer.ggml.tokens")) {
+                    GGUFArray array = value->get_array();
+                    tokens.reserve(array.size());
+                    for (const GGUFMetadataValue& t : array)
+                        tokens.emplace_back(t.get_string());
+                }
+                if (const GGUFMetadataValue* value = find_metadata("tokenizer.ggml.merges")) {
+                    GGUFArray array = value->get_array();
+                    merges.reserve(array.size());
+                    for (const GGUFMetadataValue& m : array) {
+                        std::string_view merge = m.get_string();
+                        size_t space_pos = merge.find(' ');
+                        if (space_pos != std::string_view::npos)
+                            merges.emplace_back(merge.substr(0, space_pos), merge.substr(space_pos + 1));
                     }
                 }
+                if (const GGUFMetadataValue* value = find_metadata("tokenizer.ggml.token_type")) {
+                    GGUFArray array = value->get_array();
+                    token_type.resize(array.size());
+                    for (size_t i = 0; i < array.size(); i++)
+                        token_type[i] = array.get<int32_t>(i);
+                }
 
-                tk = tokenizer::Tokenizer(tokens, merges, token_type);
+                tk = tokenizer::Tokenizer(std::move(tokens), std::move(merges), std::move(token_type));
+                report.tokenizer_ms = ms_since(start);
             }
         };
     }
@@ -0,0 +1,419 @@
+#pragma once
+
+#include "../tensor/tensor.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace blass {
+    namespace nn {
+        /**
+        * Keys and values of every position a decoder has already processed, one
+        * [batch, capacity, kv_heads, head_dim] buffer per layer. During a step each layer
+        * appends the keys/values of the new positions and reads the whole history back, then
+        * advance() commits the step, so a decode step only projects the token it adds.
+        * Buffers start empty and double as the sequence grows.
+        */
+        template <typename T>
+        class KVCache {
+        private:
+            std::vector<Tensor<T>> keys;
+            std::vector<Tensor<T>> values;
+            size_t batch = 0;
+            size_t n_kv_heads = 0;
+            size_t head_dim = 0;
+            size_t capacity = 0;
+            size_t length = 0;
+
+            size_t row_size() const {
+                return n_kv_heads * head_dim;
+            }
+
+            void grow(size_t needed) {
+                size_t new_capacity = std::max({needed, 2 * capacity, (size_t)16});
+                for (size_t l = 0; l < keys.size(); l++) {
+                    for (Tensor<T>* buf : {&keys[l], &values[l]}) {
+                        Tensor<T> grown = Tensor<T>::from_shape({batch, new_capacity, n_kv_heads, head_dim});
+                        for (size_t b = 0; b < batch && length > 0; b++) {
+                            std::memcpy(grown.get_data() + b * new_capacity * row_size(),
+                                        buf->get_data() + b * capacity * row_size(),
+                                        length * row_size() * sizeof(T));
+                        }
+                        *buf = grown;
+                    }
+                }
+                capacity = new_capacity;
+            }
+
+            Tensor<T> history(const Tensor<T>& buf, size_t n) const {
+                if (n > capacity) {
+                    throw std::out_of_range("Requested " + std::to_string(n) + " cached positions, only " +
+                                            std::to_string(capacity) + " are allocated");
+                }
+                return Tensor<T>(buf.get_data_ptr(), {batch, n, n_kv_heads, head_dim},
+                                 {capacity * row_size(), row_size(), head_dim, 1});
+            }
+
+        public:
+            KVCache() {}
+
+            KVCache(size_t n_layers, size_t batch_, size_t n_kv_heads_, size_t head_dim_, size_t capacity_ = 0)
+            : keys(n_layers), values(n_layers), batch(batch_), n_kv_heads(n_kv_heads_), head_dim(head_dim_) {
+                if (capacity_ > 0)
+                    grow(capacity_);
+            }
+
+            // positions committed so far, i.e. the position of the next token
+            size_t size() const {
+                return length;
+            }
+
+            size_t get_capacity() const {
+                return capacity;
+            }
+
+            size_t get_batch() const {
+                return batch;
+            }
+
+            size_t num_layers() const {
+                return keys.size();
+            }
+
+            // forgets the sequence but keeps the buffers for the next one
+            void clear() {
+                length = 0;
+            }
+
+            /**
+            * Writes k and v of one layer ([batch, seq, kv_heads, head_dim]) at positions
+            * [size(), size() + seq).
+            */
+            void append(size_t layer, const Tensor<T>& k_raw, const Tensor<T>& v_raw) {
+                const std::vector<size_t>& shape = k_raw.get_shape();
+                if (layer >= keys.size() || shape.size() != 4 || shape[0] != batch || shape[2] != n_kv_heads ||
+                    shape[3] != head_dim || v_raw.get_shape() != shape) {
+                    throw std::invalid_argument("Cannot append keys of shape " + utils::to_string_vec(shape) +
+                                                " and values of shape " + utils::to_string_vec(v_raw.get_shape()) +
+                                                " to layer " + std::to_string(layer) + " of the KV cache");
+                }
+
+                size_t seq_len = shape[1];
+                if (length + seq_len > capacity)
+                    grow(length + seq_len);
+
+                Tensor<T> k = k_raw.contiguous();
+                Tensor<T> v = v_raw.contiguous();
+                for (size_t b = 0; b < batch; b++) {
+                    size_t dst = (b * capacity + length) * row_size();
+                    size_t src = b * seq_len * row_size();
+                    std::memcpy(keys[layer].get_data() + dst, k.get_data() + src, seq_len * row_size() * sizeof(T));
+                    std::memcpy(values[layer].get_data() + dst, v.get_data() + src, seq_len * row_size() * sizeof(T));
+                }
+            }
+
+            /**
+            * Keys of one layer at positions [0, n) as a [batch, n, kv_heads, head_dim] view
+            * into the cache; n may include the positions appended in the current step.
+            */
+            Tensor<T> get_keys(size_t layer, size_t n) const {
+                return history(keys.at(layer), n);
+            }
+
+            Tensor<T> get_values(size_t layer, size_t n) const {
+                return history(values.at(layer), n);
+            }
+
+            // commits the n positions every layer appended in this step
+            void advance(size_t n) {
+                if (length + n > capacity)
+                    throw std::out_of_range("Cannot advance the KV cache past its allocated positions");
+                length += n;
+            }
+        };
+
+        /**
+        * Fixed-size KV blocks shared by any number of sequences. A block holds the keys and
+        * values of block_size consecutive positions for every layer, laid out as
+        * [layer][key/value][block_size][kv_heads][head_dim]. Blocks are allocated the first
+        * time they are needed and recycled through a free list, so memory follows the
+        * number of tokens alive rather than the longest possible context.
+        * Not thread-safe: sequences must allocate and release from one thread.
+        */
+        template <typename T>
+        class KVBlockPool {
+        private:
+            size_t n_layers;
+            size_t n_kv_heads;
+            size_t head_dim;
+            size_t block_size;
+            size_t max_blocks;
+            std::vector<std::unique_ptr<T[]>> blocks;
+            std::vector<uint32_t> free_blocks;
+
+            size_t plane_size() const {
+                return block_size * n_kv_heads * head_dim;
+            }
+
+        public:
+            /**
+            * max_blocks = 0 lets the pool grow without bound.
+            */
+            KVBlockPool(size_t n_layers_, size_t n_kv_heads_, size_t head_dim_, size_t block_size_ = 16, size_t max_blocks_ = 0)
+            : n_layers(n_layers_), n_kv_heads(n_kv_heads_), head_dim(head_dim_), block_size(block_size_), max_blocks(max_blocks_) {
+                if (block_size == 0)
+                    throw std::invalid_argument("KV blocks must hold at least one position");
+            }
+
+            uint32_t allocate() {
+                if (!free_blocks.empty()) {
+                    uint32_t id = free_blocks.back();
+                    free_blocks.pop_back();
+                    return id;
+                }
+                if (max_blocks != 0 && blocks.size() >= max_blocks)
+                    throw std::runtime_error("KV block pool is exhausted (" + std::to_string(max_blocks) + " blocks)");
+
+                blocks.emplace_back(new T[n_layers * 2 * plane_size()]);
+                return blocks.size() - 1;
+            }
+
+            void release(uint32_t id) {
+                free_blocks.push_back(id);
+            }
+
+            // [block_size, kv_heads, head_dim] keys of one layer in block id
+            T* keys(uint32_t id, size_t layer) const {
+                return blocks[id].get() + (layer * 2) * plane_size();
+            }
+
+            T* values(uint32_t id, size_t layer) const {
+                return blocks[id].get() + (layer * 2 + 1) * plane_size();
+            }
+
+            size_t get_block_size() const {
+                return block_size;
+            }
+
+            size_t num_layers() const {
+                return n_layers;
+            }
+
+            size_t num_kv_heads() const {
+                return n_kv_heads;
+            }
+
+            size_t get_head_dim() const {
+                return head_dim;
+            }
+
+            size_t blocks_allocated() const {
+                return blocks.size();
+            }
+
+            size_t blocks_in_use() const {
+                return blocks.size() - free_blocks.size();
+            }
+
+            // bytes of KV memory held by the pool, free blocks included
+            size_t memory_bytes() const {
+                return blocks.size() * n_layers * 2 * plane_size() * sizeof(T);
+            }
+        };
+
+        /**
+        * KV cache of one sequence stored in blocks of a shared KVBlockPool. The block table
+        * maps position p to slot p % block_size of block block_table[p / block_size]; blocks
+        * are taken from the pool as the sequence grows and handed back by clear() or the
+        * destructor. Same append/advance protocol as KVCache, for a batch of one.
+        */
+        template <typename T>
+        class PagedKVCache {
+        private:
+            std::shared_ptr<KVBlockPool<T>> pool;
+            std::vector<uint32_t> block_table;
+            size_t length = 0;
+
+        public:
+            PagedKVCache() {}
+
+            explicit PagedKVCache(std::shared_ptr<KVBlockPool<T>> pool_) : pool(std::move(pool_)) {}
+
+            PagedKVCache(const PagedKVCache&) = delete;
+            PagedKVCache& operator=(const PagedKVCache&) = delete;
+
+            PagedKVCache(PagedKVCache&& other) noexcept
+            : pool(std::move(other.pool)), block_table(std::move(other.block_table)), length(other.length) {
+                other.block_table.clear();
+                other.length = 0;
+            }
+
+            PagedKVCache& operator=(PagedKVCache&& other) noexcept {
+                if (this != &other) {
+                    clear();
+                    pool = std::move(other.pool);
+                    block_table = std::move(other.block_table);
+                    length = other.length;
+                    other.block_table.clear();
+                    other.length = 0;
+                }
+                return *this;
+            }
+
+            ~PagedKVCache() {
+                clear();
+            }
+
+            size_t size() const {
+                return length;
+            }
+
+            // returns every block to the pool
+            void clear() {
+                for (uint32_t id : block_table)
+                    pool->release(id);
+                block_table.clear();
+                length = 0;
+            }
+
+            /**
+            * Writes k and v of one layer ([1, seq, kv_heads, head_dim]) at positions
+            * [size(), size() + seq), taking new blocks from the pool when needed.
+            */
+            void append(size_t layer, const Tensor<T>& k_raw, const Tensor<T>& v_raw) {
+                const std::vector<size_t>& shape = k_raw.get_shape();
+                if (!pool || layer >= pool->num_layers() || shape.size() != 4 || shape[0] != 1 ||
+                    shape[2] != pool->num_kv_heads() || shape[3] != pool->get_head_dim() || v_raw.get_shape() != shape) {
+                    throw std::invalid_argument("Cannot append keys of shape " + utils::to_string_vec(shape) +
+                                                " and values of shape " + utils::to_string_vec(v_raw.get_shape()) +
+                                                " to layer " + std::to_string(layer) + " of a paged KV cache");
+                }
+
+                size_t seq_len = shape[1];
+                size_t block_size = pool->get_block_size();
+                while (block_table.size() * block_size < length + seq_len)
+                    block_table.push_back(pool->allocate());
+
+                Tensor<T> k = k_raw.contiguous();
+                Tensor<T> v = v_raw.contiguous();
+                size_t row = pool->num_kv_heads() * pool->get_head_dim();
+                for (size_t s = 0; s < seq_len;) {
+                    size_t pos = length + s;
+                    size_t slot = pos % block_size;
+                    size_t run = std::min(seq_len - s, block_size - slot);
+                    uint32_t id = block_table[pos / block_size];
+                    std::memcpy(pool->keys(id, layer) + slot * row, k.get_data() + s * row, run * row * sizeof(T));
+                    std::memcpy(pool->values(id, layer) + slot * row, v.get_data() + s * row, run * row * sizeof(T));
+                    s += run;
+                }
+            }
+
+            void advance(size_t n) {
+                if ((length + n) > block_table.size() * pool->get_block_size())
+                    throw std::out_of_range("Cannot advance a paged KV cache past its allocated blocks");
+                length += n;
+            }
+
+            const std::vector<uint32_t>& get_block_table() const {
+                return block_table;
+            }
+
+            const KVBlockPool<T>& get_pool() const {
+                return *pool;
+            }
+        };
+
+        /**
+        * One step of several sequences of the same pool run as a single ragged batch: the
+        * [1, rows, ...] inputs of the step hold the new positions of the first sequence,
+        * then those of the second, and so on, a whole prompt or the one token of a decode
+        * step each. append() splits the rows over the sequences and advance() commits every
+        * sequence by its own length. The caches must outlive the batch.
+        */
+        template <typename T>
+        class PagedBatch {
+        private:
+            std::vector<PagedKVCache<T>*> seqs;
+            std::vector<size_t> lengths;
+            size_t rows = 0;
+
+        public:
+            PagedBatch() {}
+
+            // adds n_new positions of seq as the next rows of the step
+            void add(PagedKVCache<T>& seq, size_t n_new) {
+                if (n_new == 0)
+                    throw std::invalid_argument("A sequence in a batch needs at least one new position");
+                if (!seqs.empty() && &seq.get_pool() != &seqs.front()->get_pool())
+                    throw std::invalid_argument("Sequences of a batch must share one KV block pool");
+                seqs.push_back(&seq);
+                lengths.push_back(n_new);
+                rows += n_new;
+            }
+
+            size_t num_sequences() const {
+                return seqs.size();
+            }
+
+            // new positions of all sequences together
+            size_t num_rows() const {
+                return rows;
+            }
+
+            const PagedKVCache<T>& sequence(size_t i) const {
+                return *seqs[i];
+            }
+
+            size_t length(size_t i) const {
+                return lengths[i];
+            }
+
+            // absolute position of every row of the step, for the rotary embedding
+            std::vector<size_t> positions() const {
+                std::vector<size_t> out;
+                out.reserve(rows);
+                for (size_t i = 0; i < seqs.size(); i++) {
+                    for (size_t s = 0; s < lengths[i]; s++)
+                        out.push_back(seqs[i]->size() + s);
+                }
+                return out;
+            }
+
+            /**
+            * Writes the keys and values of one layer ([1, rows, kv_heads, head_dim]) to
+            * their sequences.
+            */
+            void append(size_t layer, const Tensor<T>& k_raw, const Tensor<T>& v_raw) {
+                const std::vector<size_t>& shape = k_raw.get_shape();
+                if (shape.size() != 4 || shape[0] != 1 || shape[1] != rows || v_raw.get_shape() != shape) {
+                    throw std::invalid_argument("Cannot append keys of shape " + utils::to_string_vec(shape) +
+                                                " and values of shape " + utils::to_string_vec(v_raw.get_shape()) +
+                                                " to a batch of " + std::to_string(rows) + " positions");
+                }
+
+                Tensor<T> k = k_raw.contiguous();
+                Tensor<T> v = v_raw.contiguous();
+                size_t row = shape[2] * shape[3];
+                size_t first = 0;
+                for (size_t i = 0; i < seqs.size(); i++) {
+                    std::vector<size_t> seq_shape = {1, lengths[i], shape[2], shape[3]};
+                    std::shared_ptr<T[]> k_rows(k.get_data_ptr(), k.get_data() + first * row);
+                    std::shared_ptr<T[]> v_rows(v.get_data_ptr(), v.get_data() + first * row);
+                    seqs[i]->append(layer, Tensor<T>(k_rows, seq_shape), Tensor<T>(v_rows, seq_shape));
+                    first += lengths[i];
+                }
+            }
+
+            // commits the step; n must be the number of rows
+            void advance(size_t n) {
+                if (n != rows)
+                    throw std::invalid_argument("Cannot advance a batch of " + std::to_string(rows) + " positions by " + std::to_string(n));
+                for (size_t i = 0; i < seqs.size(); i++)
+                    seqs[i]->advance(lengths[i]);
+            }
+        };
+    }
+}
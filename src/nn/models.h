@@ -1,15 +1,142 @@
 #pragma once 
 
-#include <stdfloat>
 #include <iostream>
+#include <exception>
+#include <omp.h>
 #include <fstream>
+#include <optional>
+#include <variant>
 #include "../tensor/tensor.h"
 #include "modules.h"
 #include "gguf_reader.h"
 #include "tokenizer.h"
+#include "kv_cache.h"
+#include "attention.h"
+#include "ffn.h"
+#include "sampling.h"
+#include "weight_cache.h"
 
 namespace blass {
     namespace models {
+        /**
+        * Maps the GGUF block-quantized types that have matmul kernels to their kernel format.
+        */
+        inline bool quant_type_of(gguf_loader::ggml_type type, kernel::quant_type& out) {
+            switch (type) {
+                case gguf_loader::GGML_TYPE_Q8_0: out = kernel::quant_type::q8_0; return true;
+                case gguf_loader::GGML_TYPE_Q4_0: out = kernel::quant_type::q4_0; return true;
+                case gguf_loader::GGML_TYPE_Q4_K: out = kernel::quant_type::q4_K; return true;
+                default: return false;
+            }
+        }
+
+        // a projection matrix in the precision it was stored in
+        using Weight = std::variant<PackedMatrix<float>, PackedMatrix<float, kernel::f16>,
+                                    PackedMatrix<float, kernel::bf16>, QuantizedMatrix>;
+
+        /**
+        * Builds a matmul weight straight from a 2D GGUF tensor ([out, in]) without widening it:
+        * F32, F16 and BF16 are packed in their own precision, block-quantized types are kept
+        * as they are, in place when data has an owner (the file mapping), since their blocks
+        * already are the kernels' layout. Returns false for types without a matmul kernel.
+        *
+        * F32 is packed even though the row-major [out, in] data could be borrowed and read
+        * through strides (gemm with b_transposed): that only suits the decode GEMV, while
+        * every prefill or batched step would repack the whole matrix into panels on each
+        * call. Packing once here costs a copy, and the weight cache then serves the packed
+        * panels in place on later starts.
+        */
+        inline bool load_weight(const gguf_loader::tensor_data &data, Weight &out) {
+            size_t n = data.dims[0];
+            size_t k = data.dims[1];
+            kernel::quant_type qtype;
+
+            if (data.type == gguf_loader::GGML_TYPE_F32)
+                out = PackedMatrix<float>::from_rows((const float*)data.data, n, k);
+            else if (data.type == gguf_loader::GGML_TYPE_F16)
+                out = PackedMatrix<float, kernel::f16>::from_rows((const kernel::f16*)data.data, n, k);
+            else if (data.type == gguf_loader::GGML_TYPE_BF16)
+                out = PackedMatrix<float, kernel::bf16>::from_rows((const kernel::bf16*)data.data, n, k);
+            else if (quant_type_of(data.type, qtype) && data.owner)
+                out = QuantizedMatrix::borrow(qtype, n, k, data.data, data.owner);
+            else if (quant_type_of(data.type, qtype))
+                out = QuantizedMatrix::from_blocks(qtype, n, k, data.data);
+            else
+                return false;
+            return true;
+        }
+
+        /**
+        * Bytes per row of a GGUF tensor (its last dimension), or 0 for types without a kernel.
+        */
+        inline size_t weight_row_bytes(const gguf_loader::tensor_data &data) {
+            size_t k = data.dims.back();
+            kernel::quant_type qtype;
+
+            if (data.type == gguf_loader::GGML_TYPE_F32)
+                return k * sizeof(float);
+            if (data.type == gguf_loader::GGML_TYPE_F16 || data.type == gguf_loader::GGML_TYPE_BF16)
+                return k * sizeof(uint16_t);
+            if (quant_type_of(data.type, qtype))
+                return kernel::quant_row_bytes(qtype, k);
+            return 0;
+        }
+
+        // bytes the tensor takes in the file
+        inline size_t tensor_bytes(const gguf_loader::tensor_data &data) {
+            size_t rows = 1;
+            for (size_t i = 0; i + 1 < data.dims.size(); i++)
+                rows *= data.dims[i];
+            return rows * weight_row_bytes(data);
+        }
+
+        /**
+        * Whether loading data keeps using the file's memory (quantized matrices, F32
+        * vectors) instead of converting it into memory of its own. F32 matrices are copied
+        * into packed panels, see load_weight.
+        */
+        inline bool loads_in_place(const gguf_loader::tensor_data &data) {
+            kernel::quant_type qtype;
+            if (data.dims.size() == 2)
+                return quant_type_of(data.type, qtype);
+            return data.type == gguf_loader::GGML_TYPE_F32;
+        }
+
+        /**
+        * Builds one weight from the rows of a followed by the rows of b, e.g. the gate and up
+        * projections as a single matrix. Both must have the same type and input width.
+        */
+        inline void load_weight_concat(const gguf_loader::tensor_data &a, const gguf_loader::tensor_data &b, Weight &out) {
+            size_t row_bytes = weight_row_bytes(a);
+            if (a.type != b.type || a.dims[1] != b.dims[1] || row_bytes == 0) {
+                throw std::runtime_error("Cannot concatenate weights of type " + std::to_string((uint32_t)a.type) + " and " +
+                                         std::to_string((uint32_t)b.type) + " with " + std::to_string(a.dims[1]) + " and " +
+                                         std::to_string(b.dims[1]) + " columns");
+            }
+
+            std::vector<uint8_t> rows((size_t)(a.dims[0] + b.dims[0]) * row_bytes);
+            std::memcpy(rows.data(), a.data, a.dims[0] * row_bytes);
+            std::memcpy(rows.data() + a.dims[0] * row_bytes, b.data, b.dims[0] * row_bytes);
+
+            gguf_loader::tensor_data joined{a.type, {a.dims[0] + b.dims[0], a.dims[1]}, 0, rows.data()};
+            load_weight(joined, out);
+        }
+
+        inline void save_weight(weight_cache::Writer &out, const std::string &name, const Weight &w) {
+            std::visit([&](const auto& m) { out.add(name, m); }, w);
+        }
+
+        // a weight of a cache file in whichever format it was stored in
+        inline Weight cached_weight(const weight_cache::Reader &in, const std::string &name) {
+            switch (in.at(name).kind) {
+                case weight_cache::entry_kind::packed_f32: return in.packed<float>(name);
+                case weight_cache::entry_kind::packed_f16: return in.packed<kernel::f16>(name);
+                case weight_cache::entry_kind::packed_bf16: return in.packed<kernel::bf16>(name);
+                case weight_cache::entry_kind::quantized: return in.quantized(name);
+                default: throw std::runtime_error("Weight cache entry " + name + " is not a matrix");
+            }
+        }
+
         class Qwen2Block: public nn::Module<float> {
             // attn_norm_weight: float32, attn_k_weight: float16, attn_q_weight: float16
             // attn_v_weight: float16, attn_output_weight: float16
@@ -17,32 +144,53 @@ namespace blass {
             // attn_k_bias: float32, attn_q_bias: float32, attn_v_bias: float32
             // ffn_norm: float32, ffn_down: float16, ffn_gate: float16, ffn_up: float16
             std::map<std::string, Tensor<float>> tensors;
+            // projection matrices, packed once at load for the GEMM kernel in their file precision
+            std::map<std::string, Weight> weights;
+
+            // ffn_gate / ffn_up, whichever arrived first, kept until the other one is loaded
+            // so the two can be packed as one matrix
+            std::string staged_name;
+            gguf_loader::tensor_data staged_info;
+            std::vector<uint8_t> staged_rows;
 
             std::shared_ptr<nn::RMSNorm<float>> attn_norm, ffn_norm;
-            std::shared_ptr<nn::SiLU<float>> ffn_activation;
+            std::shared_ptr<nn::SwiGLU<float, Weight>> ffn;
+            // cos/sin tables, shared by all blocks of a model
+            std::shared_ptr<nn::RotaryEmbedding<float>> rotary;
         public:
-            Qwen2Block() {
+            Qwen2Block(std::shared_ptr<nn::RotaryEmbedding<float>> rotary_ = nullptr) : rotary(std::move(rotary_)) {
+                if (!rotary)
+                    rotary = std::make_shared<nn::RotaryEmbedding<float>>(64);
                 attn_norm = std::make_shared<nn::RMSNorm<float>>(896, 1e-6f);
                 ffn_norm = std::make_shared<nn::RMSNorm<float>>(896, 1e-6f);
-                ffn_activation = std::make_shared<nn::SiLU<float>>();
+                ffn = std::make_shared<nn::SwiGLU<float, Weight>>();
                 this->register_module("attn_norm", attn_norm);
                 this->register_module("ffn_norm", ffn_norm);
-                this->register_module("ffn_activation", ffn_activation);
+                this->register_module("ffn", ffn);
+                this->register_module("rotary", rotary);
             }
 
             void load_tensor_f16(Tensor<float> &param, const gguf_loader::tensor_data &data) {
                 std::vector<size_t> dims(data.dims.begin(), data.dims.end());
                 param = Tensor<float>::from_shape(dims);
                 size_t total_elems = param.size();
-                float* dest = param.get_data();
-                std::float16_t* src = (std::float16_t*)data.data;
-                for (size_t i = 0; i < total_elems; i++) {
-                    dest[i] = src[i];
-                }
+                kernel::fp16_to_fp32_row((const uint16_t*)data.data, param.get_data(), total_elems);
+            }
+
+            void load_tensor_bf16(Tensor<float> &param, const gguf_loader::tensor_data &data) {
+                std::vector<size_t> dims(data.dims.begin(), data.dims.end());
+                param = Tensor<float>::from_shape(dims);
+                size_t total_elems = param.size();
+                kernel::bf16_to_fp32_row((const uint16_t*)data.data, param.get_data(), total_elems);
             }
 
+            // used in place when the file mapping backs data
             void load_tensor_f32(Tensor<float> &param, const gguf_loader::tensor_data &data) {
                 std::vector<size_t> dims(data.dims.begin(), data.dims.end());
+                if (data.owner) {
+                    param = Tensor<float>::borrow((float*)data.data, dims, data.owner);
+                    return;
+                }
                 param = Tensor<float>::from_shape(dims);
                 size_t total_elems = param.size();
                 float* dest = param.get_data();
@@ -51,10 +199,33 @@ namespace blass {
             }
 
             void init_param(std::string name, const gguf_loader::tensor_data &data) {
+                if (name == "ffn_gate.weight" || name == "ffn_up.weight") {
+                    load_gate_up(name, data);
+                    return;
+                }
+
+                if (name == "ffn_down.weight") {
+                    Weight down;
+                    if (!load_weight(data, down))
+                        throw std::runtime_error("Unsupported weight type in Qwen2Block: " + std::to_string((uint32_t)data.type));
+                    ffn->load_down(std::move(down));
+                    return;
+                }
+
+                if (data.dims.size() == 2) {
+                    // stored as [out, in], i.e. already the transposed B of x * W^T
+                    if (!load_weight(data, weights[name]))
+                        throw std::runtime_error("Unsupported weight type in Qwen2Block: " + std::to_string((uint32_t)data.type));
+                    return;
+                }
+
                 Tensor<float> param;
                 if (data.type == gguf_loader::GGML_TYPE_F16) {
                     load_tensor_f16(param, data);
                 } 
+                else if (data.type == gguf_loader::GGML_TYPE_BF16) {
+                    load_tensor_bf16(param, data);
+                } 
                 else if (data.type == gguf_loader::GGML_TYPE_F32) {
                     load_tensor_f32(param, data);
                 } 
@@ -68,12 +239,95 @@ namespace blass {
                     ffn_norm->load_weight(param);
                 }
                 else {
-                    tensors[name] = param.clone();
+                    tensors[name] = param;
                     register_parameter(name, tensors[name]);
                 }
             }
 
+            // gate rows first, then up rows, whatever order the file lists them in
+            void load_gate_up(const std::string& name, const gguf_loader::tensor_data &data) {
+                if (staged_name.empty() || staged_name == name) {
+                    size_t row_bytes = weight_row_bytes(data);
+                    if (row_bytes == 0)
+                        throw std::runtime_error("Unsupported weight type in Qwen2Block: " + std::to_string((uint32_t)data.type));
+                    staged_name = name;
+                    staged_info = data;
+                    staged_rows.assign((const uint8_t*)data.data, (const uint8_t*)data.data + data.dims[0] * row_bytes);
+                    staged_info.data = staged_rows.data();
+                    staged_info.owner = nullptr;
+                    return;
+                }
+
+                Weight gate_up;
+                if (staged_name == "ffn_gate.weight")
+                    load_weight_concat(staged_info, data, gate_up);
+                else
+                    load_weight_concat(data, staged_info, gate_up);
+                ffn->load_gate_up(std::move(gate_up));
+
+                staged_name.clear();
+                staged_rows = std::vector<uint8_t>();
+            }
+
+            // writes every loaded parameter in its final layout, names prefixed (e.g. "blk.3.")
+            void save(weight_cache::Writer &out, const std::string &prefix) const {
+                for (const auto& [name, w] : weights)
+                    save_weight(out, prefix + name, w);
+                for (const auto& [name, t] : tensors)
+                    out.add(prefix + name, t);
+                out.add(prefix + "attn_norm.weight", attn_norm->weight);
+                out.add(prefix + "ffn_norm.weight", ffn_norm->weight);
+                save_weight(out, prefix + "ffn_gate_up.weight", ffn->get_gate_up());
+                save_weight(out, prefix + "ffn_down.weight", ffn->get_down());
+            }
+
+            // the parameters written by save, used in place from the cache's mapping
+            void load(const weight_cache::Reader &in, const std::string &prefix) {
+                const std::map<std::string, weight_cache::Entry>& entries = in.get_entries();
+                for (auto it = entries.lower_bound(prefix); it != entries.end() && it->first.starts_with(prefix); ++it) {
+                    std::string name = it->first.substr(prefix.size());
+                    if (name == "attn_norm.weight")
+                        attn_norm->load_weight(in.tensor(it->first));
+                    else if (name == "ffn_norm.weight")
+                        ffn_norm->load_weight(in.tensor(it->first));
+                    else if (name == "ffn_gate_up.weight")
+                        ffn->load_gate_up(cached_weight(in, it->first));
+                    else if (name == "ffn_down.weight")
+                        ffn->load_down(cached_weight(in, it->first));
+                    else if (it->second.kind == weight_cache::entry_kind::tensor) {
+                        tensors[name] = in.tensor(it->first);
+                        register_parameter(name, tensors[name]);
+                    }
+                    else
+                        weights[name] = cached_weight(in, it->first);
+                }
+            }
+
+            // x * W^T for a projection weight in whichever format it was loaded
+            Tensor<float> project(const Tensor<float>& x, const std::string& name, Epilogue<float> epi = {}) {
+                return std::visit([&](const auto& w) { return matmul(x, w, std::move(epi)); }, weights.at(name));
+            }
+
+            // out += x * W^T
+            void project_add(const Tensor<float>& x, const std::string& name, Tensor<float>& out) {
+                std::visit([&](const auto& w) { gemm(x, w, out, 1.0f, 1.0f); }, weights.at(name));
+            }
+
             Tensor<float> forward(const Tensor<float>& input) override {
+                nn::KVCache<float> cache(1, input.get_shape(0), 2, 64, input.get_shape(1));
+                return forward(input, cache, 0);
+            }
+
+            /**
+            * Runs the block on the positions of input that follow the ones already in cache:
+            * only they are projected and rotated, their keys/values are appended to the
+            * layer's slot and attention reads the rest of the sequence back from the cache.
+            * The caller commits the step with cache.advance once every layer ran. Cache is
+            * an nn::KVCache, an nn::PagedKVCache for a batch of one, or an nn::PagedBatch,
+            * whose sequences are stacked along seq in a batch of one.
+            */
+            template <typename Cache>
+            Tensor<float> forward(const Tensor<float>& input, Cache& cache, size_t layer) {
                 int num_attn_heads = 14;
                 int num_kv_heads = 2;
                 int head_dim = 64;
@@ -81,69 +335,63 @@ namespace blass {
                 int batch_size = input.get_shape(0);
                 int seq_len = input.get_shape(1);
                 
-                Tensor<float> residual = input.clone();
-
                 Tensor<float> x = (*attn_norm)(input);
 
-                Tensor<float> q = matmul(x, *params["attn_q.weight"], true) + *params["attn_q.bias"];
-                Tensor<float> k = matmul(x, *params["attn_k.weight"], true) + *params["attn_k.bias"];
-                Tensor<float> v = matmul(x, *params["attn_v.weight"], true) + *params["attn_v.bias"];
+                Tensor<float> q = project(x, "attn_q.weight", Epilogue<float>{.bias = *params["attn_q.bias"]});
+                Tensor<float> k = project(x, "attn_k.weight", Epilogue<float>{.bias = *params["attn_k.bias"]});
+                Tensor<float> v = project(x, "attn_v.weight", Epilogue<float>{.bias = *params["attn_v.bias"]});
                 
                 q = q.view({batch_size, seq_len, num_attn_heads, head_dim});
                 k = k.view({batch_size, seq_len, num_kv_heads, head_dim});
                 v = v.view({batch_size, seq_len, num_kv_heads, head_dim});
 
-                // questionable whether this is correct
-                q = nn::functional::rope(q);
-                k = nn::functional::rope(k);
-
-                q = q.view({batch_size, seq_len, num_attn_heads, head_dim}).contiguous();
-                k = k.view({batch_size, seq_len, num_kv_heads, 1, head_dim}).contiguous();
-                v = v.view({batch_size, seq_len, num_kv_heads, 1, head_dim}).contiguous();
-
-                k = k.broadcast({(size_t)batch_size, (size_t)seq_len, (size_t)num_kv_heads, (size_t)(num_attn_heads / num_kv_heads), (size_t)head_dim}).contiguous();
-                v = v.broadcast({(size_t)batch_size, (size_t)seq_len, (size_t)num_kv_heads, (size_t)(num_attn_heads / num_kv_heads), (size_t)head_dim}).contiguous();
+                // rotate by absolute position so cached keys stay valid for later queries
+                rotate(q, k, cache);
 
-                k = k.view({batch_size, seq_len, num_attn_heads, head_dim});
-                v = v.view({batch_size, seq_len, num_attn_heads, head_dim});
-
-                q = q.transpose({0, 2, 1, 3}); 
-                k = k.transpose({0, 2, 1, 3}); 
-                v = v.transpose({0, 2, 1, 3});
-
-                Tensor<float> scores = matmul(q, k.transpose2D()) / sqrt((float)head_dim);
-                
-                // causal mask, literally hardcoded because i just want it to run for now
-                for (size_t i = 0; i < scores.size(); i++) {
-                    size_t s_q = (i / scores.get_shape(3)) % scores.get_shape(2);
-                    size_t s_k = i % scores.get_shape(3);
-                    if (s_k > s_q) {
-                        scores.get_data()[i] = -std::numeric_limits<float>::infinity();
-                    }
-                }
+                cache.append(layer, k, v);
+                Tensor<float> attn_out = attend(q, cache, layer);
+                attn_out = attn_out.view({batch_size, seq_len, hidden_size});
 
-                Tensor<float> attn_weights = nn::functional::softmax(scores);
-                Tensor<float> attn_out = matmul(attn_weights, v);
+                // residual adds are fused into the projections (beta = 1)
+                Tensor<float> hidden = input.clone();
+                project_add(attn_out, "attn_output.weight", hidden);
 
-                attn_out = attn_out.transpose({0, 2, 1, 3});
-                attn_out = attn_out.contiguous().view({batch_size, seq_len, hidden_size});
+                x = (*ffn_norm)(hidden);
+                ffn->forward(x, hidden, 1.0f);
 
-                x = matmul(attn_out, *params["attn_output.weight"], true);
-                x = x + residual;
+                return hidden;
+            }
 
-                residual = x.clone();
+        private:
+            // the new positions follow the cached ones
+            template <typename Cache>
+            void rotate(Tensor<float>& q, Tensor<float>& k, const Cache& cache) {
+                rotary->apply(q, cache.size());
+                rotary->apply(k, cache.size());
+            }
 
-                x = (*ffn_norm)(x);
-                Tensor<float> gate = matmul(x, *params["ffn_gate.weight"], true);
-                Tensor<float> up = matmul(x, *params["ffn_up.weight"], true);
+            // every sequence of a batch continues from its own length
+            void rotate(Tensor<float>& q, Tensor<float>& k, const nn::PagedBatch<float>& batch) {
+                std::vector<size_t> positions = batch.positions();
+                rotary->apply(q, positions);
+                rotary->apply(k, positions);
+            }
 
-                Tensor<float> activated = (*ffn_activation)(gate) * up;
+            // the paged kernels walk the block tables themselves
+            Tensor<float> attend(const Tensor<float>& q, const nn::PagedKVCache<float>& cache, size_t layer) {
+                return nn::functional::paged_attention(q, cache, layer, cache.size());
+            }
 
-                x = matmul(activated, *params["ffn_down.weight"], true);
-                
-                x = x + residual;
+            Tensor<float> attend(const Tensor<float>& q, const nn::PagedBatch<float>& batch, size_t layer) {
+                return nn::functional::paged_attention(q, batch, layer);
+            }
 
-                return x;
+            // q: [batch, seq, heads, head_dim], attending over the cached positions and its own;
+            // the 14 query heads share the 2 cached KV heads in groups of 7
+            Tensor<float> attend(const Tensor<float>& q, const nn::KVCache<float>& cache, size_t layer) {
+                size_t past_len = cache.size();
+                size_t total_len = past_len + q.get_shape(1);
+                return nn::functional::causal_attention(q, cache.get_keys(layer, total_len), cache.get_values(layer, total_len), past_len);
             }
         };
 
@@ -151,33 +399,50 @@ namespace blass {
             std::shared_ptr<Qwen2Block> blocks[24];
             std::shared_ptr<nn::RMSNorm<float>> output_norm;
 
-            Tensor<float> token_embd;
+            // tied embedding / output projection, [vocab, hidden]
+            Weight token_embd;
+
+            // KV blocks shared by every sequence of this model
+            std::shared_ptr<nn::KVBlockPool<float>> kv_pool;
+            // keys/values of the default sequence, used by prefill(tokens) and decode(token)
+            nn::PagedKVCache<float> cache;
 
         public:
             tokenizer::Tokenizer tk;
 
             Qwen2Model() {
+                auto rotary = std::make_shared<nn::RotaryEmbedding<float>>(64);
                 for (int i = 0; i < 24; i++) {
-                    blocks[i] = std::make_shared<Qwen2Block>();
+                    blocks[i] = std::make_shared<Qwen2Block>(rotary);
                     this->register_module("block_" + std::to_string(i), blocks[i]);
                 }
                 output_norm = std::make_shared<nn::RMSNorm<float>>(1, 1e-6f);
                 this->register_module("output_norm", output_norm);
+                kv_pool = std::make_shared<nn::KVBlockPool<float>>(24, 2, 64);
+                cache = new_sequence();
             }
 
             void load_tensor_f16(Tensor<float> &param, const gguf_loader::tensor_data &data) {
                 std::vector<size_t> dims(data.dims.begin(), data.dims.end());
                 param = Tensor<float>::from_shape(dims);
                 size_t total_elems = param.size();
-                float* dest = param.get_data();
-                std::float16_t* src = (std::float16_t*)data.data;
-                for (size_t i = 0; i < total_elems; i++) {
-                    dest[i] = src[i];
-                }
+                kernel::fp16_to_fp32_row((const uint16_t*)data.data, param.get_data(), total_elems);
             }
 
+            void load_tensor_bf16(Tensor<float> &param, const gguf_loader::tensor_data &data) {
+                std::vector<size_t> dims(data.dims.begin(), data.dims.end());
+                param = Tensor<float>::from_shape(dims);
+                size_t total_elems = param.size();
+                kernel::bf16_to_fp32_row((const uint16_t*)data.data, param.get_data(), total_elems);
+            }
+
+            // used in place when the file mapping backs data
             void load_tensor_f32(Tensor<float> &param, const gguf_loader::tensor_data &data) {
                 std::vector<size_t> dims(data.dims.begin(), data.dims.end());
+                if (data.owner) {
+                    param = Tensor<float>::borrow((float*)data.data, dims, data.owner);
+                    return;
+                }
                 param = Tensor<float>::from_shape(dims);
                 size_t total_elems = param.size();
                 float* dest = param.get_data();
@@ -185,113 +450,415 @@ namespace blass {
                 std::memcpy(dest, src, total_elems * sizeof(float));
             }
 
-            void load_model(const char* filepath) {
+            // loads one tensor of the file into the block or model parameter it belongs to
+            void load_param(const std::string& name, const gguf_loader::tensor_data& tensor_info) {
+                if (name.substr(0, 3) == "blk") {
+                    int block_idx = 0;
+                    int suf_idx = 0;
+                    bool dot = 0;
+                    for (size_t i = 4; i < name.size(); i++) {
+                        if (name[i] == '.') {
+                            dot = 1;
+                            continue;
+                        }
+                        if (!dot)
+                            block_idx = block_idx * 10 + (name[i] - '0');
+                        else {
+                            suf_idx = i;
+                            break;
+                        }
+                    }
+
+                    std::string param_name = name.substr(suf_idx);
+                    blocks[block_idx]->init_param(param_name, tensor_info);
+                    return;
+                }
+
+                // todo: load output_norm and other params
+                if (name == "token_embd.weight") {
+                    if (!load_weight(tensor_info, token_embd))
+                        throw std::runtime_error("Unsupported token_embd type: " + std::to_string((uint32_t)tensor_info.type));
+                    return;
+                }
+
+                Tensor<float> param;
+                if (tensor_info.type == gguf_loader::GGML_TYPE_F16) {
+                    load_tensor_f16(param, tensor_info);
+                } 
+                else if (tensor_info.type == gguf_loader::GGML_TYPE_BF16) {
+                    load_tensor_bf16(param, tensor_info);
+                } 
+                else if (tensor_info.type == gguf_loader::GGML_TYPE_F32) {
+                    load_tensor_f32(param, tensor_info);
+                } 
+                else 
+                    throw std::runtime_error("Unsupported tensor type in Qwen2Model: " + std::to_string((uint32_t)tensor_info.type));
+                
+                if (name == "output_norm.weight") {
+                    output_norm->load_weight(param);
+                }
+            }
+
+            /**
+            * Loads a GGUF file as a pipeline over threads. Tensors are grouped by the module
+            * they fill (one group per block, one for the rest), so each group loads on one
+            * thread without locking, largest first. A group reads its tensors ahead
+            * (MADV_WILLNEED) before converting them, and the pages of every tensor that was
+            * copied out are dropped (MADV_DONTNEED) once it is done. Tensors used in place
+            * are never touched here. Prints and returns a LoadReport.
+            */
+            gguf_loader::LoadReport load_model(const char* filepath) {
+                using clock = std::chrono::steady_clock;
                 gguf_loader::GGUFModel model(filepath);
                 tk = model.tk;
-                for (auto &tensor_pair : model.tensors) {
-                    std::string name = tensor_pair.first;
-                    auto &tensor_info = tensor_pair.second;
-
-                    std::cout << "Loading tensor: " << name << std::endl;
-
-                    if (name.substr(0, 3) == "blk") {
-                        int block_idx = 0;
-                        int suf_idx = 0;
-                        bool dot = 0;
-                        for (size_t i = 4; i < name.size(); i++) {
-                            if (name[i] == '.') {
-                                dot = 1;
-                                continue;
+                gguf_loader::LoadReport report = model.report;
+                clock::time_point start = clock::now();
+
+                // block index + 1 per tensor, 0 for the ones outside the blocks
+                std::vector<std::vector<size_t>> groups(std::size(blocks) + 1);
+                // gate and up are always concatenated into memory of their own
+                auto copied = [](const std::string& name, const gguf_loader::tensor_data& info) {
+                    return !loads_in_place(info) || name.find("ffn_gate.") != std::string::npos || name.find("ffn_up.") != std::string::npos;
+                };
+                for (size_t t = 0; t < model.tensors.size(); t++) {
+                    const std::string& name = model.tensors[t].first;
+                    size_t group = 0;
+                    if (name.substr(0, 4) == "blk.")
+                        group = std::stoul(name.substr(4)) + 1;
+                    if (group >= groups.size())
+                        throw std::runtime_error("Tensor " + name + " belongs to a block the model does not have");
+                    groups[group].push_back(t);
+
+                    const gguf_loader::tensor_data& info = model.tensors[t].second;
+                    report.tensor_bytes += tensor_bytes(info);
+                    if (!copied(name, info))
+                        report.borrowed_bytes += tensor_bytes(info);
+                }
+
+                std::vector<size_t> group_bytes(groups.size());
+                std::vector<size_t> order(groups.size());
+                for (size_t g = 0; g < groups.size(); g++) {
+                    order[g] = g;
+                    for (size_t t : groups[g])
+                        group_bytes[g] += tensor_bytes(model.tensors[t].second);
+                }
+                std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return group_bytes[a] > group_bytes[b]; });
+
+                std::exception_ptr error;
+                #pragma omp parallel
+                {
+                    #pragma omp single
+                    report.threads = omp_get_num_threads();
+
+                    #pragma omp for schedule(dynamic, 1)
+                    for (size_t i = 0; i < order.size(); i++) {
+                        try {
+                            const std::vector<size_t>& group = groups[order[i]];
+                            for (size_t t : group) {
+                                const auto& [name, info] = model.tensors[t];
+                                if (copied(name, info))
+                                    model.file->advise(info.data, tensor_bytes(info), MADV_WILLNEED);
                             }
-                            if (!dot)
-                                block_idx = block_idx * 10 + (name[i] - '0');
-                            else {
-                                suf_idx = i;
-                                break;
+                            for (size_t t : group) {
+                                const auto& [name, info] = model.tensors[t];
+                                load_param(name, info);
+                                if (copied(name, info))
+                                    model.file->advise(info.data, tensor_bytes(info), MADV_DONTNEED);
                             }
                         }
-
-                        std::string param_name = name.substr(suf_idx);
-                        blocks[block_idx]->init_param(param_name, tensor_info);
-                    }
-                    else {
-                        // todo: load output_norm and other params
-                        Tensor<float> param;
-                        if (tensor_info.type == gguf_loader::GGML_TYPE_F16) {
-                            load_tensor_f16(param, tensor_info);
-                        } 
-                        else if (tensor_info.type == gguf_loader::GGML_TYPE_F32) {
-                            load_tensor_f32(param, tensor_info);
-                        } 
-                        else 
-                            throw std::runtime_error("Unsupported tensor type in Qwen2Model: " + std::to_string((uint32_t)tensor_info.type));
-                        
-                        if (name == "output_norm.weight") {
-                            output_norm->load_weight(param);
-                        }
-                        else if (name == "token_embd.weight") {
-                            token_embd = param.clone();
-                            register_parameter(name, token_embd);
+                        catch (...) {
+                            #pragma omp critical
+                            if (!error)
+                                error = std::current_exception();
                         }
                     }
                 }
+                if (error)
+                    std::rethrow_exception(error);
+
+                report.tensors_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+                std::cout << report.to_string() << std::endl;
+                return report;
             }
 
-            std::string run_inference(const std::vector<int>& token_ids) {
-                size_t seq_len = token_ids.size();
-                int hidden_dim = params["token_embd.weight"]->get_shape(1);
+            /**
+            * Writes the loaded weights, already packed, and the tokenizer as a weight cache
+            * for the GGUF file with fingerprint source and hash content
+            * (weight_cache::fingerprint, weight_cache::content_hash).
+            */
+            void save_cache(const std::string& path, uint64_t source, uint64_t content) const {
+                weight_cache::Writer out;
+                out.add(tk);
+                save_weight(out, "token_embd.weight", token_embd);
+                out.add("output_norm.weight", output_norm->weight);
+                for (size_t i = 0; i < std::size(blocks); i++)
+                    blocks[i]->save(out, "blk." + std::to_string(i) + ".");
+                out.write(path, source, content);
+            }
 
-                Tensor<float> x = Tensor<float>::from_shape({(size_t)1, seq_len, (size_t)hidden_dim});
-                std::cout << "Running inference with input shape: " << utils::to_string_vec(x.get_shape()) << std::endl;
+            /**
+            * Loads the weights and tokenizer from the cache at path, in place from its
+            * mapping, if it is current for source and this build, and, when given, was built
+            * from a GGUF with hash content. Returns nothing when there is no usable cache;
+            * throws on a malformed one.
+            */
+            std::optional<gguf_loader::LoadReport> load_cache(const std::string& path, uint64_t source,
+                                                              std::optional<uint64_t> content = std::nullopt) {
+                using clock = std::chrono::steady_clock;
+                auto ms_since = [](clock::time_point t) {
+                    return std::chrono::duration<double, std::milli>(clock::now() - t).count();
+                };
+
+                clock::time_point start = clock::now();
+                std::shared_ptr<weight_cache::Reader> in = weight_cache::Reader::open(path, source);
+                if (!in || (content && in->get_content_hash() != *content))
+                    return std::nullopt;
+
+                gguf_loader::LoadReport report;
+                report.from_cache = true;
+                report.tensor_count = in->get_entries().size();
+                report.tensor_bytes = report.borrowed_bytes = in->size();
+                report.header_ms = ms_since(start);
+
+                start = clock::now();
+                tk = in->tokenizer();
+                report.tokenizer_ms = ms_since(start);
+
+                start = clock::now();
+                token_embd = cached_weight(*in, "token_embd.weight");
+                output_norm->load_weight(in->tensor("output_norm.weight"));
+                for (size_t i = 0; i < std::size(blocks); i++)
+                    blocks[i]->load(*in, "blk." + std::to_string(i) + ".");
+                report.tensors_ms = ms_since(start);
+                return report;
+            }
+
+            /**
+            * Starts from the weight cache at cache_path when it is current for the GGUF at
+            * filepath; otherwise loads the GGUF and writes the cache for the next start. A
+            * cache that cannot be read or written is reported and skipped.
+            *
+            * "Current" only compares weight_cache::fingerprint (size, mtime, first and last
+            * MiB), which misses a model rewritten in the middle with its size and mtime kept
+            * (cp -p, rsync -t, re-quantizing in place). With verify the whole GGUF is hashed
+            * and must match the hash the cache was built with; that reads the entire file,
+            * so it is off by default.
+            */
+            gguf_loader::LoadReport load_model(const char* filepath, const std::string& cache_path, bool verify = false) {
+                uint64_t source = weight_cache::fingerprint(filepath);
+                std::optional<uint64_t> content;
+                if (verify)
+                    content = weight_cache::content_hash(filepath);
+                try {
+                    if (std::optional<gguf_loader::LoadReport> report = load_cache(cache_path, source, content)) {
+                        std::cout << report->to_string() << std::endl;
+                        return *report;
+                    }
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Ignoring weight cache " << cache_path << ": " << e.what() << std::endl;
+                }
+
+                gguf_loader::LoadReport report = load_model(filepath);
+                try {
+                    // the one full read of the GGUF, paid only when the cache is rebuilt; it also
+                    // brings in the pages of the weights used in place
+                    save_cache(cache_path, source, content ? *content : weight_cache::content_hash(filepath));
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Could not save weight cache " << cache_path << ": " << e.what() << std::endl;
+                }
+                return report;
+            }
+
+            // [1, n, hidden] embeddings of token_ids
+            Tensor<float> embed(const std::vector<int>& token_ids) {
+                size_t seq_len = token_ids.size();
+                size_t hidden_dim = std::visit([](const auto& w) { return w.rows(); }, token_embd);
 
-                float* embedding_data = params["token_embd.weight"]->get_data();
+                Tensor<float> x = Tensor<float>::from_shape({(size_t)1, seq_len, hidden_dim});
                 float* input_data = x.get_data();
 
                 for (size_t i = 0; i < seq_len; i++) {
                     int token = token_ids[i];
-
-                    float* src_row = embedding_data + token * hidden_dim;
                     float* dest_row = input_data + i * hidden_dim;
-                    
-                    std::memcpy(dest_row, src_row, hidden_dim * sizeof(float));
+
+                    std::visit([&](const auto& w) {
+                        if constexpr (std::is_same_v<std::decay_t<decltype(w)>, QuantizedMatrix>)
+                            w.dequantize_row(token, dest_row);
+                        else
+                            w.unpack_column(token, dest_row);
+                    }, token_embd);
                 }
+                return x;
+            }
 
-                x = forward(x);
-                Tensor<float> results = matmul(x, *params["token_embd.weight"], true);
-
-                int mx = 0;
-                int lst_token = results.get_shape(1) - 1;
-                std::vector<std::pair<float, int>> token_probs;
-                float max_val = results(0, lst_token, 0);
-                for (size_t i = 0; i < results.get_shape(2); i++) {
-                    if (results(0, lst_token, i) > max_val) {
-                        max_val = results(0, lst_token, i);
-                        mx = i;
+            /**
+            * Logits [batch, positions.size(), vocab] of the given sequence positions of the
+            * final hidden state x ([batch, seq, hidden]); only those rows go through the
+            * vocab-sized output projection.
+            */
+            Tensor<float> logits(const Tensor<float>& x_raw, const std::vector<size_t>& positions) {
+                Tensor<float> x = x_raw.contiguous();
+                size_t batch_size = x.get_shape(0);
+                size_t seq_len = x.get_shape(1);
+                size_t hidden_dim = x.get_shape(2);
+
+                Tensor<float> rows = Tensor<float>::from_shape({batch_size, positions.size(), hidden_dim});
+                for (size_t b = 0; b < batch_size; b++) {
+                    for (size_t i = 0; i < positions.size(); i++) {
+                        if (positions[i] >= seq_len)
+                            throw std::out_of_range("Logits requested for position " + std::to_string(positions[i]) +
+                                                    " of a sequence of " + std::to_string(seq_len));
+                        std::memcpy(rows.get_data() + (b * positions.size() + i) * hidden_dim,
+                                    x.get_data() + (b * seq_len + positions[i]) * hidden_dim, hidden_dim * sizeof(float));
                     }
-                    
-                    float val = results(0, lst_token, i);
-                    // if val is not nan
-                    if (val == val)
-                        token_probs.push_back({val, (int)i});
                 }
+                return std::visit([&](const auto& w) { return matmul(rows, w); }, token_embd);
+            }
 
-                std::sort(token_probs.begin(), token_probs.end(), std::greater<std::pair<float, int>>());
+            // logits [batch, 1, vocab] of the last position, the only one generation needs
+            Tensor<float> logits(const Tensor<float>& x) {
+                return logits(x, {x.get_shape(1) - 1});
+            }
 
-                for (int i = 0; i < 10; i++) {
-                    std::cout << "Token " << token_probs[i].second << " with string " << tk.get_token(token_probs[i].second) << " logit: " << token_probs[i].first << std::endl;
+            // greedy pick from the logits of the last position of the final hidden state
+            int select_token(const Tensor<float>& x) {
+                Tensor<float> results = logits(x);
+                size_t vocab_size = results.get_shape(2);
+
+                std::vector<std::pair<float, size_t>> best = nn::functional::top_k(results.get_data(), vocab_size, 10);
+                for (auto& [logit, token] : best) {
+                    std::cout << "Token " << token << " with string " << tk.get_token(token) << " logit: " << logit << std::endl;
                 }
-                return tk.get_token(mx);
+                return best.empty() ? 0 : (int)best.front().second;
             }
 
-            Tensor<float> forward(const Tensor<float>& input) override {
-                Tensor<float> x = input.clone();
+            /**
+            * An empty KV cache drawing from the model's block pool; each concurrent
+            * conversation gets its own and passes it to prefill/decode.
+            */
+            nn::PagedKVCache<float> new_sequence() {
+                return nn::PagedKVCache<float>(kv_pool);
+            }
+
+            const nn::KVBlockPool<float>& get_kv_pool() const {
+                return *kv_pool;
+            }
+
+            /**
+            * Starts the sequence of seq over: runs the whole prompt through the model,
+            * filling its KV cache, and returns the final hidden state of the prompt.
+            */
+            Tensor<float> run_prompt(const std::vector<int>& token_ids, nn::PagedKVCache<float>& seq) {
+                if (token_ids.empty())
+                    throw std::invalid_argument("Cannot prefill an empty prompt");
+
+                seq.clear();
+                Tensor<float> x = embed(token_ids);
+                std::cout << "Running inference with input shape: " << utils::to_string_vec(x.get_shape()) << std::endl;
+                return forward(x, seq);
+            }
+
+            /**
+            * Appends one token to seq and returns its final hidden state; only the new
+            * position goes through the model.
+            */
+            Tensor<float> run_step(int token, nn::PagedKVCache<float>& seq) {
+                if (seq.size() == 0)
+                    throw std::logic_error("decode called before prefill");
+                return forward(embed({token}), seq);
+            }
+
+            // prefill / decode that return the greedy next token
+            int prefill(const std::vector<int>& token_ids, nn::PagedKVCache<float>& seq) {
+                return select_token(run_prompt(token_ids, seq));
+            }
+
+            int decode(int token, nn::PagedKVCache<float>& seq) {
+                return select_token(run_step(token, seq));
+            }
+
+            /**
+            * prefill / decode that draw the next token with sampler, which holds the
+            * decoding settings and token history of this sequence; the prompt counts
+            * towards its repetition penalties.
+            */
+            int prefill(const std::vector<int>& token_ids, nn::PagedKVCache<float>& seq, nn::Sampler& sampler) {
+                Tensor<float> x = run_prompt(token_ids, seq);
+                sampler.reset();
+                for (int token : token_ids)
+                    sampler.accept(token);
+
+                Tensor<float> next = logits(x);
+                return sampler.sample(next.get_data(), next.get_shape(2));
+            }
+
+            int decode(int token, nn::PagedKVCache<float>& seq, nn::Sampler& sampler) {
+                Tensor<float> next = logits(run_step(token, seq));
+                return sampler.sample(next.get_data(), next.get_shape(2));
+            }
+
+            /**
+            * One forward pass over several sequences at once: tokens[i] are the new tokens of
+            * seqs[i], a whole prompt or the one token of a decode step. The steps are stacked
+            * into one [1, total, hidden] batch, so every projection streams its weights once
+            * for all of them, while rotary positions, KV appends and attention follow each
+            * sequence. Returns the logits of every sequence's last new token, [1, seqs, vocab].
+            */
+            Tensor<float> step(const std::vector<std::vector<int>>& tokens, const std::vector<nn::PagedKVCache<float>*>& seqs) {
+                if (tokens.size() != seqs.size() || seqs.empty())
+                    throw std::invalid_argument("A batched step needs one token list per sequence, got " + std::to_string(tokens.size()) +
+                                                " for " + std::to_string(seqs.size()) + " sequences");
+
+                nn::PagedBatch<float> batch;
+                std::vector<int> all_tokens;
+                std::vector<size_t> last_rows;
+                for (size_t i = 0; i < seqs.size(); i++) {
+                    batch.add(*seqs[i], tokens[i].size());
+                    all_tokens.insert(all_tokens.end(), tokens[i].begin(), tokens[i].end());
+                    last_rows.push_back(all_tokens.size() - 1);
+                }
+                return logits(forward(embed(all_tokens), batch), last_rows);
+            }
+
+            int prefill(const std::vector<int>& token_ids) {
+                return prefill(token_ids, cache);
+            }
+
+            int decode(int token) {
+                return decode(token, cache);
+            }
+
+            // number of tokens in the default sequence
+            size_t context_length() const {
+                return cache.size();
+            }
+
+            std::string run_inference(const std::vector<int>& token_ids) {
+                return tk.get_token(prefill(token_ids));
+            }
+
+            /**
+            * Runs the positions in input that follow the ones in kv and commits them.
+            */
+            template <typename Cache>
+            Tensor<float> forward(const Tensor<float>& input, Cache& kv) {
+                Tensor<float> x = input;
 
                 for (int i = 0; i < 24; i++) {
-                    x = (*blocks[i])(x);
+                    x = blocks[i]->forward(x, kv, i);
                 }
+                kv.advance(input.get_shape(1));
                 x = (*output_norm)(x);
                 return x;
             }
+
+            // a whole sequence without touching the model's cache
+            Tensor<float> forward(const Tensor<float>& input) override {
+                nn::KVCache<float> kv(24, input.get_shape(0), 2, 64, input.get_shape(1));
+                return forward(input, kv);
+            }
         };
     };
 };
\ No newline at end of file
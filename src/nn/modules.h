@@ -1,44 +1,85 @@
 #pragma once
 
 #include "../tensor/tensor.h"
+#include "../tensor/vmath.h"
 #include <math.h>
+#include <algorithm>
 #include <map>
 #include <limits>
+#include <vector>
 
 namespace blass {
     namespace nn {
         namespace functional {
-            template<typename T>
-            Tensor<T> softmax(const Tensor<T>& input) {
-                Tensor<T> result = input.clone(); // result should be contiguous 
-                size_t last_dim = result.get_shape().back();
-                size_t batch_size = result.size() / last_dim;
+            /**
+            * Runs row_fn(src_row, out_row) over every row of the last dimension of input,
+            * writing into out. out is reallocated unless it is already a contiguous tensor of
+            * input's shape, so passing input itself (when contiguous) works in place.
+            */
+            template <typename T, typename F>
+            void map_rows(const Tensor<T>& input, Tensor<T>& out, F row_fn) {
+                Tensor<T> src = input.contiguous();
+                if (out.get_shape() != src.get_shape() || !out.is_contiguous() || !out.get_data())
+                    out = Tensor<T>::from_shape(src.get_shape());
 
-                T* data = result.get_data();
-                
-                #pragma omp parallel for
+                size_t last_dim = src.get_shape().empty() ? 1 : src.get_shape().back();
+                size_t batch_size = last_dim == 0 ? 0 : src.size() / last_dim;
+                const T* src_data = src.get_data();
+                T* out_data = out.get_data();
+
+                #pragma omp parallel for if (src.size() >= (1 << 14))
                 for (size_t i = 0; i < batch_size; i++) {
-                    T* row = data + i * last_dim;
+                    kernel::run_isa([&] {
+                        row_fn(src_data + i * last_dim, out_data + i * last_dim, last_dim);
+                    });
+                }
+            }
 
-                    T max_val = row[0];
-                    for (size_t j = 0; j < last_dim; j++)
-                        if (max_val < row[j]) max_val = row[j];
+            /**
+            * Softmax over the last dimension into out; out may be input for an in-place
+            * softmax. Uses the polynomial exp of kernel::fast_exp.
+            */
+            template<typename T>
+            void softmax(const Tensor<T>& input, Tensor<T>& out) {
+                map_rows(input, out, [](const T* x, T* y, size_t n) { kernel::softmax_row(x, y, n); });
+            }
 
-                    T sum = 0;
-                    for (size_t j = 0; j < last_dim; j++) {
-                        row[j] = std::exp(row[j] - max_val);
-                        sum += row[j];
-                    }
+            template<typename T>
+            void softmax_inplace(Tensor<T>& x) {
+                softmax(x, x);
+            }
 
-                    T inv_sum = static_cast<T>(1.0) / sum;
-                    for (size_t j = 0; j < last_dim; j++)
-                        row[j] *= inv_sum;
-                }
+            template<typename T>
+            Tensor<T> softmax(const Tensor<T>& input) {
+                Tensor<T> result;
+                softmax(input, result);
                 return result;
             }
 
+            // elementwise x * sigmoid(x) into out; out may be input
+            template<typename T>
+            void silu(const Tensor<T>& input, Tensor<T>& out) {
+                Tensor<T> src = input.contiguous();
+                if (out.get_shape() != src.get_shape() || !out.is_contiguous() || !out.get_data())
+                    out = Tensor<T>::from_shape(src.get_shape());
+
+                const T* src_data = src.get_data();
+                T* out_data = out.get_data();
+                size_t n = src.size();
+
+                #pragma omp parallel if (n >= (1 << 14))
+                {
+                    size_t begin, end;
+                    kernel::thread_range(n, 16, begin, end);
+                    kernel::run_isa([&] {
+                        kernel::silu_row(src_data + begin, out_data + begin, end - begin);
+                    });
+                }
+            }
+
+            // rotates [..., seq, heads, head_dim]; position s of the input is rotated as offset + s
             template<typename T>
-            Tensor<T> rope(const Tensor<T>& input, float theta = 1000000.0f) {
+            Tensor<T> rope(const Tensor<T>& input, size_t offset = 0, float theta = 1000000.0f) {
                 Tensor<T> result = input.clone();
                 std::vector<size_t> shape = result.get_shape();
                 size_t head_dim = shape.back();
@@ -57,7 +98,7 @@ namespace blass {
                             
                             for (size_t d = 0; d < half_dim; d++) {
                                 float freq = 1.0f / std::pow(theta, (float)(2 * d) / head_dim);
-                                float val = s * freq;
+                                float val = (offset + s) * freq;
                                 float cos_val = std::cos(val);
                                 float sin_val = std::sin(val);
                                 
@@ -135,17 +176,21 @@ namespace blass {
         class SiLU : public Module<T> {
         public:
             SiLU() {}
-            Tensor<T> forward(const Tensor<T>& input) override {
-                Tensor<T> result = input.clone();
-                T* data = result.get_data();
-                size_t n = result.size();
 
-                #pragma omp parallel for
-                for (size_t i = 0; i < n; i++) {
-                    data[i] = data[i] / (1.0f + std::exp(-data[i]));
-                }
+            Tensor<T> forward(const Tensor<T>& input) override {
+                Tensor<T> result;
+                forward(input, result);
                 return result;
             }
+
+            // into out, which may be input
+            void forward(const Tensor<T>& input, Tensor<T>& out) {
+                functional::silu(input, out);
+            }
+
+            void apply(Tensor<T>& x) {
+                functional::silu(x, x);
+            }
         };
 
         template <typename T>
@@ -159,37 +204,162 @@ namespace blass {
                 this->register_parameter("weight", weight);
             }
 
+            // shares w's storage, which may be borrowed from a model file
             void load_weight(const Tensor<T>& w) {
-                weight = w.clone();
+                weight = w.contiguous();
             }
 
             Tensor<T> forward(const Tensor<T>& input) override {
-                Tensor<T> result = input.clone();
-                size_t last_dim = result.get_shape().back();
+                Tensor<T> result;
+                forward(input, result);
+                return result;
+            }
 
-                assert(weight.size() == last_dim && "Weight size must match the last dimension of input");
-                size_t batch_size = result.size() / last_dim;
+            // normalises the last dimension of input into out, which may be input
+            void forward(const Tensor<T>& input, Tensor<T>& out) {
+                assert(!input.get_shape().empty() && weight.size() == input.get_shape().back() &&
+                       "Weight size must match the last dimension of input");
 
-                T* data = result.get_data();
-                T* weight_data = weight.get_data();
+                const T* weight_data = weight.get_data();
+                T row_eps = eps;
+                functional::map_rows(input, out, [&](const T* x, T* y, size_t n) {
+                    kernel::rmsnorm_row(x, weight_data, y, n, row_eps);
+                });
+            }
 
-                #pragma omp parallel for
-                for (size_t i = 0; i < batch_size; i++) {
-                    T* row = data + i * last_dim;
+            void apply(Tensor<T>& x) {
+                forward(x, x);
+            }
+        };
+
+        /**
+        * Rotary position embedding with the cos/sin of every (position, frequency) pair
+        * computed once, as [max_positions, head_dim / 2] tables that double when a later
+        * position needs them. Rotates [..., seq, heads, head_dim] in place (NeoX layout:
+        * element d pairs with d + head_dim / 2), either from a starting position or with an
+        * explicit position per row.
+        */
+        template <typename T>
+        class RotaryEmbedding : public Module<T> {
+        private:
+            size_t head_dim;
+            float theta;
+            size_t max_positions = 0;
+            std::vector<T> cos_table;
+            std::vector<T> sin_table;
 
-                    T rms = 0;
-                    for (size_t j = 0; j < last_dim; j++) {
-                        rms += row[j] * row[j];
+            void reserve(size_t n_positions) {
+                if (n_positions <= max_positions)
+                    return;
+
+                size_t half_dim = head_dim / 2;
+                size_t new_max = std::max(n_positions, 2 * max_positions);
+                cos_table.resize(new_max * half_dim);
+                sin_table.resize(new_max * half_dim);
+                for (size_t pos = max_positions; pos < new_max; pos++) {
+                    for (size_t d = 0; d < half_dim; d++) {
+                        // angles in double so large positions keep their precision
+                        double freq = std::pow((double)theta, -(double)(2 * d) / head_dim);
+                        double angle = pos * freq;
+                        cos_table[pos * half_dim + d] = std::cos(angle);
+                        sin_table[pos * half_dim + d] = std::sin(angle);
                     }
-                    rms = std::sqrt(rms / last_dim + eps);
+                }
+                max_positions = new_max;
+            }
+
+            void rotate_row(T* __restrict__ head_data, size_t pos, size_t n_heads) const {
+                size_t half_dim = head_dim / 2;
+                const T* __restrict__ cos_row = cos_table.data() + pos * half_dim;
+                const T* __restrict__ sin_row = sin_table.data() + pos * half_dim;
 
-                    T inv_rms = static_cast<T>(1.0) / rms;
-                    for (size_t j = 0; j < last_dim; j++) {
-                        row[j] = row[j] * inv_rms * weight_data[j];
+                for (size_t h = 0; h < n_heads; h++, head_data += head_dim) {
+                    #pragma omp simd
+                    for (size_t d = 0; d < half_dim; d++) {
+                        T x0 = head_data[d];
+                        T x1 = head_data[d + half_dim];
+                        head_data[d] = x0 * cos_row[d] - x1 * sin_row[d];
+                        head_data[d + half_dim] = x0 * sin_row[d] + x1 * cos_row[d];
                     }
                 }
+            }
+
+            void check_input(const Tensor<T>& x) const {
+                const std::vector<size_t>& shape = x.get_shape();
+                if (shape.size() < 3 || shape.back() != head_dim || !x.is_contiguous()) {
+                    throw std::invalid_argument("RotaryEmbedding rotates contiguous [..., seq, heads, " + std::to_string(head_dim) +
+                                                "] tensors, got shape " + utils::to_string_vec(shape));
+                }
+            }
+
+        public:
+            RotaryEmbedding(size_t head_dim_, size_t max_positions_ = 2048, float theta_ = 1000000.0f)
+            : head_dim(head_dim_), theta(theta_) {
+                if (head_dim == 0 || head_dim % 2 != 0)
+                    throw std::invalid_argument("Rotary embedding needs an even head dimension, got " + std::to_string(head_dim));
+                reserve(max_positions_);
+            }
+
+            /**
+            * Rotates x in place, row s of every batch at position offset + s.
+            */
+            void apply(Tensor<T>& x, size_t offset = 0) {
+                check_input(x);
+                const std::vector<size_t>& shape = x.get_shape();
+                size_t n_heads = shape[shape.size() - 2];
+                size_t seq_len = shape[shape.size() - 3];
+                size_t n_rows = x.size() / (n_heads * head_dim);
+                reserve(offset + seq_len);
+
+                T* data = x.get_data();
+                #pragma omp parallel for if (n_rows * n_heads >= 64)
+                for (size_t row = 0; row < n_rows; row++) {
+                    kernel::run_isa([&] {
+                        rotate_row(data + row * n_heads * head_dim, offset + row % seq_len, n_heads);
+                    });
+                }
+            }
+
+            /**
+            * Rotates x in place with an explicit position per row: positions holds either one
+            * entry per sequence index, shared by the batch, or one per (batch, sequence index).
+            */
+            void apply(Tensor<T>& x, const std::vector<size_t>& positions) {
+                check_input(x);
+                const std::vector<size_t>& shape = x.get_shape();
+                size_t n_heads = shape[shape.size() - 2];
+                size_t seq_len = shape[shape.size() - 3];
+                size_t n_rows = x.size() / (n_heads * head_dim);
+                if (positions.size() != seq_len && positions.size() != n_rows) {
+                    throw std::invalid_argument("Expected " + std::to_string(seq_len) + " or " + std::to_string(n_rows) +
+                                                " rotary positions, got " + std::to_string(positions.size()));
+                }
+                if (!positions.empty())
+                    reserve(*std::max_element(positions.begin(), positions.end()) + 1);
+
+                T* data = x.get_data();
+                #pragma omp parallel for if (n_rows * n_heads >= 64)
+                for (size_t row = 0; row < n_rows; row++) {
+                    size_t pos = positions.size() == n_rows ? positions[row] : positions[row % seq_len];
+                    kernel::run_isa([&] {
+                        rotate_row(data + row * n_heads * head_dim, pos, n_heads);
+                    });
+                }
+            }
+
+            Tensor<T> forward(const Tensor<T>& input) override {
+                Tensor<T> result = input.clone();
+                apply(result);
                 return result;
             }
+
+            size_t get_head_dim() const {
+                return head_dim;
+            }
+
+            size_t get_max_positions() const {
+                return max_positions;
+            }
         };
     };
 };
\ No newline at end of file
@@ -0,0 +1,350 @@
+#pragma once
+
+#include "../tensor/tensor.h"
+#include "../tensor/vmath.h"
+#include "../random/random.h"
+#include <algorithm>
+#include <bit>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace blass {
+    namespace nn {
+        namespace functional {
+            // (logit, token id) ordered by logit, then by lower id, so results do not depend on threads
+            template <typename T>
+            bool ranks_before(const std::pair<T, size_t>& a, const std::pair<T, size_t>& b) {
+                return a.first > b.first || (a.first == b.first && a.second < b.second);
+            }
+
+            /**
+            * Index of the first largest of x[0..n), split across threads for vocab-sized rows.
+            * NaNs never win; returns 0 if every element is NaN.
+            */
+            template <typename T>
+            size_t argmax(const T* x, size_t n) {
+                std::pair<T, size_t> best = {T(0), n};
+
+                #pragma omp parallel if (n >= (1 << 15))
+                {
+                    size_t begin, end;
+                    kernel::thread_range(n, 64, begin, end);
+                    size_t local = end;
+                    kernel::run_isa([&] {
+                        local = begin + kernel::argmax_row(x + begin, end - begin);
+                    });
+
+                    if (local < end) {
+                        #pragma omp critical
+                        {
+                            if (best.second == n || ranks_before(std::pair<T, size_t>{x[local], local}, best))
+                                best = {x[local], local};
+                        }
+                    }
+                }
+                return best.second == n ? 0 : best.second;
+            }
+
+            /**
+            * The k largest of x[0..n) as (value, index), best first, ties to the lower index,
+            * NaNs skipped. Each thread keeps a heap of its k best and only looks inside
+            * 64-element blocks whose (vectorized) max beats the heap's worst entry, so on
+            * logits nearly the whole row is rejected at SIMD speed; the heaps are merged at the end.
+            */
+            template <typename T>
+            std::vector<std::pair<T, size_t>> top_k(const T* x, size_t n, size_t k) {
+                constexpr size_t BLOCK = 64;
+                k = std::min(k, n);
+                std::vector<std::pair<T, size_t>> result;
+                if (k == 0)
+                    return result;
+
+                #pragma omp parallel if (n >= (1 << 15))
+                {
+                    size_t begin, end;
+                    kernel::thread_range(n, BLOCK, begin, end);
+
+                    // worst entry at the front
+                    std::vector<std::pair<T, size_t>> heap;
+                    heap.reserve(k);
+                    kernel::run_isa([&] {
+                        for (size_t j0 = begin; j0 < end; j0 += BLOCK) {
+                            size_t j1 = std::min(end, j0 + BLOCK);
+                            if (heap.size() == k && !(kernel::max_row(x + j0, j1 - j0) > heap.front().first))
+                                continue;
+
+                            for (size_t j = j0; j < j1; j++) {
+                                if (heap.size() < k) {
+                                    if (x[j] == x[j]) {
+                                        heap.push_back({x[j], j});
+                                        std::push_heap(heap.begin(), heap.end(), ranks_before<T>);
+                                    }
+                                }
+                                else if (x[j] > heap.front().first) {
+                                    std::pop_heap(heap.begin(), heap.end(), ranks_before<T>);
+                                    heap.back() = {x[j], j};
+                                    std::push_heap(heap.begin(), heap.end(), ranks_before<T>);
+                                }
+                            }
+                        }
+                    });
+
+                    #pragma omp critical
+                    result.insert(result.end(), heap.begin(), heap.end());
+                }
+
+                k = std::min(k, result.size());
+                std::partial_sort(result.begin(), result.begin() + k, result.end(), ranks_before<T>);
+                result.resize(k);
+                return result;
+            }
+        }
+
+        /**
+        * Decoding settings of a Sampler. temperature 0 is greedy; top_k 0, top_p 1 and
+        * min_p 0 disable those filters, penalties of 1 / 0 disable the penalties.
+        */
+        struct SamplingParams {
+            float temperature = 1.0f;
+            size_t top_k = 40;
+            // smallest set of best tokens whose probability adds up to top_p
+            float top_p = 1.0f;
+            // drops tokens less likely than min_p times the best one
+            float min_p = 0.0f;
+            // logits of tokens seen before are divided by it when positive, multiplied when negative
+            float repetition_penalty = 1.0f;
+            // subtracted once per earlier occurrence / once for any occurrence
+            float frequency_penalty = 0.0f;
+            float presence_penalty = 0.0f;
+        };
+
+        /**
+        * Picks the next token of one sequence from a row of logits. Works on the caller's
+        * buffer: penalties are applied to it in place (only to tokens already seen), top-k
+        * is a partial selection, and top-p / min-p cut the sorted top-k set. Without top-k
+        * they work on the whole vocabulary in a few linear passes, without a full sort.
+        * Every sampled token, and the prompt through accept(), counts for the penalties.
+        * Each sampler draws from its own random stream.
+        */
+        class Sampler {
+            SamplingParams params;
+            randomt::stream rng;
+            // occurrences of every token of the sequence so far
+            std::unordered_map<size_t, uint32_t> counts;
+            // token weights of the current step, kept to avoid a vocab-sized allocation per token
+            std::vector<float> weights;
+
+            void apply_penalties(float* logits, size_t vocab_size) const {
+                if (params.repetition_penalty == 1.0f && params.frequency_penalty == 0.0f && params.presence_penalty == 0.0f)
+                    return;
+
+                for (auto [token, count] : counts) {
+                    if (token >= vocab_size)
+                        continue;
+                    float& logit = logits[token];
+                    logit = logit > 0.0f ? logit / params.repetition_penalty : logit * params.repetition_penalty;
+                    logit -= params.frequency_penalty * count + params.presence_penalty;
+                }
+            }
+
+            /**
+            * Sampling over the whole vocabulary (no top-k). One vectorized pass turns logits
+            * into weights relative to the best token, which min-p then thresholds directly.
+            * The top-p cut needs the weights in order only around the cut: a histogram of
+            * the weights' leading bits (16 buckets per power of two) finds the bucket the cut
+            * falls in, and only that bucket is sorted.
+            */
+            size_t sample_all(const float* logits, size_t vocab_size, float inv_temp) {
+                float max_logit = logits[functional::argmax(logits, vocab_size)];
+                float min_weight = params.min_p;
+                weights.resize(vocab_size);
+                float* w = weights.data();
+
+                float total = 0;
+                kernel::run_isa([&] {
+                    // locals, so the pointers are not reloaded through the captures
+                    const float* __restrict__ x = logits;
+                    float* __restrict__ out = w;
+                    float shift = max_logit, scale = inv_temp, floor = min_weight;
+                    float sum = 0;
+                    #pragma omp simd reduction(+:sum)
+                    for (size_t j = 0; j < vocab_size; j++) {
+                        float p = kernel::fast_exp((x[j] - shift) * scale);
+                        p = p >= floor ? p : 0.0f;
+                        out[j] = p;
+                        sum += p;
+                    }
+                    total = sum;
+                });
+
+                if (params.top_p < 1.0f) {
+                    // weights are in [0, 1], so bits >> 19 (exponent and 4 mantissa bits) is monotonic
+                    // and < 2048; four interleaved histograms keep neighbouring adds independent
+                    constexpr size_t BUCKETS = (0x3f800000u >> 19) + 1;
+                    std::vector<float> bucket_mass(4 * BUCKETS);
+                    for (size_t j = 0; j < vocab_size; j++)
+                        bucket_mass[(j & 3) * BUCKETS + (std::bit_cast<uint32_t>(w[j]) >> 19)] += w[j];
+
+                    float need = params.top_p * total;
+                    uint32_t cut = BUCKETS - 1;
+                    while (cut > 0) {
+                        float mass = bucket_mass[cut] + bucket_mass[BUCKETS + cut] + bucket_mass[2 * BUCKETS + cut] + bucket_mass[3 * BUCKETS + cut];
+                        if (need <= mass)
+                            break;
+                        need -= mass;
+                        cut--;
+                    }
+
+                    // everything above the cut bucket stays, everything below goes
+                    float lo = std::bit_cast<float>(cut << 19);
+                    float hi = std::bit_cast<float>((cut + 1) << 19);
+                    float above = 0;
+                    kernel::run_isa([&] {
+                        float* __restrict__ out = w;
+                        float lo_ = lo, hi_ = hi;
+                        float sum = 0;
+                        #pragma omp simd reduction(+:sum)
+                        for (size_t j = 0; j < vocab_size; j++) {
+                            float p = out[j] < lo_ ? 0.0f : out[j];
+                            out[j] = p;
+                            sum += p >= hi_ ? p : 0.0f;
+                        }
+                        above = sum;
+                    });
+
+                    // of the cut bucket, the best that make up the rest of the mass, ties to the lower id;
+                    // 64-token blocks with nothing in the bucket are skipped after a vectorized count
+                    // (& rather than &&, which would branch and keep the count from vectorizing)
+                    constexpr size_t BLOCK = 64;
+                    std::vector<std::pair<float, size_t>> boundary;
+                    for (size_t j0 = 0; j0 < vocab_size; j0 += BLOCK) {
+                        size_t j1 = std::min(vocab_size, j0 + BLOCK);
+                        int in_bucket = 0;
+                        #pragma omp simd reduction(+:in_bucket)
+                        for (size_t j = j0; j < j1; j++)
+                            in_bucket += (w[j] < hi) & (w[j] > 0.0f);
+                        if (in_bucket == 0)
+                            continue;
+                        for (size_t j = j0; j < j1; j++) {
+                            if (w[j] < hi && w[j] > 0.0f)
+                                boundary.push_back({w[j], j});
+                        }
+                    }
+                    std::sort(boundary.begin(), boundary.end(), functional::ranks_before<float>);
+
+                    total = above;
+                    size_t keep = 0;
+                    while (keep < boundary.size() && need > 0.0f) {
+                        need -= boundary[keep].first;
+                        total += boundary[keep++].first;
+                    }
+                    for (size_t i = keep; i < boundary.size(); i++)
+                        w[boundary[i].second] = 0.0f;
+                }
+
+                // find the 64-token block the draw falls in from vectorized block sums, then walk it
+                constexpr size_t BLOCK = 64;
+                float target = rng.rand() * total;
+                size_t last_block = 0;
+                for (size_t j0 = 0; j0 < vocab_size; j0 += BLOCK) {
+                    size_t j1 = std::min(vocab_size, j0 + BLOCK);
+                    float block_mass = 0;
+                    #pragma omp simd reduction(+:block_mass)
+                    for (size_t j = j0; j < j1; j++)
+                        block_mass += w[j];
+                    if (block_mass == 0.0f)
+                        continue;
+
+                    last_block = j0;
+                    if (target >= block_mass) {
+                        target -= block_mass;
+                        continue;
+                    }
+                    for (size_t j = j0; j < j1; j++) {
+                        if (target < w[j])
+                            return j;
+                        target -= w[j];
+                    }
+                }
+
+                // rounding left the draw past the end: the last token with any weight
+                size_t pick = last_block;
+                for (size_t j = last_block; j < std::min(vocab_size, last_block + BLOCK); j++)
+                    pick = w[j] > 0.0f ? j : pick;
+                return pick;
+            }
+
+            // top-k, then top-p / min-p on the sorted top-k set
+            size_t sample_top_k(const float* logits, size_t vocab_size, float inv_temp) {
+                std::vector<std::pair<float, size_t>> candidates = functional::top_k(logits, vocab_size, params.top_k);
+                // every logit NaN
+                if (candidates.empty())
+                    return 0;
+
+                // weights relative to the best token, which has weight 1
+                weights.resize(candidates.size());
+                float mass = 0;
+                for (size_t i = 0; i < candidates.size(); i++) {
+                    weights[i] = kernel::fast_exp((candidates[i].first - candidates[0].first) * inv_temp);
+                    mass += weights[i];
+                }
+
+                // the best token always stays
+                size_t keep = 1;
+                float kept_mass = weights[0];
+                while (keep < candidates.size() && weights[keep] >= params.min_p && kept_mass < params.top_p * mass)
+                    kept_mass += weights[keep++];
+
+                float target = rng.rand() * kept_mass;
+                for (size_t i = 0; i + 1 < keep; i++) {
+                    if (target < weights[i])
+                        return candidates[i].second;
+                    target -= weights[i];
+                }
+                return candidates[keep - 1].second;
+            }
+
+        public:
+            explicit Sampler(SamplingParams params_ = {}) : params(params_), rng(randomt::new_stream()) {}
+
+            Sampler(SamplingParams params_, uint64_t seed) : params(params_), rng(seed) {}
+
+            const SamplingParams& get_params() const {
+                return params;
+            }
+
+            // counts token towards the penalties, e.g. for every prompt token
+            void accept(size_t token) {
+                counts[token]++;
+            }
+
+            // forgets the tokens seen so far, for a new sequence
+            void reset() {
+                counts.clear();
+            }
+
+            /**
+            * Next token from logits[0..vocab_size); the penalties modify logits in place.
+            * The token is accepted before it is returned.
+            */
+            size_t sample(float* logits, size_t vocab_size) {
+                if (vocab_size == 0)
+                    throw std::invalid_argument("Cannot sample from an empty vocabulary");
+
+                apply_penalties(logits, vocab_size);
+
+                size_t token;
+                if (params.temperature <= 0.0f || params.top_k == 1)
+                    token = functional::argmax(logits, vocab_size);
+                else if (params.top_k == 0)
+                    token = sample_all(logits, vocab_size, 1.0f / params.temperature);
+                else
+                    token = sample_top_k(logits, vocab_size, 1.0f / params.temperature);
+
+                accept(token);
+                return token;
+            }
+        };
+    }
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "models.h"
+#include <deque>
+#include <utility>
+#include <vector>
+
+namespace blass {
+    namespace models {
+        /**
+        * A generation job for the Scheduler: the prompt, how many tokens to generate at
+        * most, and an optional stop token that ends it early (it is part of the output).
+        * The sampler holds the decoding settings and is greedy unless replaced.
+        */
+        struct GenerationRequest {
+            std::vector<int> prompt;
+            size_t max_new_tokens = 16;
+            int stop_token = -1;
+            nn::Sampler sampler = nn::Sampler(nn::SamplingParams{.temperature = 0.0f});
+        };
+
+        struct GenerationResult {
+            size_t id;
+            std::vector<int> prompt;
+            std::vector<int> tokens;
+            // ended on stop_token rather than max_new_tokens
+            bool stopped;
+        };
+
+        /**
+        * Continuous batching over one Qwen2Model. Submitted requests wait in a queue; every
+        * step() admits waiting ones while there is room, runs the new prompts and the next
+        * token of every running sequence as one batched forward pass, samples a token per
+        * sequence, and retires the ones that finished, whose KV blocks go back to the
+        * model's pool right away. Sequences therefore join and leave between any two steps
+        * instead of waiting for a whole batch to drain, and each step streams the weights
+        * once for all users rather than once per user.
+        */
+        class Scheduler {
+            struct Sequence {
+                size_t id;
+                GenerationRequest request;
+                nn::PagedKVCache<float> kv;
+                std::vector<int> output;
+                // tokens fed in the next step: the prompt, then the last sampled token
+                std::vector<int> pending;
+            };
+
+            Qwen2Model& model;
+            size_t max_sequences;
+            size_t max_step_tokens;
+            std::deque<std::pair<size_t, GenerationRequest>> waiting;
+            std::vector<Sequence> running;
+            size_t next_id = 0;
+
+            void admit() {
+                size_t step_tokens = running.size();
+                bool prompt_admitted = false;
+                while (!waiting.empty() && running.size() < max_sequences) {
+                    GenerationRequest& request = waiting.front().second;
+                    // a long prompt stalls the decode steps it shares a pass with, so prompts
+                    // are capped per step; one always goes in so none starves
+                    if (prompt_admitted && step_tokens + request.prompt.size() > max_step_tokens)
+                        break;
+
+                    Sequence seq{waiting.front().first, std::move(request), model.new_sequence(), {}, {}};
+                    waiting.pop_front();
+                    seq.pending = seq.request.prompt;
+                    seq.request.sampler.reset();
+                    for (int token : seq.request.prompt)
+                        seq.request.sampler.accept(token);
+
+                    step_tokens += seq.pending.size();
+                    prompt_admitted = true;
+                    running.push_back(std::move(seq));
+                }
+            }
+
+        public:
+            /**
+            * max_sequences bounds how many sequences decode together; max_step_tokens bounds
+            * the prompt tokens admitted per step on top of the running decodes.
+            */
+            Scheduler(Qwen2Model& model_, size_t max_sequences_ = 16, size_t max_step_tokens_ = 512)
+            : model(model_), max_sequences(max_sequences_), max_step_tokens(max_step_tokens_) {
+                if (max_sequences == 0)
+                    throw std::invalid_argument("A scheduler must run at least one sequence at a time");
+            }
+
+            // queues a request and returns the id its result will carry
+            size_t submit(GenerationRequest request) {
+                if (request.prompt.empty())
+                    throw std::invalid_argument("Cannot generate from an empty prompt");
+                if (request.max_new_tokens == 0)
+                    throw std::invalid_argument("A generation request must ask for at least one token");
+                waiting.emplace_back(next_id, std::move(request));
+                return next_id++;
+            }
+
+            size_t num_waiting() const {
+                return waiting.size();
+            }
+
+            size_t num_running() const {
+                return running.size();
+            }
+
+            bool idle() const {
+                return waiting.empty() && running.empty();
+            }
+
+            /**
+            * Admits what fits, runs one batched forward pass and samples one token for every
+            * running sequence. Returns the requests that finished in this step.
+            */
+            std::vector<GenerationResult> step() {
+                admit();
+                std::vector<GenerationResult> finished;
+                if (running.empty())
+                    return finished;
+
+                // pending is copied, not moved: a step that throws (say the KV pool ran out)
+                // commits nothing to the caches, so every sequence can retry it as it was
+                std::vector<std::vector<int>> tokens;
+                std::vector<nn::PagedKVCache<float>*> seqs;
+                for (Sequence& seq : running) {
+                    tokens.push_back(seq.pending);
+                    seqs.push_back(&seq.kv);
+                }
+                Tensor<float> next = model.step(tokens, seqs);
+                size_t vocab_size = next.get_shape(2);
+
+                std::vector<Sequence> still_running;
+                for (size_t i = 0; i < running.size(); i++) {
+                    Sequence& seq = running[i];
+                    int token = seq.request.sampler.sample(next.get_data() + i * vocab_size, vocab_size);
+                    seq.output.push_back(token);
+
+                    bool stopped = token == seq.request.stop_token;
+                    if (stopped || seq.output.size() >= seq.request.max_new_tokens) {
+                        finished.push_back({seq.id, std::move(seq.request.prompt), std::move(seq.output), stopped});
+                        continue;
+                    }
+                    seq.pending = {token};
+                    still_running.push_back(std::move(seq));
+                }
+                running = std::move(still_running);
+                return finished;
+            }
+
+            // steps until every submitted request finished; results in the order they finished
+            std::vector<GenerationResult> run() {
+                std::vector<GenerationResult> results;
+                while (!idle()) {
+                    std::vector<GenerationResult> done = step();
+                    results.insert(results.end(), std::make_move_iterator(done.begin()), std::make_move_iterator(done.end()));
+                }
+                return results;
+            }
+        };
+    }
+}
@@ -3,6 +3,7 @@
 #include <vector>
 #include <map>
 #include <codecvt>
+#include <locale>
 
 namespace blass {
     namespace tokenizer {
@@ -13,7 +14,7 @@ namespace blass {
             std::vector<int> token_type;
         public:
             Tokenizer() {}
-            Tokenizer(std::vector<std::string> tokens_, std::vector<std::pair<std::string, std::string>> merges_, std::vector<int> token_type_) : tokens(tokens_), merges(merges_), token_type(token_type_) {
+            Tokenizer(std::vector<std::string> tokens_, std::vector<std::pair<std::string, std::string>> merges_, std::vector<int> token_type_) : tokens(std::move(tokens_)), merges(std::move(merges_)), token_type(std::move(token_type_)) {
                 for (size_t i = 0; i < tokens.size(); i++)
                     encoder[tokens[i]] = i;
             }
@@ -34,6 +35,18 @@ namespace blass {
                 return tokens[idx];
             }
 
+            const std::vector<std::string>& get_tokens() const {
+                return tokens;
+            }
+
+            const std::vector<std::pair<std::string, std::string>>& get_merges() const {
+                return merges;
+            }
+
+            const std::vector<int>& get_token_type() const {
+                return token_type;
+            }
+
             std::vector<int> encode(const std::string& _text) {
                 std::u32string text = utf8_to_u32(_text);
                 
@@ -0,0 +1,432 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "../tensor/tensor.h"
+#include "gguf_reader.h"
+#include "tokenizer.h"
+
+namespace blass {
+    namespace weight_cache {
+        // "BLWC"
+        constexpr uint32_t MAGIC = 0x43574c42;
+        constexpr uint32_t FORMAT_VERSION = 2;
+        // bump whenever a packed layout changes (gemm_params, pack_b, quantized blocks), so
+        // caches written by older builds are rebuilt rather than misread
+        constexpr uint32_t LAYOUT_VERSION = 1;
+        constexpr size_t ALIGNMENT = 64;
+
+        enum class entry_kind : uint32_t {
+            tensor,
+            packed_f32,
+            packed_f16,
+            packed_bf16,
+            quantized,
+            tokenizer
+        };
+
+        /**
+        * One named blob of a cache file. dims are the tensor shape, [k, n] of a packed matrix
+        * or [n, k] of a quantized one; offset is from the start of the file.
+        */
+        struct Entry {
+            entry_kind kind = entry_kind::tensor;
+            // kernel::isa of a packed matrix, kernel::quant_type of a quantized one
+            uint32_t param = 0;
+            std::vector<uint64_t> dims;
+            uint64_t offset = 0;
+            uint64_t bytes = 0;
+        };
+
+        template <typename S>
+        constexpr entry_kind packed_kind() {
+            if constexpr (std::is_same_v<S, kernel::f16>)
+                return entry_kind::packed_f16;
+            else if constexpr (std::is_same_v<S, kernel::bf16>)
+                return entry_kind::packed_bf16;
+            else
+                return entry_kind::packed_f32;
+        }
+
+        // 64-bit FNV-1a, continuing from h
+        inline uint64_t hash_bytes(uint64_t h, const void* data, size_t n) {
+            const uint8_t* bytes = (const uint8_t*)data;
+            for (size_t i = 0; i < n; i++) {
+                h ^= bytes[i];
+                h *= 0x100000001b3ull;
+            }
+            return h;
+        }
+
+        /**
+        * Identifies a GGUF file without reading all of it, so a restart stays cheap: its
+        * size, modification time and first and last MiB. A copy with a new mtime only
+        * rebuilds its cache once. A change that keeps the size and mtime and lies between
+        * the sampled ends (cp -p or rsync -t of another file, re-quantizing in place) goes
+        * unnoticed; content_hash() catches it, at the price of reading the whole file.
+        */
+        inline uint64_t fingerprint(const char* filepath) {
+            int fd = open(filepath, O_RDONLY);
+            if (fd == -1)
+                throw std::runtime_error(std::string("Could not open file ") + filepath);
+
+            struct stat sb;
+            if (fstat(fd, &sb) == -1) {
+                close(fd);
+                throw std::runtime_error(std::string("Could not get file size of ") + filepath);
+            }
+
+            uint64_t h = 0xcbf29ce484222325ull;
+            uint64_t stamp[3] = {(uint64_t)sb.st_size, (uint64_t)sb.st_mtim.tv_sec, (uint64_t)sb.st_mtim.tv_nsec};
+            h = hash_bytes(h, stamp, sizeof(stamp));
+
+            size_t sample = (size_t)1 << 20;
+            size_t size = sb.st_size;
+            std::vector<uint8_t> buffer(std::min(size, sample));
+            for (size_t offset : {(size_t)0, size - buffer.size()}) {
+                ssize_t got = pread(fd, buffer.data(), buffer.size(), offset);
+                if (got != (ssize_t)buffer.size()) {
+                    close(fd);
+                    throw std::runtime_error(std::string("Could not read ") + filepath);
+                }
+                h = hash_bytes(h, buffer.data(), buffer.size());
+            }
+            close(fd);
+            return h;
+        }
+
+        /**
+        * A hash of every byte of a file. Caches store it when they are built, right after
+        * the GGUF was read for conversion, so a start that wants to be sure the model did
+        * not change in place compares against it instead of trusting fingerprint(). 1 MiB
+        * chunks are hashed (8-byte FNV-1a) on all threads and their hashes combined in
+        * order, so the result does not depend on the thread count.
+        */
+        inline uint64_t content_hash(const char* filepath) {
+            gguf_loader::MemoryMappedFile file(filepath);
+            file.advise(file.data, file.size, MADV_WILLNEED);
+            const uint8_t* bytes = (const uint8_t*)file.data;
+            size_t chunk = (size_t)1 << 20;
+            size_t n_chunks = (file.size + chunk - 1) / chunk;
+            std::vector<uint64_t> hashes(n_chunks);
+
+            #pragma omp parallel for schedule(static)
+            for (size_t c = 0; c < n_chunks; c++) {
+                const uint8_t* begin = bytes + c * chunk;
+                size_t n = std::min(chunk, file.size - c * chunk);
+                uint64_t h = 0xcbf29ce484222325ull;
+                size_t i = 0;
+                for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+                    uint64_t word;
+                    std::memcpy(&word, begin + i, sizeof(word));
+                    h = (h ^ word) * 0x100000001b3ull;
+                }
+                hashes[c] = hash_bytes(h, begin + i, n - i);
+            }
+
+            uint64_t size = file.size;
+            uint64_t h = hash_bytes(0xcbf29ce484222325ull, &size, sizeof(size));
+            return hash_bytes(h, hashes.data(), hashes.size() * sizeof(uint64_t));
+        }
+
+        /**
+        * Collects tensors, packed and quantized matrices and a tokenizer, then writes them as
+        * one cache file: a header with the key, a table of named entries, and the data of
+        * every entry at a 64-byte aligned offset, exactly as the kernels read it. Whatever
+        * was added must stay alive until write().
+        */
+        class Writer {
+            struct Pending {
+                std::string name;
+                Entry entry;
+                const void* data;
+                // bytes built here (the tokenizer), or the contiguous copy of a tensor
+                std::vector<uint8_t> owned;
+                Tensor<float> keep;
+            };
+            std::vector<Pending> pending;
+
+            Pending& add_entry(const std::string& name, entry_kind kind, uint32_t param, std::vector<uint64_t> dims, const void* data, size_t bytes) {
+                for (const Pending& p : pending) {
+                    if (p.name == name)
+                        throw std::invalid_argument("Weight cache already has an entry named " + name);
+                }
+                pending.push_back({name, {kind, param, std::move(dims), 0, bytes}, data, {}, {}});
+                return pending.back();
+            }
+
+            static void put_string(std::vector<uint8_t>& out, const std::string& s) {
+                uint32_t length = s.size();
+                out.insert(out.end(), (const uint8_t*)&length, (const uint8_t*)&length + sizeof(length));
+                out.insert(out.end(), s.begin(), s.end());
+            }
+
+            template <typename U>
+            static void put(std::ofstream& out, U value) {
+                out.write((const char*)&value, sizeof(U));
+            }
+
+        public:
+            void add(const std::string& name, const Tensor<float>& t) {
+                Tensor<float> data = t.contiguous();
+                std::vector<uint64_t> dims(data.get_shape().begin(), data.get_shape().end());
+                Pending& p = add_entry(name, entry_kind::tensor, 0, std::move(dims), data.get_data(), data.size() * sizeof(float));
+                p.keep = data;
+            }
+
+            template <typename S>
+            void add(const std::string& name, const PackedMatrix<float, S>& m) {
+                add_entry(name, packed_kind<S>(), (uint32_t)m.get_isa(), {m.rows(), m.cols()}, m.get_data(), m.size() * sizeof(S));
+            }
+
+            void add(const std::string& name, const QuantizedMatrix& m) {
+                add_entry(name, entry_kind::quantized, (uint32_t)m.get_type(), {m.cols(), m.rows()}, m.get_data(), m.cols() * m.row_bytes());
+            }
+
+            // stored as length-prefixed strings: tokens, then merge pairs, then token types
+            void add(const tokenizer::Tokenizer& tk) {
+                std::vector<uint8_t> blob;
+                uint64_t counts[3] = {tk.get_tokens().size(), tk.get_merges().size(), tk.get_token_type().size()};
+                blob.insert(blob.end(), (const uint8_t*)counts, (const uint8_t*)counts + sizeof(counts));
+                for (const std::string& token : tk.get_tokens())
+                    put_string(blob, token);
+                for (const auto& [first, second] : tk.get_merges()) {
+                    put_string(blob, first);
+                    put_string(blob, second);
+                }
+                for (int type : tk.get_token_type()) {
+                    int32_t t = type;
+                    blob.insert(blob.end(), (const uint8_t*)&t, (const uint8_t*)&t + sizeof(t));
+                }
+
+                Pending& p = add_entry("tokenizer", entry_kind::tokenizer, 0, {}, nullptr, blob.size());
+                p.owned = std::move(blob);
+                p.data = p.owned.data();
+            }
+
+            /**
+            * Writes the cache for a model whose GGUF has fingerprint source and content_hash
+            * content. The data goes to a temporary file renamed over path at the end, so a
+            * process starting meanwhile sees either the old cache or the complete new one.
+            */
+            void write(const std::string& path, uint64_t source, uint64_t content) {
+                uint64_t offset = 4 * sizeof(uint32_t) + 3 * sizeof(uint64_t);
+                for (const Pending& p : pending)
+                    offset += sizeof(uint64_t) + p.name.size() + 3 * sizeof(uint32_t) + (p.entry.dims.size() + 2) * sizeof(uint64_t);
+                for (Pending& p : pending) {
+                    offset = (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+                    p.entry.offset = offset;
+                    offset += p.entry.bytes;
+                }
+
+                std::string temp = path + ".tmp." + std::to_string(getpid());
+                std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+                if (!out)
+                    throw std::runtime_error("Could not create weight cache " + temp);
+
+                put(out, MAGIC);
+                put(out, FORMAT_VERSION);
+                put(out, LAYOUT_VERSION);
+                put(out, (uint32_t)kernel::active_isa());
+                put(out, source);
+                put(out, content);
+                put(out, (uint64_t)pending.size());
+                for (const Pending& p : pending) {
+                    put(out, (uint64_t)p.name.size());
+                    out.write(p.name.data(), p.name.size());
+                    put(out, (uint32_t)p.entry.kind);
+                    put(out, p.entry.param);
+                    put(out, (uint32_t)p.entry.dims.size());
+                    for (uint64_t d : p.entry.dims)
+                        put(out, d);
+                    put(out, p.entry.offset);
+                    put(out, p.entry.bytes);
+                }
+
+                static const char zeros[ALIGNMENT] = {};
+                for (const Pending& p : pending) {
+                    out.write(zeros, p.entry.offset - out.tellp());
+                    out.write((const char*)p.data, p.entry.bytes);
+                }
+
+                out.close();
+                if (!out || std::rename(temp.c_str(), path.c_str()) != 0) {
+                    std::remove(temp.c_str());
+                    throw std::runtime_error("Could not write weight cache " + path);
+                }
+            }
+        };
+
+        /**
+        * A cache file mapped into memory. Tensors and matrices handed out use the mapping in
+        * place and keep it alive, so a start from the cache converts and packs nothing.
+        */
+        class Reader {
+            std::shared_ptr<gguf_loader::MemoryMappedFile> file;
+            std::map<std::string, Entry> entries;
+            // content_hash of the GGUF the cache was built from
+            uint64_t content = 0;
+
+            const uint8_t* bytes_of(const Entry& e) const {
+                return (const uint8_t*)file->data + e.offset;
+            }
+
+            static void expect_kind(const std::string& name, const Entry& e, entry_kind kind) {
+                if (e.kind != kind) {
+                    throw std::runtime_error("Weight cache entry " + name + " has kind " + std::to_string((uint32_t)e.kind) +
+                                             ", expected " + std::to_string((uint32_t)kind));
+                }
+            }
+
+        public:
+            /**
+            * Maps the cache at path if it was written for source by a build with this layout
+            * version and kernel variant; nullptr when it is missing or stale. Only the cheap
+            * fingerprint is checked here; compare get_content_hash() to be sure. Throws on a
+            * file that is not a cache or whose table is truncated.
+            */
+            static std::shared_ptr<Reader> open(const std::string& path, uint64_t source) {
+                struct stat sb;
+                if (stat(path.c_str(), &sb) == -1)
+                    return nullptr;
+
+                auto reader = std::make_shared<Reader>();
+                reader->file = std::make_shared<gguf_loader::MemoryMappedFile>(path.c_str());
+                gguf_loader::MemoryMappedFile& f = *reader->file;
+                if (f.read_at<uint32_t>(0) != MAGIC)
+                    throw std::runtime_error("Not a weight cache: " + path);
+                if (f.read_at<uint32_t>(4) != FORMAT_VERSION || f.read_at<uint32_t>(8) != LAYOUT_VERSION ||
+                    f.read_at<uint32_t>(12) != (uint32_t)kernel::active_isa() || f.read_at<uint64_t>(16) != source)
+                    return nullptr;
+
+                reader->content = f.read_at<uint64_t>(24);
+                uint64_t count = f.read_at<uint64_t>(32);
+                size_t offset = 40;
+                for (uint64_t i = 0; i < count; i++) {
+                    uint64_t name_length = f.read_at<uint64_t>(offset);
+                    std::string name = f.read_string_at(offset + 8, name_length);
+                    offset += 8 + name_length;
+
+                    Entry e;
+                    e.kind = (entry_kind)f.read_at<uint32_t>(offset);
+                    e.param = f.read_at<uint32_t>(offset + 4);
+                    uint32_t n_dims = f.read_at<uint32_t>(offset + 8);
+                    offset += 12;
+                    for (uint32_t d = 0; d < n_dims; d++, offset += 8)
+                        e.dims.push_back(f.read_at<uint64_t>(offset));
+                    e.offset = f.read_at<uint64_t>(offset);
+                    e.bytes = f.read_at<uint64_t>(offset + 8);
+                    offset += 16;
+
+                    if (e.offset % ALIGNMENT != 0 || e.offset > f.size || e.bytes > f.size - e.offset)
+                        throw std::runtime_error("Weight cache entry " + name + " lies outside " + path);
+                    reader->entries[name] = e;
+                }
+
+                // every entry is needed soon: start reading the file ahead
+                f.advise(f.data, f.size, MADV_WILLNEED);
+                return reader;
+            }
+
+            const std::map<std::string, Entry>& get_entries() const {
+                return entries;
+            }
+
+            uint64_t get_content_hash() const {
+                return content;
+            }
+
+            const Entry& at(const std::string& name) const {
+                auto it = entries.find(name);
+                if (it == entries.end())
+                    throw std::runtime_error("Weight cache has no entry " + name);
+                return it->second;
+            }
+
+            size_t size() const {
+                return file->size;
+            }
+
+            Tensor<float> tensor(const std::string& name) const {
+                const Entry& e = at(name);
+                expect_kind(name, e, entry_kind::tensor);
+                std::vector<size_t> shape(e.dims.begin(), e.dims.end());
+                size_t elems = 1;
+                for (size_t d : shape)
+                    elems *= d;
+                if (elems * sizeof(float) != e.bytes)
+                    throw std::runtime_error("Weight cache entry " + name + " does not match its shape " + utils::to_string_vec(shape));
+                return Tensor<float>::borrow((float*)bytes_of(e), shape, file);
+            }
+
+            template <typename S>
+            PackedMatrix<float, S> packed(const std::string& name) const {
+                const Entry& e = at(name);
+                expect_kind(name, e, packed_kind<S>());
+                if (e.dims.size() != 2)
+                    throw std::runtime_error("Weight cache entry " + name + " is not a matrix");
+                PackedMatrix<float, S> m = PackedMatrix<float, S>::borrow((kernel::isa)e.param, e.dims[0], e.dims[1], (const S*)bytes_of(e), file);
+                if (m.size() * sizeof(S) != e.bytes)
+                    throw std::runtime_error("Weight cache entry " + name + " does not match its packed size");
+                return m;
+            }
+
+            QuantizedMatrix quantized(const std::string& name) const {
+                const Entry& e = at(name);
+                expect_kind(name, e, entry_kind::quantized);
+                if (e.dims.size() != 2)
+                    throw std::runtime_error("Weight cache entry " + name + " is not a matrix");
+                QuantizedMatrix m = QuantizedMatrix::borrow((kernel::quant_type)e.param, e.dims[0], e.dims[1], bytes_of(e), file);
+                if (m.cols() * m.row_bytes() != e.bytes)
+                    throw std::runtime_error("Weight cache entry " + name + " does not match its quantized size");
+                return m;
+            }
+
+            tokenizer::Tokenizer tokenizer() const {
+                const Entry& e = at("tokenizer");
+                expect_kind("tokenizer", e, entry_kind::tokenizer);
+                size_t offset = e.offset;
+                size_t end = e.offset + e.bytes;
+                auto next = [&]<typename U>(U) {
+                    if (offset + sizeof(U) > end)
+                        throw std::runtime_error("Weight cache tokenizer entry is truncated");
+                    U value = file->read_at<U>(offset);
+                    offset += sizeof(U);
+                    return value;
+                };
+                auto next_string = [&] {
+                    uint32_t length = next(uint32_t{});
+                    if (offset + length > end)
+                        throw std::runtime_error("Weight cache tokenizer entry is truncated");
+                    std::string s = file->read_string_at(offset, length);
+                    offset += length;
+                    return s;
+                };
+
+                uint64_t n_tokens = next(uint64_t{});
+                uint64_t n_merges = next(uint64_t{});
+                uint64_t n_types = next(uint64_t{});
+                std::vector<std::string> tokens;
+                std::vector<std::pair<std::string, std::string>> merges;
+                std::vector<int> token_type;
+                for (uint64_t i = 0; i < n_tokens; i++)
+                    tokens.push_back(next_string());
+                for (uint64_t i = 0; i < n_merges; i++) {
+                    std::string first = next_string();
+                    merges.push_back({std::move(first), next_string()});
+                }
+                for (uint64_t i = 0; i < n_types; i++)
+                    token_type.push_back(next(int32_t{}));
+                return tokenizer::Tokenizer(std::move(tokens), std::move(merges), std::move(token_type));
+            }
+        };
+    }
+}
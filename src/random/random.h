@@ -41,4 +41,48 @@ namespace randomt {
     int randint(int min_val, int max_val) {
         return std::uniform_int_distribution<int>(min_val, max_val)(rng);
     }
+
+    /**
+    * Small, fast generator (xoshiro256**) for one consumer, e.g. one sequence being
+    * sampled: independent of the shared rng, so concurrent users neither contend nor
+    * perturb each other's streams.
+    */
+    struct stream {
+        uint64_t s[4];
+
+        explicit stream(uint64_t stream_seed) {
+            // splitmix64 spreads any seed, including 0, over the whole state
+            for (uint64_t& word : s) {
+                stream_seed += 0x9e3779b97f4a7c15ull;
+                uint64_t z = stream_seed;
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+                word = z ^ (z >> 31);
+            }
+        }
+
+        uint64_t next() {
+            auto rotl = [](uint64_t x, int k) { return (x << k) | (x >> (64 - k)); };
+            uint64_t result = rotl(s[1] * 5, 7) * 9;
+            uint64_t t = s[1] << 17;
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = rotl(s[3], 45);
+            return result;
+        }
+
+        // uniform in [0, 1)
+        float rand() {
+            return (next() >> 40) * 0x1.0p-24f;
+        }
+    };
+
+    // a stream seeded from the shared rng, so set_seed makes it reproducible
+    stream new_stream() {
+        uint64_t stream_seed = ((uint64_t)rng() << 32) | rng();
+        return stream(stream_seed);
+    }
 }
\ No newline at end of file
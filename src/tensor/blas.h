@@ -0,0 +1,102 @@
+#pragma once
+
+#include <tuple>
+
+#include "epilogue.h"
+#include "gemm_batched.h"
+
+namespace blass {
+    /**
+    * Tensor-level description of a fused GEMM epilogue (see kernel::epilogue):
+    *   out = act(out + bias) * mul + residual
+    * bias has one entry per output column, mul and residual have the shape of the output.
+    * Default-constructed (empty) tensors are skipped.
+    */
+    template <typename T>
+    struct Epilogue {
+        Tensor<T> bias = {};
+        kernel::activation act = kernel::activation::none;
+        Tensor<T> mul = {};
+        Tensor<T> residual = {};
+
+        /**
+        * Checks the operands against an output of shape out_shape, makes them contiguous
+        * (kept alive by this object) and returns the raw descriptor the kernels take.
+        */
+        kernel::epilogue<T> bind(const std::vector<size_t>& out_shape) {
+            size_t n = out_shape.empty() ? 1 : out_shape.back();
+            kernel::epilogue<T> raw;
+            raw.act = act;
+
+            if (bias.get_data()) {
+                if (bias.size() != n) {
+                    throw std::invalid_argument("Epilogue bias of shape " + utils::to_string_vec(bias.get_shape()) +
+                                                " does not match " + std::to_string(n) + " output columns");
+                }
+                bias = bias.contiguous();
+                raw.bias = bias.get_data();
+            }
+
+            for (auto [operand, ptr, ld] : {std::tuple{&mul, &raw.mul, &raw.ld_mul},
+                                            std::tuple{&residual, &raw.residual, &raw.ld_residual}}) {
+                if (!operand->get_data())
+                    continue;
+                if (operand->get_shape() != out_shape) {
+                    throw std::invalid_argument("Epilogue operand of shape " + utils::to_string_vec(operand->get_shape()) +
+                                                " does not match output shape " + utils::to_string_vec(out_shape));
+                }
+                *operand = operand->contiguous();
+                *ptr = operand->get_data();
+                *ld = n;
+            }
+            return raw;
+        }
+    };
+
+    /**
+    * BLAS-style C = alpha * op(A) * op(B) + beta * C on row-major storage, where op(A) is
+    * M x K and op(B) is K x N. A is read as M x K with leading dimension lda (or K x M
+    * when trans_a), B as K x N with leading dimension ldb (or N x K when trans_b).
+    * With beta = 0, C is not read and may hold garbage.
+    */
+    template <typename T>
+    void gemm(bool trans_a, bool trans_b, size_t m, size_t n, size_t k,
+              T alpha, const T* a, size_t lda, const T* b, size_t ldb,
+              T beta, T* c, size_t ldc) {
+        kernel::gemm_auto(m, n, k,
+                          a, trans_a ? 1 : lda, trans_a ? lda : 1,
+                          b, trans_b ? 1 : ldb, trans_b ? ldb : 1,
+                          c, ldc, true, alpha, beta);
+    }
+
+    /**
+    * c = alpha * a * b + beta * c for 2D tensors, writing into the existing c in place.
+    * a and b may be any strided view (transposes, slices, broadcasts); with b_transposed
+    * b is laid out as [N, K]. Rows of c must be contiguous. epi is applied last.
+    */
+    template <typename T>
+    void gemm(const Tensor<T>& a, const Tensor<T>& b, Tensor<T>& c,
+              T alpha = T(1), T beta = T(0), bool b_transposed = false, Epilogue<T> epi = {}) {
+        if (a.get_shape().size() != 2 || b.get_shape().size() != 2 || c.get_shape().size() != 2) {
+            throw std::invalid_argument("gemm expects 2D tensors, got shapes " + utils::to_string_vec(a.get_shape()) + ", " +
+                                        utils::to_string_vec(b.get_shape()) + " and " + utils::to_string_vec(c.get_shape()));
+        }
+
+        size_t m = a.get_shape(0);
+        size_t k = a.get_shape(1);
+        size_t n = b.get_shape(!b_transposed);
+        if (b.get_shape(b_transposed) != k || c.get_shape(0) != m || c.get_shape(1) != n) {
+            throw std::invalid_argument("Shape mismatch in gemm: " + utils::to_string_vec(a.get_shape()) + " x " +
+                                        utils::to_string_vec(b.get_shape()) + " into " + utils::to_string_vec(c.get_shape()));
+        }
+        if (n > 1 && c.get_stride(1) != 1) {
+            throw std::invalid_argument("gemm needs an output with contiguous rows");
+        }
+
+        kernel::epilogue<T> raw = epi.bind(c.get_shape());
+        kernel::gemm_auto(m, n, k,
+                          a.get_data(), a.get_stride(0), a.get_stride(1),
+                          b.get_data(), b.get_stride(b_transposed ? 1 : 0), b.get_stride(b_transposed ? 0 : 1),
+                          c.get_data(), c.get_stride(0), true, alpha, beta, &raw);
+    }
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define BLASS_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(BLASS_X86)
+// ISA variants of the hand-written kernels. Functions carrying one of these may use its
+// intrinsics whatever -march the translation unit is built with, but must only run once
+// the CPU is known to support it (see active_isa).
+#define BLASS_TARGET_SSE42 __attribute__((target("sse4.2")))
+#define BLASS_TARGET_AVX2 __attribute__((target("avx2,fma,f16c")))
+#define BLASS_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma,f16c")))
+#endif
+
+namespace blass {
+    namespace kernel {
+        /**
+        * Instruction set a kernel variant is written for, in increasing order of capability.
+        * generic is plain C++ for whatever the compiler targets, and the only variant on
+        * non-x86 builds.
+        */
+        enum class isa {
+            generic,
+            sse42,
+            avx2,
+            avx512
+        };
+
+        template <isa I>
+        using isa_constant = std::integral_constant<isa, I>;
+
+        inline const char* isa_name(isa target) {
+            switch (target) {
+                case isa::sse42: return "sse42";
+                case isa::avx2: return "avx2";
+                case isa::avx512: return "avx512";
+                default: return "generic";
+            }
+        }
+
+        inline isa parse_isa(const std::string& name) {
+            for (isa target : {isa::generic, isa::sse42, isa::avx2, isa::avx512}) {
+                if (name == isa_name(target))
+                    return target;
+            }
+            throw std::invalid_argument("Unknown instruction set '" + name + "', expected generic, sse42, avx2 or avx512");
+        }
+
+        /**
+        * Best variant the running CPU supports.
+        */
+        inline isa detect_isa() {
+#if defined(BLASS_X86)
+            static const isa detected = [] {
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") &&
+                    __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"))
+                    return isa::avx512;
+                if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"))
+                    return isa::avx2;
+                if (__builtin_cpu_supports("sse4.2"))
+                    return isa::sse42;
+                return isa::generic;
+            }();
+            return detected;
+#else
+            return isa::generic;
+#endif
+        }
+
+        /**
+        * Variant the kernels run with. Starts out as detect_isa(), lowered to $BLASS_ISA
+        * when that names a supported variant, e.g. BLASS_ISA=avx2 to benchmark the AVX2
+        * kernels on an AVX-512 machine.
+        */
+        inline std::atomic<isa>& isa_setting() {
+            static std::atomic<isa> setting = [] {
+                isa best = detect_isa();
+                const char* forced = std::getenv("BLASS_ISA");
+                if (!forced)
+                    return best;
+                isa wanted = parse_isa(forced);
+                return wanted < best ? wanted : best;
+            }();
+            return setting;
+        }
+
+        inline isa active_isa() {
+            return isa_setting().load(std::memory_order_relaxed);
+        }
+
+        /**
+        * Forces the kernels to one variant. Matrices already packed for the packed GEMM keep
+        * using the variant they were packed for. Not meant to be called while kernels run.
+        */
+        inline void set_isa(isa target) {
+            if (target > detect_isa()) {
+                throw std::invalid_argument(std::string("This CPU does not support the ") + isa_name(target) +
+                                            " kernels (best is " + isa_name(detect_isa()) + ")");
+            }
+            isa_setting().store(target, std::memory_order_relaxed);
+        }
+
+        /**
+        * Calls f(isa_constant<I>{}) for the variant I matching target, so that f can
+        * instantiate kernels for it. Only float has hand-written variants; every other
+        * type always gets generic.
+        */
+        template <typename T, typename F>
+        decltype(auto) dispatch_isa([[maybe_unused]] isa target, F&& f) {
+#if defined(BLASS_X86)
+            if constexpr (std::is_same_v<T, float>) {
+                switch (target) {
+                    case isa::avx512: return f(isa_constant<isa::avx512>{});
+                    case isa::avx2: return f(isa_constant<isa::avx2>{});
+                    case isa::sse42: return f(isa_constant<isa::sse42>{});
+                    default: break;
+                }
+            }
+#endif
+            return f(isa_constant<isa::generic>{});
+        }
+
+#if defined(BLASS_X86)
+        template <typename F>
+        BLASS_TARGET_AVX512 __attribute__((flatten)) void run_avx512(F& f) {
+            f();
+        }
+
+        template <typename F>
+        BLASS_TARGET_AVX2 __attribute__((flatten)) void run_avx2(F& f) {
+            f();
+        }
+#endif
+
+        /**
+        * Runs a plain loop body compiled for the active variant: f is inlined into a
+        * function targeting that instruction set, so the compiler vectorizes it with the
+        * wider registers even in a baseline build. f must not open a parallel region.
+        */
+        template <typename F>
+        void run_isa(F&& f) {
+#if defined(BLASS_X86)
+            switch (active_isa()) {
+                case isa::avx512: run_avx512(f); return;
+                case isa::avx2: run_avx2(f); return;
+                default: break;
+            }
+#endif
+            f();
+        }
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include "vmath.h"
+
+namespace blass {
+    namespace kernel {
+        enum class activation {
+            none,
+            silu,
+            gelu
+        };
+
+        /**
+        * Elementwise post-processing fused into a GEMM, applied to each output tile right
+        * after its last K slice is written, while it is still in L1:
+        *   out = act(out + bias[col]) * mul[row, col] + residual[row, col]
+        * Every part is optional (null pointer / activation::none).
+        */
+        template <typename T>
+        struct epilogue {
+            const T* bias = nullptr;
+            activation act = activation::none;
+            const T* mul = nullptr;
+            size_t ld_mul = 0;
+            const T* residual = nullptr;
+            size_t ld_residual = 0;
+
+            bool empty() const {
+                return !bias && act == activation::none && !mul && !residual;
+            }
+
+            /**
+            * Applies the epilogue to len consecutive outputs c[0..len), which sit at
+            * (row, col..col+len) of the full output matrix.
+            */
+            void apply(T* __restrict__ c, size_t row, size_t col, size_t len) const {
+                if (bias) {
+                    const T* __restrict__ b = bias + col;
+                    #pragma omp simd
+                    for (size_t j = 0; j < len; j++)
+                        c[j] += b[j];
+                }
+
+                if (act == activation::silu) {
+                    #pragma omp simd
+                    for (size_t j = 0; j < len; j++)
+                        c[j] = fast_silu(c[j]);
+                }
+                else if (act == activation::gelu) {
+                    // tanh approximation, as used by GPT-2 style models
+                    const T k0 = T(0.7978845608028654);
+                    const T k1 = T(0.044715);
+                    for (size_t j = 0; j < len; j++) {
+                        T x = c[j];
+                        c[j] = T(0.5) * x * (T(1) + std::tanh(k0 * (x + k1 * x * x * x)));
+                    }
+                }
+
+                if (mul) {
+                    const T* __restrict__ m = mul + row * ld_mul + col;
+                    #pragma omp simd
+                    for (size_t j = 0; j < len; j++)
+                        c[j] *= m[j];
+                }
+
+                if (residual) {
+                    const T* __restrict__ r = residual + row * ld_residual + col;
+                    #pragma omp simd
+                    for (size_t j = 0; j < len; j++)
+                        c[j] += r[j];
+                }
+            }
+        };
+
+        /**
+        * Applies an epilogue to a whole m x n block of C, for kernels that cannot fuse it
+        * per tile (GEMV, split-K). Rows are split between threads when use_omp is set.
+        */
+        template <typename T>
+        void apply_epilogue(size_t m, size_t n, T* c, size_t ldc, const epilogue<T>* epi, bool use_omp = true) {
+            if (!epi || epi->empty())
+                return;
+
+            // short, wide outputs (decode rows) are split along columns instead
+            constexpr size_t CHUNK = 1024;
+            size_t chunks = (n + CHUNK - 1) / CHUNK;
+            bool parallel = use_omp && m * n >= (1 << 15);
+
+            #pragma omp parallel for collapse(2) schedule(static) if (parallel)
+            for (size_t i = 0; i < m; i++) {
+                for (size_t t = 0; t < chunks; t++) {
+                    size_t col = t * CHUNK;
+                    epi->apply(c + i * ldc + col, i, col, std::min(CHUNK, n - col));
+                }
+            }
+        }
+    }
+}
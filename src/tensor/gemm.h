@@ -0,0 +1,645 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "cpu.h"
+#include "epilogue.h"
+#include "half.h"
+
+namespace blass {
+    namespace kernel {
+        /**
+        * Blocking parameters of the packed GEMM for compute type T and kernel variant I,
+        * using the BLIS naming:
+        * an MR x NR tile of C is held in registers by the micro-kernel,
+        * an NR-wide micro-panel of B (KC deep) stays in L1,
+        * an MC x KC block of packed A stays in L2,
+        * a KC x NC panel of packed B stays in L3.
+        */
+        template <typename T, isa I = isa::generic>
+        struct gemm_params {
+            static constexpr size_t MR = 4;
+            static constexpr size_t NR = 8;
+            static constexpr size_t MC = 128;
+            static constexpr size_t KC = 256;
+            static constexpr size_t NC = 2048;
+        };
+
+        template <>
+        struct gemm_params<float, isa::sse42> {
+            static constexpr size_t MR = 6;
+            static constexpr size_t NR = 8;
+            static constexpr size_t MC = 144;
+            static constexpr size_t KC = 256;
+            static constexpr size_t NC = 2048;
+        };
+
+        template <>
+        struct gemm_params<float, isa::avx2> {
+            static constexpr size_t MR = 6;
+            static constexpr size_t NR = 16;
+            static constexpr size_t MC = 144;
+            static constexpr size_t KC = 256;
+            static constexpr size_t NC = 2048;
+        };
+
+        template <>
+        struct gemm_params<float, isa::avx512> {
+            static constexpr size_t MR = 12;
+            static constexpr size_t NR = 32;
+            static constexpr size_t MC = 144;
+            static constexpr size_t KC = 256;
+            static constexpr size_t NC = 2048;
+        };
+
+        // below this many multiply-adds the packed path runs on the calling thread only
+        constexpr size_t GEMM_OMP_THRESHOLD = 1 << 15;
+
+        /**
+        * Grow-only, 64-byte aligned scratch buffer. Every thread owns its own set of
+        * slots, so calls made from inside a parallel region never share packing space.
+        */
+        template <typename T, int slot>
+        T* workspace(size_t count) {
+            struct buffer {
+                T* ptr = nullptr;
+                size_t capacity = 0;
+                ~buffer() { std::free(ptr); }
+            };
+            static thread_local buffer buf;
+
+            if (buf.capacity < count) {
+                std::free(buf.ptr);
+                size_t bytes = (count * sizeof(T) + 63) / 64 * 64;
+                buf.ptr = static_cast<T*>(std::aligned_alloc(64, bytes));
+                if (!buf.ptr) {
+                    buf.capacity = 0;
+                    throw std::bad_alloc();
+                }
+                buf.capacity = count;
+            }
+            return buf.ptr;
+        }
+
+        /**
+        * C = beta * C. A beta of 0 overwrites C with zeros, so C may start out uninitialised.
+        */
+        template <typename T>
+        void scale_c(size_t m, size_t n, T beta, T* c, size_t ldc) {
+            if (beta == T(1))
+                return;
+
+            for (size_t i = 0; i < m; i++) {
+                T* __restrict__ c_row = c + i * ldc;
+                if (beta == T(0)) {
+                    std::fill_n(c_row, n, T(0));
+                }
+                else {
+                    #pragma omp simd
+                    for (size_t j = 0; j < n; j++)
+                        c_row[j] *= beta;
+                }
+            }
+        }
+
+        /**
+        * C = alpha * op + beta * C for kernels that can only overwrite their output:
+        * kernel(out, ld_out) writes op into a scratch m x n block, which is then folded into C.
+        * Only meant for small outputs (GEMV rows, split-K); with alpha = 1, beta = 0 the
+        * kernel writes straight into C.
+        */
+        template <typename T, typename Kernel>
+        void scaled_output(size_t m, size_t n, T alpha, T beta, T* c, size_t ldc, Kernel&& kernel) {
+            if (alpha == T(1) && beta == T(0)) {
+                kernel(c, ldc);
+                return;
+            }
+
+            T* scratch = workspace<T, 3>(m * n);
+            kernel(scratch, n);
+
+            for (size_t i = 0; i < m; i++) {
+                T* __restrict__ c_row = c + i * ldc;
+                const T* __restrict__ s_row = scratch + i * n;
+                if (beta == T(0)) {
+                    #pragma omp simd
+                    for (size_t j = 0; j < n; j++)
+                        c_row[j] = alpha * s_row[j];
+                }
+                else {
+                    #pragma omp simd
+                    for (size_t j = 0; j < n; j++)
+                        c_row[j] = alpha * s_row[j] + beta * c_row[j];
+                }
+            }
+        }
+
+        /**
+        * Packs an mr-row sliver of A (element (i, p) at a[i * rsa + p * csa]) into
+        * MR-interleaved order: buf[p * MR + i], scaled by alpha. Rows past mr are zero filled.
+        */
+        template <typename T, size_t MR>
+        void pack_a_panel(const T* __restrict__ a, size_t rsa, size_t csa,
+                          size_t mr, size_t kc, T* __restrict__ buf, T alpha = T(1)) {
+            if (csa == 1) {
+                for (size_t i = 0; i < mr; i++) {
+                    const T* __restrict__ row = a + i * rsa;
+                    for (size_t p = 0; p < kc; p++)
+                        buf[p * MR + i] = alpha * row[p];
+                }
+            }
+            else {
+                for (size_t p = 0; p < kc; p++) {
+                    const T* __restrict__ col = a + p * csa;
+                    for (size_t i = 0; i < mr; i++)
+                        buf[p * MR + i] = alpha * col[i * rsa];
+                }
+            }
+            if (mr < MR) {
+                for (size_t p = 0; p < kc; p++)
+                    for (size_t i = mr; i < MR; i++)
+                        buf[p * MR + i] = T(0);
+            }
+        }
+
+        /**
+        * Packs an nr-column sliver of B (element (p, j) at b[p * rsb + j * csb]) into
+        * NR-interleaved order: buf[p * NR + j], converted to the storage type S.
+        * Columns past nr are zero filled.
+        */
+        template <typename T, size_t NR, typename S = T>
+        void pack_b_panel(const T* __restrict__ b, size_t rsb, size_t csb,
+                          size_t kc, size_t nr, S* __restrict__ buf) {
+            if (csb == 1) {
+                for (size_t p = 0; p < kc; p++) {
+                    const T* __restrict__ row = b + p * rsb;
+                    S* __restrict__ dst = buf + p * NR;
+                    for (size_t j = 0; j < nr; j++)
+                        dst[j] = convert_to<S>(row[j]);
+                    for (size_t j = nr; j < NR; j++)
+                        dst[j] = S{};
+                }
+            }
+            else {
+                for (size_t j = 0; j < nr; j++) {
+                    const T* __restrict__ col = b + j * csb;
+                    for (size_t p = 0; p < kc; p++)
+                        buf[p * NR + j] = convert_to<S>(col[p * rsb]);
+                }
+                if (nr < NR) {
+                    for (size_t p = 0; p < kc; p++)
+                        for (size_t j = nr; j < NR; j++)
+                            buf[p * NR + j] = S{};
+                }
+            }
+        }
+
+        /**
+        * Portable micro-kernel: C[MR x NR] (+)= A_panel * B_panel over kc steps, with B
+        * stored as S (T itself, or a 16-bit type widened on load).
+        * The accumulator tile is small enough for the compiler to keep in vector registers.
+        */
+        template <typename T, size_t MR, size_t NR, typename S = T>
+        inline void micro_kernel(size_t kc, const T* __restrict__ a, const S* __restrict__ b,
+                                 T* __restrict__ c, size_t ldc, bool accumulate) {
+            T acc[MR][NR] = {};
+
+            for (size_t p = 0; p < kc; p++) {
+                const T* __restrict__ a_p = a + p * MR;
+                const S* __restrict__ b_p = b + p * NR;
+                #pragma GCC unroll 8
+                for (size_t i = 0; i < MR; i++) {
+                    #pragma omp simd
+                    for (size_t j = 0; j < NR; j++)
+                        acc[i][j] += a_p[i] * convert_to<T>(b_p[j]);
+                }
+            }
+
+            for (size_t i = 0; i < MR; i++) {
+                T* __restrict__ c_row = c + i * ldc;
+                if (accumulate) {
+                    #pragma omp simd
+                    for (size_t j = 0; j < NR; j++)
+                        c_row[j] += acc[i][j];
+                }
+                else {
+                    #pragma omp simd
+                    for (size_t j = 0; j < NR; j++)
+                        c_row[j] = acc[i][j];
+                }
+            }
+        }
+
+#if defined(BLASS_X86)
+        // 16 consecutive packed B values as floats; 16-bit storage is widened in registers.
+        // The zero-masked forms avoid the _mm512_undefined_* passthrough GCC warns about.
+        BLASS_TARGET_AVX512 inline __m512 load_b_avx512(const float* b) {
+            return _mm512_load_ps(b);
+        }
+
+        BLASS_TARGET_AVX512 inline __m512 load_b_avx512(const f16* b) {
+            return _mm512_maskz_cvtph_ps((__mmask16)0xFFFF, _mm256_loadu_si256((const __m256i*)b));
+        }
+
+        BLASS_TARGET_AVX512 inline __m512 load_b_avx512(const bf16* b) {
+            __m512i wide = _mm512_maskz_cvtepu16_epi32((__mmask16)0xFFFF, _mm256_loadu_si256((const __m256i*)b));
+            return _mm512_castsi512_ps(_mm512_maskz_slli_epi32((__mmask16)0xFFFF, wide, 16));
+        }
+
+        template <typename S>
+        BLASS_TARGET_AVX512 inline void micro_kernel_12x32(size_t kc, const float* __restrict__ a, const S* __restrict__ b,
+                                                           float* __restrict__ c, size_t ldc, bool accumulate) {
+            constexpr size_t MR = 12, NR = 32;
+            __m512 acc0[MR], acc1[MR];
+
+            #pragma GCC unroll 12
+            for (size_t i = 0; i < MR; i++) {
+                acc0[i] = _mm512_setzero_ps();
+                acc1[i] = _mm512_setzero_ps();
+            }
+
+            for (size_t p = 0; p < kc; p++) {
+                _mm_prefetch((const char*)(b + 8 * NR), _MM_HINT_T0);
+                __m512 b0 = load_b_avx512(b);
+                __m512 b1 = load_b_avx512(b + 16);
+
+                #pragma GCC unroll 12
+                for (size_t i = 0; i < MR; i++) {
+                    __m512 a_i = _mm512_set1_ps(a[i]);
+                    acc0[i] = _mm512_fmadd_ps(a_i, b0, acc0[i]);
+                    acc1[i] = _mm512_fmadd_ps(a_i, b1, acc1[i]);
+                }
+                a += MR;
+                b += NR;
+            }
+
+            #pragma GCC unroll 12
+            for (size_t i = 0; i < MR; i++) {
+                float* c_row = c + i * ldc;
+                if (accumulate) {
+                    acc0[i] = _mm512_add_ps(acc0[i], _mm512_loadu_ps(c_row));
+                    acc1[i] = _mm512_add_ps(acc1[i], _mm512_loadu_ps(c_row + 16));
+                }
+                _mm512_storeu_ps(c_row, acc0[i]);
+                _mm512_storeu_ps(c_row + 16, acc1[i]);
+            }
+        }
+
+        // 8 consecutive packed B values as floats
+        BLASS_TARGET_AVX2 inline __m256 load_b_avx2(const float* b) {
+            return _mm256_load_ps(b);
+        }
+
+        BLASS_TARGET_AVX2 inline __m256 load_b_avx2(const f16* b) {
+            return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)b));
+        }
+
+        BLASS_TARGET_AVX2 inline __m256 load_b_avx2(const bf16* b) {
+            __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)b));
+            return _mm256_castsi256_ps(_mm256_slli_epi32(wide, 16));
+        }
+
+        template <typename S>
+        BLASS_TARGET_AVX2 inline void micro_kernel_6x16(size_t kc, const float* __restrict__ a, const S* __restrict__ b,
+                                                        float* __restrict__ c, size_t ldc, bool accumulate) {
+            constexpr size_t MR = 6, NR = 16;
+            __m256 acc0[MR], acc1[MR];
+
+            #pragma GCC unroll 6
+            for (size_t i = 0; i < MR; i++) {
+                acc0[i] = _mm256_setzero_ps();
+                acc1[i] = _mm256_setzero_ps();
+            }
+
+            for (size_t p = 0; p < kc; p++) {
+                _mm_prefetch((const char*)(b + 8 * NR), _MM_HINT_T0);
+                __m256 b0 = load_b_avx2(b);
+                __m256 b1 = load_b_avx2(b + 8);
+
+                #pragma GCC unroll 6
+                for (size_t i = 0; i < MR; i++) {
+                    __m256 a_i = _mm256_broadcast_ss(a + i);
+                    acc0[i] = _mm256_fmadd_ps(a_i, b0, acc0[i]);
+                    acc1[i] = _mm256_fmadd_ps(a_i, b1, acc1[i]);
+                }
+                a += MR;
+                b += NR;
+            }
+
+            #pragma GCC unroll 6
+            for (size_t i = 0; i < MR; i++) {
+                float* c_row = c + i * ldc;
+                if (accumulate) {
+                    acc0[i] = _mm256_add_ps(acc0[i], _mm256_loadu_ps(c_row));
+                    acc1[i] = _mm256_add_ps(acc1[i], _mm256_loadu_ps(c_row + 8));
+                }
+                _mm256_storeu_ps(c_row, acc0[i]);
+                _mm256_storeu_ps(c_row + 8, acc1[i]);
+            }
+        }
+
+        // 4 consecutive packed B values as floats. Without F16C, half floats are widened with
+        // integer shifts and one multiply that rebiases the exponent (subnormals included),
+        // then infinities and NaNs get their all-ones exponent back.
+        BLASS_TARGET_SSE42 inline __m128 load_b_sse(const float* b) {
+            return _mm_load_ps(b);
+        }
+
+        BLASS_TARGET_SSE42 inline __m128 load_b_sse(const f16* b) {
+            __m128i h = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)b));
+            __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+            __m128i magnitude = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+            __m128 wide = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(magnitude, 13)),
+                                     _mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
+            __m128i inf_nan = _mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x7bff));
+            wide = _mm_or_ps(wide, _mm_castsi128_ps(_mm_and_si128(inf_nan, _mm_set1_epi32(0x7f800000))));
+            return _mm_or_ps(wide, _mm_castsi128_ps(sign));
+        }
+
+        BLASS_TARGET_SSE42 inline __m128 load_b_sse(const bf16* b) {
+            __m128i wide = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)b));
+            return _mm_castsi128_ps(_mm_slli_epi32(wide, 16));
+        }
+
+        template <typename S>
+        BLASS_TARGET_SSE42 inline void micro_kernel_6x8(size_t kc, const float* __restrict__ a, const S* __restrict__ b,
+                                                        float* __restrict__ c, size_t ldc, bool accumulate) {
+            constexpr size_t MR = 6, NR = 8;
+            __m128 acc0[MR], acc1[MR];
+
+            #pragma GCC unroll 6
+            for (size_t i = 0; i < MR; i++) {
+                acc0[i] = _mm_setzero_ps();
+                acc1[i] = _mm_setzero_ps();
+            }
+
+            for (size_t p = 0; p < kc; p++) {
+                _mm_prefetch((const char*)(b + 8 * NR), _MM_HINT_T0);
+                __m128 b0 = load_b_sse(b);
+                __m128 b1 = load_b_sse(b + 4);
+
+                #pragma GCC unroll 6
+                for (size_t i = 0; i < MR; i++) {
+                    __m128 a_i = _mm_set1_ps(a[i]);
+                    acc0[i] = _mm_add_ps(acc0[i], _mm_mul_ps(a_i, b0));
+                    acc1[i] = _mm_add_ps(acc1[i], _mm_mul_ps(a_i, b1));
+                }
+                a += MR;
+                b += NR;
+            }
+
+            #pragma GCC unroll 6
+            for (size_t i = 0; i < MR; i++) {
+                float* c_row = c + i * ldc;
+                if (accumulate) {
+                    acc0[i] = _mm_add_ps(acc0[i], _mm_loadu_ps(c_row));
+                    acc1[i] = _mm_add_ps(acc1[i], _mm_loadu_ps(c_row + 4));
+                }
+                _mm_storeu_ps(c_row, acc0[i]);
+                _mm_storeu_ps(c_row + 4, acc1[i]);
+            }
+        }
+#endif
+
+        /**
+        * Micro-kernel of variant I for the tile shape of gemm_params<T, I>: the hand-written
+        * float kernels on x86, the portable one otherwise.
+        */
+        template <typename T, isa I, typename S = T>
+        inline void run_micro_kernel(size_t kc, const T* __restrict__ a, const S* __restrict__ b,
+                                     T* __restrict__ c, size_t ldc, bool accumulate) {
+            constexpr size_t MR = gemm_params<T, I>::MR;
+            constexpr size_t NR = gemm_params<T, I>::NR;
+#if defined(BLASS_X86)
+            if constexpr (std::is_same_v<T, float> && I == isa::avx512)
+                micro_kernel_12x32(kc, a, b, c, ldc, accumulate);
+            else if constexpr (std::is_same_v<T, float> && I == isa::avx2)
+                micro_kernel_6x16(kc, a, b, c, ldc, accumulate);
+            else if constexpr (std::is_same_v<T, float> && I == isa::sse42)
+                micro_kernel_6x8(kc, a, b, c, ldc, accumulate);
+            else
+                micro_kernel<T, MR, NR>(kc, a, b, c, ldc, accumulate);
+#else
+            micro_kernel<T, MR, NR>(kc, a, b, c, ldc, accumulate);
+#endif
+        }
+
+        /**
+        * Runs the micro-kernel over one packed MC x KC block of A against one packed KC x NC
+        * panel of B. Partial edge tiles go through a local tile so the micro-kernel only ever
+        * sees full MR x NR tiles. Must be called from inside a parallel region (or serially).
+        * A non-null epi is applied to every finished tile; (row0, col0) is the position of
+        * this block inside the full C. B may be packed in a 16-bit storage type S.
+        */
+        template <isa I, typename T, typename S = T>
+        void macro_kernel(size_t mc, size_t nc, size_t kc, const T* __restrict__ packed_a,
+                          const S* __restrict__ packed_b, T* __restrict__ c, size_t ldc, bool accumulate,
+                          const epilogue<T>* epi = nullptr, size_t row0 = 0, size_t col0 = 0) {
+            constexpr size_t MR = gemm_params<T, I>::MR;
+            constexpr size_t NR = gemm_params<T, I>::NR;
+
+            size_t m_panels = (mc + MR - 1) / MR;
+            size_t n_panels = (nc + NR - 1) / NR;
+
+            #pragma omp for collapse(2) schedule(static)
+            for (size_t jr = 0; jr < n_panels; jr++) {
+                for (size_t ir = 0; ir < m_panels; ir++) {
+                    size_t mr = std::min(MR, mc - ir * MR);
+                    size_t nr = std::min(NR, nc - jr * NR);
+
+                    const T* a_panel = packed_a + ir * MR * kc;
+                    const S* b_panel = packed_b + jr * NR * kc;
+                    T* c_tile = c + ir * MR * ldc + jr * NR;
+
+                    if (mr == MR && nr == NR) {
+                        run_micro_kernel<T, I>(kc, a_panel, b_panel, c_tile, ldc, accumulate);
+                    }
+                    else {
+                        alignas(64) T tile[MR * NR];
+                        run_micro_kernel<T, I>(kc, a_panel, b_panel, tile, NR, false);
+                        for (size_t i = 0; i < mr; i++) {
+                            for (size_t j = 0; j < nr; j++) {
+                                if (accumulate) c_tile[i * ldc + j] += tile[i * NR + j];
+                                else c_tile[i * ldc + j] = tile[i * NR + j];
+                            }
+                        }
+                    }
+
+                    if (epi) {
+                        for (size_t i = 0; i < mr; i++)
+                            epi->apply(c_tile + i * ldc, row0 + ir * MR + i, col0 + jr * NR, nr);
+                    }
+                }
+            }
+        }
+
+        /**
+        * Size (in elements) of a k x n matrix B stored in fully packed form: for every KC-deep
+        * slice, ceil(n / NR) micro-panels of NR x kc elements each.
+        */
+        template <isa I, typename T>
+        size_t packed_b_size(size_t k, size_t n) {
+            constexpr size_t NR = gemm_params<T, I>::NR;
+            return k * ((n + NR - 1) / NR) * NR;
+        }
+
+        /**
+        * Offset of the micro-panel holding column j of KC slice pc inside a fully packed B.
+        * Both j and pc must be block aligned (multiples of NR and KC).
+        */
+        template <isa I, typename T>
+        size_t packed_b_offset(size_t k, size_t n, size_t pc, size_t j) {
+            constexpr size_t NR = gemm_params<T, I>::NR;
+            size_t kc = std::min(gemm_params<T, I>::KC, k - pc);
+            return pc * ((n + NR - 1) / NR) * NR + j * kc;
+        }
+
+        /**
+        * Packs the whole of B (element (p, j) at b[p * rsb + j * csb]) once, in the layout
+        * gemm_prepacked<I> consumes for compute type T, converting it to the storage type S.
+        * Used for weights that are multiplied many times.
+        */
+        template <isa I, typename T, typename S = T, typename Src = T>
+        void pack_b(size_t k, size_t n, const Src* b, size_t rsb, size_t csb, S* packed, bool use_omp = true) {
+            using P = gemm_params<T, I>;
+            constexpr size_t NR = P::NR;
+            size_t n_panels = (n + NR - 1) / NR;
+
+            for (size_t pc = 0; pc < k; pc += P::KC) {
+                size_t kc = std::min(P::KC, k - pc);
+
+                #pragma omp parallel for schedule(static) if (use_omp)
+                for (size_t jr = 0; jr < n_panels; jr++) {
+                    pack_b_panel<Src, NR>(b + pc * rsb + jr * NR * csb, rsb, csb,
+                                        kc, std::min(NR, n - jr * NR), packed + packed_b_offset<I, T>(k, n, pc, jr * NR));
+                }
+            }
+        }
+
+        /**
+        * Shared GEMM loop nest: jc over NC-wide panels of B, pc over KC-deep slices,
+        * ic over MC-tall blocks of A, then the macro-kernel over MR x NR register tiles.
+        * b_panel(jc, nc, pc, kc) returns the packed KC x NC panel of B (in the layout of
+        * variant I) and is called by every thread of the team, so it may contain
+        * worksharing loops.
+        * Computes C = alpha * A * B, or C += alpha * A * B with accumulate, then applies epi.
+        */
+        template <isa I, typename T, typename BPanel>
+        void gemm_driver(size_t m, size_t n, size_t k,
+                         const T* a, size_t rsa, size_t csa,
+                         BPanel&& b_panel, T* c, size_t ldc, bool use_omp,
+                         T alpha = T(1), bool accumulate = false, const epilogue<T>* epi = nullptr) {
+            using P = gemm_params<T, I>;
+            constexpr size_t MR = P::MR;
+
+            if (m == 0 || n == 0)
+                return;
+
+            if (epi && epi->empty())
+                epi = nullptr;
+
+            if (k == 0) {
+                if (!accumulate) {
+                    for (size_t i = 0; i < m; i++)
+                        std::fill_n(c + i * ldc, n, T(0));
+                }
+                apply_epilogue(m, n, c, ldc, epi, use_omp);
+                return;
+            }
+
+            T* packed_a = workspace<T, 0>(((std::min(m, P::MC) + MR - 1) / MR) * MR * P::KC);
+
+            bool parallel = use_omp && m * n * k >= GEMM_OMP_THRESHOLD;
+
+            #pragma omp parallel if (parallel)
+            {
+                for (size_t jc = 0; jc < n; jc += P::NC) {
+                    size_t nc = std::min(P::NC, n - jc);
+
+                    for (size_t pc = 0; pc < k; pc += P::KC) {
+                        size_t kc = std::min(P::KC, k - pc);
+                        const auto* packed_b = b_panel(jc, nc, pc, kc);
+
+                        for (size_t ic = 0; ic < m; ic += P::MC) {
+                            size_t mc = std::min(P::MC, m - ic);
+                            size_t m_panels = (mc + MR - 1) / MR;
+
+                            #pragma omp for schedule(static)
+                            for (size_t ir = 0; ir < m_panels; ir++) {
+                                pack_a_panel<T, MR>(a + (ic + ir * MR) * rsa + pc * csa, rsa, csa,
+                                                    std::min(MR, mc - ir * MR), kc, packed_a + ir * MR * kc, alpha);
+                            }
+
+                            macro_kernel<I>(mc, nc, kc, packed_a, packed_b, c + ic * ldc + jc, ldc, accumulate || pc > 0,
+                                            pc + kc == k ? epi : nullptr, ic, jc);
+                        }
+                    }
+                }
+            }
+        }
+
+        /**
+        * C = A * B for an m x k matrix A and a k x n matrix B, both given by arbitrary
+        * element strides (so transposed or broadcast views need no copy), writing into a
+        * row-major C with leading dimension ldc. B is packed panel by panel as it is used.
+        * With accumulate the product is added to C instead of overwriting it.
+        */
+        template <isa I, typename T>
+        void gemm_packed(size_t m, size_t n, size_t k,
+                         const T* a, size_t rsa, size_t csa,
+                         const T* b, size_t rsb, size_t csb,
+                         T* c, size_t ldc, bool use_omp = true,
+                         T alpha = T(1), bool accumulate = false, const epilogue<T>* epi = nullptr) {
+            using P = gemm_params<T, I>;
+            constexpr size_t NR = P::NR;
+            T* packed_b = workspace<T, 1>(((std::min(n, P::NC) + NR - 1) / NR) * NR * P::KC);
+
+            auto pack_panel = [&](size_t jc, size_t nc, size_t pc, size_t kc) -> const T* {
+                size_t n_panels = (nc + NR - 1) / NR;
+
+                #pragma omp for schedule(static)
+                for (size_t jr = 0; jr < n_panels; jr++) {
+                    pack_b_panel<T, NR>(b + pc * rsb + (jc + jr * NR) * csb, rsb, csb,
+                                        kc, std::min(NR, nc - jr * NR), packed_b + jr * NR * kc);
+                }
+                return packed_b;
+            };
+
+            gemm_driver<I>(m, n, k, a, rsa, csa, pack_panel, c, ldc, use_omp, alpha, accumulate, epi);
+        }
+
+        /**
+        * gemm_packed with the kernels of the active variant.
+        */
+        template <typename T>
+        void gemm_packed(size_t m, size_t n, size_t k,
+                         const T* a, size_t rsa, size_t csa,
+                         const T* b, size_t rsb, size_t csb,
+                         T* c, size_t ldc, bool use_omp = true,
+                         T alpha = T(1), bool accumulate = false, const epilogue<T>* epi = nullptr) {
+            dispatch_isa<T>(active_isa(), [&](auto I) {
+                gemm_packed<I>(m, n, k, a, rsa, csa, b, rsb, csb, c, ldc, use_omp, alpha, accumulate, epi);
+            });
+        }
+
+        /**
+        * Same as gemm_packed, but B was packed ahead of time with pack_b<I>, so no packing
+        * (and no pass over the unpacked B) happens inside the call. With a 16-bit storage
+        * type S the micro-kernel widens B as it loads it.
+        */
+        template <isa I, typename T, typename S = T>
+        void gemm_prepacked(size_t m, size_t n, size_t k,
+                            const T* a, size_t rsa, size_t csa,
+                            const S* packed_b, T* c, size_t ldc, bool use_omp = true,
+                            T alpha = T(1), bool accumulate = false, const epilogue<T>* epi = nullptr) {
+            auto panel = [&](size_t jc, size_t, size_t pc, size_t) -> const S* {
+                return packed_b + packed_b_offset<I, T>(k, n, pc, jc);
+            };
+
+            gemm_driver<I>(m, n, k, a, rsa, csa, panel, c, ldc, use_omp, alpha, accumulate, epi);
+        }
+    }
+}
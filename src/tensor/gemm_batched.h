@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "gemm.h"
+#include "gemm_skinny.h"
+#include "gemv.h"
+
+namespace blass {
+    namespace kernel {
+        /**
+        * C = alpha * A * B + beta * C for a single m x k by k x n product given by element
+        * strides, picking the kernel from the shape: outer product, split-K, GEMV (row-wise or
+        * column-wise B) or the packed GEMM. A non-null epi is fused into the packed GEMM per
+        * tile and run as one pass over the (small) output everywhere else. I selects the
+        * kernel variant.
+        */
+        template <isa I, typename T>
+        void gemm_auto(size_t m, size_t n, size_t k,
+                       const T* a, size_t rsa, size_t csa,
+                       const T* b, size_t rsb, size_t csb,
+                       T* c, size_t ldc, bool use_omp = true,
+                       T alpha = T(1), T beta = T(0), const epilogue<T>* epi = nullptr) {
+            if (m == 0 || n == 0)
+                return;
+
+            if (k == 0 || alpha == T(0)) {
+                scale_c(m, n, beta, c, ldc);
+            }
+            else if (k == 1) {
+                // an outer product: no reduction, just broadcast-multiply into C
+                gemm_rank1(m, n, a, rsa, b, csb, c, ldc, use_omp, alpha, beta);
+            }
+            else if (m * n <= SPLITK_MAX_OUTPUTS && k >= SPLITK_MIN_K) {
+                // too few outputs to keep every thread busy: split the reduction itself
+                scaled_output(m, n, alpha, beta, c, ldc, [&](T* out, size_t ld_out) {
+                    gemm_split_k<I>(m, n, k, a, rsa, csa, b, rsb, csb, out, ld_out, use_omp);
+                });
+            }
+            else if (m <= GEMV_MAX_ROWS && csa == 1 && rsb == 1) {
+                // decode-style row vector(s) against [N, K] weights: one streamed dot product per weight row
+                scaled_output(m, n, alpha, beta, c, ldc, [&](T* out, size_t ld_out) {
+                    gemv_rows<I>(m, n, k, a, rsa, b, csb, out, ld_out, use_omp);
+                });
+            }
+            else if (m <= GEMV_MAX_ROWS && csb == 1) {
+                scaled_output(m, n, alpha, beta, c, ldc, [&](T* out, size_t ld_out) {
+                    gemv_cols(m, n, k, a, rsa, csa, b, rsb, out, ld_out, use_omp);
+                });
+            }
+            else {
+                if (beta != T(0))
+                    scale_c(m, n, beta, c, ldc);
+                // the epilogue runs per tile inside the packed GEMM
+                gemm_packed<I>(m, n, k, a, rsa, csa, b, rsb, csb, c, ldc, use_omp, alpha, beta != T(0), epi);
+                return;
+            }
+
+            apply_epilogue(m, n, c, ldc, epi, use_omp);
+        }
+
+        /**
+        * gemm_auto with the kernels of the active variant.
+        */
+        template <typename T>
+        void gemm_auto(size_t m, size_t n, size_t k,
+                       const T* a, size_t rsa, size_t csa,
+                       const T* b, size_t rsb, size_t csb,
+                       T* c, size_t ldc, bool use_omp = true,
+                       T alpha = T(1), T beta = T(0), const epilogue<T>* epi = nullptr) {
+            dispatch_isa<T>(active_isa(), [&](auto I) {
+                gemm_auto<I>(m, n, k, a, rsa, csa, b, rsb, csb, c, ldc, use_omp, alpha, beta, epi);
+            });
+        }
+
+        /**
+        * C_i = A_i * B_i for i < batch, where A_i starts at a + i * stride_a (likewise for B
+        * and C). A stride of 0 broadcasts one operand over the whole batch. Products write
+        * straight into their slice of C; when they are too small to keep every thread busy
+        * on their own, threads are spread over (batch, row tile) pairs instead.
+        */
+        template <isa I, typename T>
+        void gemm_strided_batched(size_t batch, size_t m, size_t n, size_t k,
+                                  const T* a, size_t stride_a, size_t rsa, size_t csa,
+                                  const T* b, size_t stride_b, size_t rsb, size_t csb,
+                                  T* c, size_t stride_c, size_t ldc, bool use_omp = true) {
+            if (batch == 0 || m == 0 || n == 0)
+                return;
+
+            size_t tile_rows = m <= GEMV_MAX_ROWS ? m : gemm_params<T, I>::MC;
+            size_t row_tiles = (m + tile_rows - 1) / tile_rows;
+#ifdef _OPENMP
+            size_t max_threads = use_omp ? omp_get_max_threads() : 1;
+#else
+            size_t max_threads = 1;
+#endif
+
+            if (batch == 1 || batch * row_tiles < max_threads) {
+                for (size_t i = 0; i < batch; i++)
+                    gemm_auto<I>(m, n, k, a + i * stride_a, rsa, csa, b + i * stride_b, rsb, csb,
+                                 c + i * stride_c, ldc, use_omp);
+                return;
+            }
+
+            bool parallel = use_omp && batch * m * n * k >= GEMM_OMP_THRESHOLD;
+
+            #pragma omp parallel for collapse(2) schedule(static) if (parallel)
+            for (size_t i = 0; i < batch; i++) {
+                for (size_t t = 0; t < row_tiles; t++) {
+                    size_t row = t * tile_rows;
+                    gemm_auto<I>(std::min(tile_rows, m - row), n, k,
+                                 a + i * stride_a + row * rsa, rsa, csa,
+                                 b + i * stride_b, rsb, csb,
+                                 c + i * stride_c + row * ldc, ldc, false);
+                }
+            }
+        }
+
+        /**
+        * gemm_strided_batched with the kernels of the active variant.
+        */
+        template <typename T>
+        void gemm_strided_batched(size_t batch, size_t m, size_t n, size_t k,
+                                  const T* a, size_t stride_a, size_t rsa, size_t csa,
+                                  const T* b, size_t stride_b, size_t rsb, size_t csb,
+                                  T* c, size_t stride_c, size_t ldc, bool use_omp = true) {
+            dispatch_isa<T>(active_isa(), [&](auto I) {
+                gemm_strided_batched<I>(batch, m, n, k, a, stride_a, rsa, csa, b, stride_b, rsb, csb,
+                                        c, stride_c, ldc, use_omp);
+            });
+        }
+    }
+}
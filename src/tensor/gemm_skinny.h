@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "gemm.h"
+#include "gemv.h"
+
+namespace blass {
+    namespace kernel {
+        // split-K is used when there are at most this many outputs...
+        constexpr size_t SPLITK_MAX_OUTPUTS = 64;
+        // ...and the reduction is at least this long
+        constexpr size_t SPLITK_MIN_K = 1 << 14;
+
+        /**
+        * C[m x n] = A * B for a tiny C and a huge k. Every thread reduces its own contiguous
+        * slice of k into a private m x n partial, and the partials are then combined with a
+        * pairwise tree reduction (log2(threads) rounds) instead of one parallel region per output.
+        */
+        template <isa I, typename T>
+        void gemm_split_k(size_t m, size_t n, size_t k,
+                          const T* a, size_t rsa, size_t csa,
+                          const T* b, size_t rsb, size_t csb,
+                          T* c, size_t ldc, bool use_omp = true) {
+#ifdef _OPENMP
+            size_t max_threads = use_omp ? omp_get_max_threads() : 1;
+#else
+            size_t max_threads = 1;
+#endif
+            // per-thread partials are padded to whole cache lines
+            size_t outputs = m * n;
+            size_t stride = (outputs * sizeof(T) + 63) / 64 * 64 / sizeof(T);
+            T* partials = workspace<T, 2>(max_threads * stride);
+
+            #pragma omp parallel if (use_omp)
+            {
+#ifdef _OPENMP
+                size_t n_threads = omp_get_num_threads();
+                size_t tid = omp_get_thread_num();
+#else
+                size_t n_threads = 1;
+                size_t tid = 0;
+#endif
+                size_t begin, end;
+                thread_range(k, 64, begin, end);
+                T* mine = partials + tid * stride;
+
+                size_t len = end - begin;
+                if (csa == 1 && rsb == 1) {
+                    // up to GEMV_MAX_ROWS rows of A share every streamed column of B
+                    for (size_t i = 0; i < m; i += GEMV_MAX_ROWS) {
+                        const T* a_rows = a + i * rsa + begin;
+                        for (size_t j = 0; j < n; j++) {
+                            const T* b_col = b + j * csb + begin;
+                            T* out = mine + i * n + j;
+                            switch (std::min(m - i, GEMV_MAX_ROWS)) {
+                                case 4: gemv_rows_kernel<I, T, 4>(len, a_rows, rsa, b_col, out, n); break;
+                                case 3: gemv_rows_kernel<I, T, 3>(len, a_rows, rsa, b_col, out, n); break;
+                                case 2: gemv_rows_kernel<I, T, 2>(len, a_rows, rsa, b_col, out, n); break;
+                                default: gemv_rows_kernel<I, T, 1>(len, a_rows, rsa, b_col, out, n); break;
+                            }
+                        }
+                    }
+                }
+                else {
+                    for (size_t i = 0; i < m; i++) {
+                        for (size_t j = 0; j < n; j++) {
+                            const T* a_row = a + i * rsa + begin * csa;
+                            const T* b_col = b + j * csb + begin * rsb;
+                            T sum = 0;
+                            for (size_t p = 0; p < len; p++)
+                                sum += a_row[p * csa] * b_col[p * rsb];
+                            mine[i * n + j] = sum;
+                        }
+                    }
+                }
+
+                for (size_t step = 1; step < n_threads; step *= 2) {
+                    #pragma omp barrier
+                    if (tid % (2 * step) == 0 && tid + step < n_threads) {
+                        const T* other = partials + (tid + step) * stride;
+                        for (size_t idx = 0; idx < outputs; idx++)
+                            mine[idx] += other[idx];
+                    }
+                }
+            }
+
+            for (size_t i = 0; i < m; i++)
+                std::copy(partials + i * n, partials + (i + 1) * n, c + i * ldc);
+        }
+
+        /**
+        * gemm_split_k with the kernels of the active variant.
+        */
+        template <typename T>
+        void gemm_split_k(size_t m, size_t n, size_t k,
+                          const T* a, size_t rsa, size_t csa,
+                          const T* b, size_t rsb, size_t csb,
+                          T* c, size_t ldc, bool use_omp = true) {
+            dispatch_isa<T>(active_isa(), [&](auto I) {
+                gemm_split_k<I>(m, n, k, a, rsa, csa, b, rsb, csb, c, ldc, use_omp);
+            });
+        }
+
+        /**
+        * C[m x n] = alpha * a * b^T + beta * C for k == 1: a pure outer product. Bound by the
+        * stores to C, so rows are split between threads and each row is a broadcast-multiply of
+        * a contiguous copy of b.
+        */
+        template <typename T>
+        void gemm_rank1(size_t m, size_t n, const T* a, size_t rsa,
+                        const T* b, size_t csb, T* c, size_t ldc, bool use_omp = true,
+                        T alpha = T(1), T beta = T(0)) {
+            const T* b_row = b;
+            if (csb != 1) {
+                T* gathered = workspace<T, 2>(n);
+                for (size_t j = 0; j < n; j++)
+                    gathered[j] = b[j * csb];
+                b_row = gathered;
+            }
+
+            bool parallel = use_omp && m * n >= GEMM_OMP_THRESHOLD;
+
+            #pragma omp parallel for schedule(static) if (parallel)
+            for (size_t i = 0; i < m; i++) {
+                T a_val = alpha * a[i * rsa];
+                T* __restrict__ c_row = c + i * ldc;
+                const T* __restrict__ src = b_row;
+
+                if (beta == T(0)) {
+                    #pragma omp simd
+                    for (size_t j = 0; j < n; j++)
+                        c_row[j] = a_val * src[j];
+                }
+                else {
+                    #pragma omp simd
+                    for (size_t j = 0; j < n; j++)
+                        c_row[j] = a_val * src[j] + beta * c_row[j];
+                }
+            }
+        }
+    }
+}
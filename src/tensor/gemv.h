@@ -0,0 +1,560 @@
+#pragma once
+
+#include <algorithm>
+#include <type_traits>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "gemm.h"
+
+namespace blass {
+    namespace kernel {
+        // up to this many rows of A, matmul is treated as a (multi-)vector product
+        constexpr size_t GEMV_MAX_ROWS = 4;
+
+        // below this many weight elements, the vector product runs on the calling thread only
+        constexpr size_t GEMV_OMP_THRESHOLD = 1 << 15;
+
+        // how far ahead (in bytes) the weight stream is prefetched
+        constexpr size_t GEMV_PREFETCH_BYTES = 1024;
+
+        // read-once prefetch into L1 that does not displace cached activations in L2/L3
+        inline void prefetch_stream(const void* ptr) {
+            __builtin_prefetch(ptr, 0, 0);
+        }
+
+        /**
+        * Splits [0, n) into equal contiguous ranges, one per thread, with boundaries rounded
+        * to multiples of align so neighbouring threads never write into the same cache line.
+        */
+        inline void thread_range(size_t n, size_t align, size_t& begin, size_t& end) {
+#ifdef _OPENMP
+            size_t n_threads = omp_get_num_threads();
+            size_t tid = omp_get_thread_num();
+#else
+            size_t n_threads = 1;
+            size_t tid = 0;
+#endif
+            size_t units = (n + align - 1) / align;
+            begin = std::min(n, units * tid / n_threads * align);
+            end = std::min(n, units * (tid + 1) / n_threads * align);
+        }
+
+#if defined(BLASS_X86)
+        BLASS_TARGET_AVX512 inline float hsum(__m512 v) {
+            alignas(64) float lanes[16];
+            _mm512_store_ps(lanes, v);
+            float sum = 0;
+            for (size_t i = 0; i < 16; i++)
+                sum += lanes[i];
+            return sum;
+        }
+
+        template <size_t M>
+        BLASS_TARGET_AVX512 inline void gemv_rows_kernel_avx512(size_t k, const float* __restrict__ a, size_t lda,
+                                                                const float* __restrict__ b_row, float* __restrict__ out, size_t ldc) {
+            // independent accumulators per row hide the FMA latency; fewer rows need more of them
+            constexpr size_t U = M == 1 ? 4 : 2;
+            constexpr size_t STEP = 16 * U;
+            __m512 acc[M][U];
+
+            #pragma GCC unroll 8
+            for (size_t i = 0; i < M; i++)
+                for (size_t u = 0; u < U; u++)
+                    acc[i][u] = _mm512_setzero_ps();
+
+            size_t p = 0;
+            for (; p + STEP <= k; p += STEP) {
+                prefetch_stream((const char*)(b_row + p) + GEMV_PREFETCH_BYTES);
+                __m512 b_vec[U];
+                #pragma GCC unroll 8
+                for (size_t u = 0; u < U; u++)
+                    b_vec[u] = _mm512_loadu_ps(b_row + p + 16 * u);
+
+                #pragma GCC unroll 8
+                for (size_t i = 0; i < M; i++)
+                    for (size_t u = 0; u < U; u++)
+                        acc[i][u] = _mm512_fmadd_ps(_mm512_loadu_ps(a + i * lda + p + 16 * u), b_vec[u], acc[i][u]);
+            }
+            for (; p < k; p += 16) {
+                __mmask16 mask = k - p >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (k - p)) - 1);
+                __m512 b_vec = _mm512_maskz_loadu_ps(mask, b_row + p);
+                #pragma GCC unroll 8
+                for (size_t i = 0; i < M; i++)
+                    acc[i][0] = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i * lda + p), b_vec, acc[i][0]);
+            }
+
+            #pragma GCC unroll 8
+            for (size_t i = 0; i < M; i++) {
+                for (size_t u = 1; u < U; u++)
+                    acc[i][0] = _mm512_add_ps(acc[i][0], acc[i][u]);
+                out[i * ldc] = hsum(acc[i][0]);
+            }
+        }
+
+        template <size_t M, typename S>
+        BLASS_TARGET_AVX512 inline void gemv_panel_kernel_avx512(size_t kc, const float* __restrict__ a, size_t lda,
+                                                                 const S* __restrict__ panel, float* __restrict__ acc) {
+            constexpr size_t NR = gemm_params<float, isa::avx512>::NR;
+            // with a single row, even and odd k steps get separate accumulators to hide the FMA latency
+            constexpr size_t U = M == 1 ? 2 : 1;
+            __m512 acc0[M][U], acc1[M][U];
+
+            #pragma GCC unroll 8
+            for (size_t i = 0; i < M; i++) {
+                acc0[i][0] = _mm512_load_ps(acc + i * NR);
+                acc1[i][0] = _mm512_load_ps(acc + i * NR + 16);
+                #pragma GCC unroll 8
+                for (size_t u = 1; u < U; u++) {
+                    acc0[i][u] = _mm512_setzero_ps();
+                    acc1[i][u] = _mm512_setzero_ps();
+                }
+            }
+
+            size_t p = 0;
+            for (; p + U <= kc; p += U) {
+                prefetch_stream(panel + p * NR + GEMV_PREFETCH_BYTES / sizeof(S));
+                #pragma GCC unroll 8
+                for (size_t u = 0; u < U; u++) {
+                    __m512 b0 = load_b_avx512(panel + (p + u) * NR);
+                    __m512 b1 = load_b_avx512(panel + (p + u) * NR + 16);
+                    #pragma GCC unroll 8
+                    for (size_t i = 0; i < M; i++) {
+                        __m512 a_i = _mm512_set1_ps(a[i * lda + p + u]);
+                        acc0[i][u] = _mm512_fmadd_ps(a_i, b0, acc0[i][u]);
+                        acc1[i][u] = _mm512_fmadd_ps(a_i, b1, acc1[i][u]);
+                    }
+                }
+            }
+            for (; p < kc; p++) {
+                __m512 b0 = load_b_avx512(panel + p * NR);
+                __m512 b1 = load_b_avx512(panel + p * NR + 16);
+                #pragma GCC unroll 8
+                for (size_t i = 0; i < M; i++) {
+                    __m512 a_i = _mm512_set1_ps(a[i * lda + p]);
+                    acc0[i][0] = _mm512_fmadd_ps(a_i, b0, acc0[i][0]);
+                    acc1[i][0] = _mm512_fmadd_ps(a_i, b1, acc1[i][0]);
+                }
+            }
+
+            #pragma GCC unroll 8
+            for (size_t i = 0; i < M; i++) {
+                for (size_t u = 1; u < U; u++) {
+                    acc0[i][0] = _mm512_add_ps(acc0[i][0], acc0[i][u]);
+                    acc1[i][0] = _mm512_add_ps(acc1[i][0], acc1[i][u]);
+                }
+                _mm512_store_ps(acc + i * NR, acc0[i][0]);
+                _mm512_store_ps(acc + i * NR + 16, acc1[i][0]);
+            }
+        }
+
+        BLASS_TARGET_AVX2 inline float hsum(__m256 v) {
+            __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            sum4 = _mm_hadd_ps(sum4, sum4);
+            sum4 = _mm_hadd_ps(sum4, sum4);
+            return _mm_cvtss_f32(sum4);
+        }
+
+        template <size_t M>
+        BLASS_TARGET_AVX2 inline void gemv_rows_kernel_avx2(size_t k, const float* __restrict__ a, size_t lda,
+                                                            const float* __restrict__ b_row, float* __restrict__ out, size_t ldc) {
+            constexpr size_t U = M == 1 ? 4 : 2;
+            constexpr size_t STEP = 8 * U;
+            __m256 acc[M][U];
+
+            #pragma GCC unroll 8
+            for (size_t i = 0; i < M; i++)
+                for (size_t u = 0; u < U; u++)
+                    acc[i][u] = _mm256_setzero_ps();
+
+            size_t p = 0;
+            for (; p + STEP <= k; p += STEP) {
+                prefetch_stream((const char*)(b_row + p) + GEMV_PREFETCH_BYTES);
+                __m256 b_vec[U];
+                #pragma GCC unroll 8
+                for (size_t u = 0; u < U; u++)
+                    b_vec[u] = _mm256_loadu_ps(b_row + p + 8 * u);
+
+                #pragma GCC unroll 8
+                for (size_t i = 0; i < M; i++)
+                    for (size_t u = 0; u < U; u++)
+                        acc[i][u] = _mm256_fmadd_ps(_mm256_loadu_ps(a + i * lda + p + 8 * u), b_vec[u], acc[i][u]);
+            }
+
+            #pragma GCC unroll 8
+            for (size_t i = 0; i < M; i++) {
+                for (size_t u = 1; u < U; u++)
+                    acc[i][0] = _mm256_add_ps(acc[i][0], acc[i][u]);
+                float sum = hsum(acc[i][0]);
+
+                const float* a_row = a + i * lda;
+                for (size_t q = p; q < k; q++)
+                    sum += a_row[q] * b_row[q];
+                out[i * ldc] = sum;
+            }
+        }
+
+        template <size_t M, typename S>
+        BLASS_TARGET_AVX2 inline void gemv_panel_kernel_avx2(size_t kc, const float* __restrict__ a, size_t lda,
+                                                             const S* __restrict__ panel, float* __restrict__ acc) {
+            constexpr size_t NR = gemm_params<float, isa::avx2>::NR;
+            constexpr size_t U = M == 1 ? 2 : 1;
+            __m256 acc0[M][U], acc1[M][U];
+
+            #pragma GCC unroll 8
+            for (size_t i = 0; i < M; i++) {
+                acc0[i][0] = _mm256_load_ps(acc + i * NR);
+                acc1[i][0] = _mm256_load_ps(acc + i * NR + 8);
+                #pragma GCC unroll 8
+                for (size_t u = 1; u < U; u++) {
+                    acc0[i][u] = _mm256_setzero_ps();
+                    acc1[i][u] = _mm256_setzero_ps();
+                }
+            }
+
+            size_t p = 0;
+            for (; p + U <= kc; p += U) {
+                prefetch_stream(panel + p * NR + GEMV_PREFETCH_BYTES / sizeof(S));
+                #pragma GCC unroll 8
+                for (size_t u = 0; u < U; u++) {
+                    __m256 b0 = load_b_avx2(panel + (p + u) * NR);
+                    __m256 b1 = load_b_avx2(panel + (p + u) * NR + 8);
+                    #pragma GCC unroll 8
+                    for (size_t i = 0; i < M; i++) {
+                        __m256 a_i = _mm256_set1_ps(a[i * lda + p + u]);
+                        acc0[i][u] = _mm256_fmadd_ps(a_i, b0, acc0[i][u]);
+                        acc1[i][u] = _mm256_fmadd_ps(a_i, b1, acc1[i][u]);
+                    }
+                }
+            }
+            for (; p < kc; p++) {
+                __m256 b0 = load_b_avx2(panel + p * NR);
+                __m256 b1 = load_b_avx2(panel + p * NR + 8);
+                #pragma GCC unroll 8
+                for (size_t i = 0; i < M; i++) {
+                    __m256 a_i = _mm256_set1_ps(a[i * lda + p]);
+                    acc0[i][0] = _mm256_fmadd_ps(a_i, b0, acc0[i][0]);
+                    acc1[i][0] = _mm256_fmadd_ps(a_i, b1, acc1[i][0]);
+                }
+            }
+
+            #pragma GCC unroll 8
+            for (size_t i = 0; i < M; i++) {
+                for (size_t u = 1; u < U; u++) {
+                    acc0[i][0] = _mm256_add_ps(acc0[i][0], acc0[i][u]);
+                    acc1[i][0] = _mm256_add_ps(acc1[i][0], acc1[i][u]);
+                }
+                _mm256_store_ps(acc + i * NR, acc0[i][0]);
+                _mm256_store_ps(acc + i * NR + 8, acc1[i][0]);
+            }
+        }
+
+        BLASS_TARGET_SSE42 inline float hsum(__m128 v) {
+            v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+            v = _mm_add_ss(v, _mm_movehdup_ps(v));
+            return _mm_cvtss_f32(v);
+        }
+
+        template <size_t M>
+        BLASS_TARGET_SSE42 inline void gemv_rows_kernel_sse(size_t k, const float* __restrict__ a, size_t lda,
+                                                            const float* __restrict__ b_row, float* __restrict__ out, size_t ldc) {
+            constexpr size_t U = M == 1 ? 4 : 2;
+            constexpr size_t STEP = 4 * U;
+            __m128 acc[M][U];
+
+            #pragma GCC unroll 8
+            for (size_t i = 0; i < M; i++)
+                for (size_t u = 0; u < U; u++)
+                    acc[i][u] = _mm_setzero_ps();
+
+            size_t p = 0;
+            for (; p + STEP <= k; p += STEP) {
+                prefetch_stream((const char*)(b_row + p) + GEMV_PREFETCH_BYTES);
+                __m128 b_vec[U];
+                #pragma GCC unroll 8
+                for (size_t u = 0; u < U; u++)
+                    b_vec[u] = _mm_loadu_ps(b_row + p + 4 * u);
+
+                #pragma GCC unroll 8
+                for (size_t i = 0; i < M; i++)
+                    for (size_t u = 0; u < U; u++)
+                        acc[i][u] = _mm_add_ps(acc[i][u], _mm_mul_ps(_mm_loadu_ps(a + i * lda + p + 4 * u), b_vec[u]));
+            }
+
+            #pragma GCC unroll 8
+            for (size_t i = 0; i < M; i++) {
+                for (size_t u = 1; u < U; u++)
+                    acc[i][0] = _mm_add_ps(acc[i][0], acc[i][u]);
+                float sum = hsum(acc[i][0]);
+
+                const float* a_row = a + i * lda;
+                for (size_t q = p; q < k; q++)
+                    sum += a_row[q] * b_row[q];
+                out[i * ldc] = sum;
+            }
+        }
+
+        template <size_t M, typename S>
+        BLASS_TARGET_SSE42 inline void gemv_panel_kernel_sse(size_t kc, const float* __restrict__ a, size_t lda,
+                                                             const S* __restrict__ panel, float* __restrict__ acc) {
+            constexpr size_t NR = gemm_params<float, isa::sse42>::NR;
+            constexpr size_t U = M == 1 ? 4 : 2;
+            __m128 acc0[M][U], acc1[M][U];
+
+            #pragma GCC unroll 8
+            for (size_t i = 0; i < M; i++) {
+                acc0[i][0] = _mm_load_ps(acc + i * NR);
+                acc1[i][0] = _mm_load_ps(acc + i * NR + 4);
+                #pragma GCC unroll 8
+                for (size_t u = 1; u < U; u++) {
+                    acc0[i][u] = _mm_setzero_ps();
+                    acc1[i][u] = _mm_setzero_ps();
+                }
+            }
+
+            size_t p = 0;
+            for (; p + U <= kc; p += U) {
+                prefetch_stream(panel + p * NR + GEMV_PREFETCH_BYTES / sizeof(S));
+                #pragma GCC unroll 8
+                for (size_t u = 0; u < U; u++) {
+                    __m128 b0 = load_b_sse(panel + (p + u) * NR);
+                    __m128 b1 = load_b_sse(panel + (p + u) * NR + 4);
+                    #pragma GCC unroll 8
+                    for (size_t i = 0; i < M; i++) {
+                        __m128 a_i = _mm_set1_ps(a[i * lda + p + u]);
+                        acc0[i][u] = _mm_add_ps(acc0[i][u], _mm_mul_ps(a_i, b0));
+                        acc1[i][u] = _mm_add_ps(acc1[i][u], _mm_mul_ps(a_i, b1));
+                    }
+                }
+            }
+            for (; p < kc; p++) {
+                __m128 b0 = load_b_sse(panel + p * NR);
+                __m128 b1 = load_b_sse(panel + p * NR + 4);
+                #pragma GCC unroll 8
+                for (size_t i = 0; i < M; i++) {
+                    __m128 a_i = _mm_set1_ps(a[i * lda + p]);
+                    acc0[i][0] = _mm_add_ps(acc0[i][0], _mm_mul_ps(a_i, b0));
+                    acc1[i][0] = _mm_add_ps(acc1[i][0], _mm_mul_ps(a_i, b1));
+                }
+            }
+
+            #pragma GCC unroll 8
+            for (size_t i = 0; i < M; i++) {
+                for (size_t u = 1; u < U; u++) {
+                    acc0[i][0] = _mm_add_ps(acc0[i][0], acc0[i][u]);
+                    acc1[i][0] = _mm_add_ps(acc1[i][0], acc1[i][u]);
+                }
+                _mm_store_ps(acc + i * NR, acc0[i][0]);
+                _mm_store_ps(acc + i * NR + 4, acc1[i][0]);
+            }
+        }
+#endif
+
+        /**
+        * c[i, j] = dot(a[i, :], b[j, :]) for the M rows of A, with B given row-wise (the
+        * [N, K] weight layout). Every row of B is streamed from memory exactly once and reused
+        * for all M rows of A while it is in registers.
+        */
+        template <isa I, typename T, size_t M>
+        inline void gemv_rows_kernel(size_t k, const T* __restrict__ a, size_t lda,
+                                     const T* __restrict__ b_row, T* __restrict__ out, size_t ldc) {
+#if defined(BLASS_X86)
+            if constexpr (std::is_same_v<T, float> && I == isa::avx512) {
+                gemv_rows_kernel_avx512<M>(k, a, lda, b_row, out, ldc);
+                return;
+            }
+            else if constexpr (std::is_same_v<T, float> && I == isa::avx2) {
+                gemv_rows_kernel_avx2<M>(k, a, lda, b_row, out, ldc);
+                return;
+            }
+            else if constexpr (std::is_same_v<T, float> && I == isa::sse42) {
+                gemv_rows_kernel_sse<M>(k, a, lda, b_row, out, ldc);
+                return;
+            }
+#endif
+            for (size_t i = 0; i < M; i++) {
+                const T* __restrict__ a_row = a + i * lda;
+                T sum = 0;
+
+                #pragma omp simd reduction(+:sum)
+                for (size_t p = 0; p < k; p++)
+                    sum += a_row[p] * b_row[p];
+
+                out[i * ldc] = sum;
+            }
+        }
+
+        template <isa I, typename T, size_t M>
+        void gemv_rows_range(size_t begin, size_t end, size_t k, const T* a, size_t lda,
+                             const T* b, size_t ldb, T* c, size_t ldc) {
+            for (size_t j = begin; j < end; j++)
+                gemv_rows_kernel<I, T, M>(k, a, lda, b + j * ldb, c + j, ldc);
+        }
+
+        /**
+        * C[m x n] = A[m x k] * B^T for m <= GEMV_MAX_ROWS, where row j of B (k contiguous
+        * elements) starts at b + j * ldb. Output columns are split evenly between threads.
+        */
+        template <isa I, typename T>
+        void gemv_rows(size_t m, size_t n, size_t k, const T* a, size_t lda,
+                       const T* b, size_t ldb, T* c, size_t ldc, bool use_omp = true) {
+            bool parallel = use_omp && n * k >= GEMV_OMP_THRESHOLD;
+
+            #pragma omp parallel if (parallel)
+            {
+                size_t begin, end;
+                thread_range(n, 16, begin, end);
+
+                for (size_t i = 0; i < m; i += GEMV_MAX_ROWS) {
+                    const T* a_rows = a + i * lda;
+                    T* c_rows = c + i * ldc;
+                    switch (std::min(m - i, GEMV_MAX_ROWS)) {
+                        case 1: gemv_rows_range<I, T, 1>(begin, end, k, a_rows, lda, b, ldb, c_rows, ldc); break;
+                        case 2: gemv_rows_range<I, T, 2>(begin, end, k, a_rows, lda, b, ldb, c_rows, ldc); break;
+                        case 3: gemv_rows_range<I, T, 3>(begin, end, k, a_rows, lda, b, ldb, c_rows, ldc); break;
+                        default: gemv_rows_range<I, T, 4>(begin, end, k, a_rows, lda, b, ldb, c_rows, ldc); break;
+                    }
+                }
+            }
+        }
+
+        /**
+        * gemv_rows with the kernels of the active variant.
+        */
+        template <typename T>
+        void gemv_rows(size_t m, size_t n, size_t k, const T* a, size_t lda,
+                       const T* b, size_t ldb, T* c, size_t ldc, bool use_omp = true) {
+            dispatch_isa<T>(active_isa(), [&](auto I) {
+                gemv_rows<I>(m, n, k, a, lda, b, ldb, c, ldc, use_omp);
+            });
+        }
+
+        /**
+        * C[m x n] = A[m x k] * B for m <= GEMV_MAX_ROWS, where B is row-major with leading
+        * dimension ldb. Each thread owns a contiguous range of columns and walks down B once,
+        * accumulating a[i, p] * B[p, :] into its slice of C.
+        */
+        template <typename T>
+        void gemv_cols(size_t m, size_t n, size_t k, const T* a, size_t rsa, size_t csa,
+                       const T* b, size_t ldb, T* c, size_t ldc, bool use_omp = true) {
+            constexpr size_t CHUNK = 256;
+            bool parallel = use_omp && n * k >= GEMV_OMP_THRESHOLD;
+
+            #pragma omp parallel if (parallel)
+            {
+                size_t begin, end;
+                thread_range(n, 16, begin, end);
+
+                for (size_t j0 = begin; j0 < end; j0 += CHUNK) {
+                    size_t len = std::min(CHUNK, end - j0);
+
+                    for (size_t i = 0; i < m; i++) {
+                        T* __restrict__ c_row = c + i * ldc + j0;
+                        std::fill_n(c_row, len, T(0));
+                    }
+
+                    for (size_t p = 0; p < k; p++) {
+                        const T* __restrict__ b_row = b + p * ldb + j0;
+                        prefetch_stream(b_row + ldb);
+
+                        for (size_t i = 0; i < m; i++) {
+                            T a_val = a[i * rsa + p * csa];
+                            T* __restrict__ c_row = c + i * ldc + j0;
+
+                            #pragma omp simd
+                            for (size_t j = 0; j < len; j++)
+                                c_row[j] += a_val * b_row[j];
+                        }
+                    }
+                }
+            }
+        }
+
+        /**
+        * acc[M][NR] += A[M x kc] * panel for one packed NR-wide, kc-deep micro-panel of B in
+        * the layout of variant I, stored as S (T itself, or a 16-bit type widened on load).
+        */
+        template <isa I, typename T, size_t M, typename S = T>
+        inline void gemv_panel_kernel(size_t kc, const T* __restrict__ a, size_t lda,
+                                      const S* __restrict__ panel, T* __restrict__ acc) {
+#if defined(BLASS_X86)
+            if constexpr (std::is_same_v<T, float> && I == isa::avx512) {
+                gemv_panel_kernel_avx512<M>(kc, a, lda, panel, acc);
+                return;
+            }
+            else if constexpr (std::is_same_v<T, float> && I == isa::avx2) {
+                gemv_panel_kernel_avx2<M>(kc, a, lda, panel, acc);
+                return;
+            }
+            else if constexpr (std::is_same_v<T, float> && I == isa::sse42) {
+                gemv_panel_kernel_sse<M>(kc, a, lda, panel, acc);
+                return;
+            }
+#endif
+            constexpr size_t NR = gemm_params<T, I>::NR;
+            for (size_t p = 0; p < kc; p++) {
+                for (size_t i = 0; i < M; i++) {
+                    T a_val = a[i * lda + p];
+
+                    #pragma omp simd
+                    for (size_t j = 0; j < NR; j++)
+                        acc[i * NR + j] += a_val * convert_to<T>(panel[p * NR + j]);
+                }
+            }
+        }
+
+        template <isa I, typename T, size_t M, typename S>
+        void gemv_prepacked_range(size_t begin, size_t end, size_t n, size_t k, const T* a, size_t lda,
+                                  const S* packed_b, T* c, size_t ldc) {
+            using P = gemm_params<T, I>;
+            constexpr size_t NR = P::NR;
+
+            for (size_t jr = begin; jr < end; jr++) {
+                size_t nr = std::min(NR, n - jr * NR);
+                alignas(64) T acc[M * NR] = {};
+
+                for (size_t pc = 0; pc < k; pc += P::KC) {
+                    size_t kc = std::min(P::KC, k - pc);
+                    gemv_panel_kernel<I, T, M>(kc, a + pc, lda, packed_b + packed_b_offset<I, T>(k, n, pc, jr * NR), acc);
+                }
+
+                for (size_t i = 0; i < M; i++)
+                    for (size_t j = 0; j < nr; j++)
+                        c[i * ldc + jr * NR + j] = acc[i * NR + j];
+            }
+        }
+
+        /**
+        * C[m x n] = A[m x k] * B for m <= GEMV_MAX_ROWS and a B packed by pack_b<I>. Each
+        * thread takes a contiguous range of NR-wide column panels and streams them through
+        * every KC slice, so the packed weight is read exactly once (at 16 bits per element
+        * for a half-precision storage type S).
+        */
+        template <isa I, typename T, typename S = T>
+        void gemv_prepacked(size_t m, size_t n, size_t k, const T* a, size_t lda,
+                            const S* packed_b, T* c, size_t ldc, bool use_omp = true) {
+            constexpr size_t NR = gemm_params<T, I>::NR;
+            size_t n_panels = (n + NR - 1) / NR;
+            bool parallel = use_omp && n * k >= GEMV_OMP_THRESHOLD;
+
+            #pragma omp parallel if (parallel)
+            {
+                size_t begin, end;
+                thread_range(n_panels, 1, begin, end);
+
+                for (size_t i = 0; i < m; i += GEMV_MAX_ROWS) {
+                    const T* a_rows = a + i * lda;
+                    T* c_rows = c + i * ldc;
+                    switch (std::min(m - i, GEMV_MAX_ROWS)) {
+                        case 1: gemv_prepacked_range<I, T, 1>(begin, end, n, k, a_rows, lda, packed_b, c_rows, ldc); break;
+                        case 2: gemv_prepacked_range<I, T, 2>(begin, end, n, k, a_rows, lda, packed_b, c_rows, ldc); break;
+                        case 3: gemv_prepacked_range<I, T, 3>(begin, end, n, k, a_rows, lda, packed_b, c_rows, ldc); break;
+                        default: gemv_prepacked_range<I, T, 4>(begin, end, n, k, a_rows, lda, packed_b, c_rows, ldc); break;
+                    }
+                }
+            }
+        }
+    }
+}
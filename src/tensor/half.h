@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "cpu.h"
+
+namespace blass {
+    namespace kernel {
+        /**
+        * IEEE half <-> float conversion on raw bit patterns, for data stored as uint16_t
+        * (GGUF block scales, F16 tensors). Uses F16C when the target has it.
+        */
+        inline float fp16_to_fp32(uint16_t h) {
+#if defined(__F16C__)
+            return _cvtsh_ss(h);
+#else
+            uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+            uint32_t exp = (h >> 10) & 0x1f;
+            uint32_t mant = h & 0x3ff;
+            uint32_t bits;
+
+            if (exp == 0) {
+                if (mant == 0) {
+                    bits = sign;
+                }
+                else {
+                    // subnormal half: renormalise into a float
+                    exp = 127 - 15 + 1;
+                    while (!(mant & 0x400)) {
+                        mant <<= 1;
+                        exp--;
+                    }
+                    bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+                }
+            }
+            else if (exp == 31) {
+                bits = sign | 0x7f800000 | (mant << 13);
+            }
+            else {
+                bits = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+            }
+
+            float f;
+            std::memcpy(&f, &bits, sizeof(f));
+            return f;
+#endif
+        }
+
+        inline uint16_t fp32_to_fp16(float f) {
+#if defined(__F16C__)
+            return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+            uint32_t x;
+            std::memcpy(&x, &f, sizeof(x));
+            uint32_t sign = (x >> 16) & 0x8000;
+            int32_t exp = (int32_t)((x >> 23) & 0xff) - 127 + 15;
+            uint32_t mant = x & 0x7fffff;
+
+            if (((x >> 23) & 0xff) == 0xff)
+                return sign | 0x7c00 | (mant ? 0x200 : 0);
+            if (exp >= 31)
+                return sign | 0x7c00;
+
+            if (exp <= 0) {
+                if (exp < -10)
+                    return sign;
+                mant |= 0x800000;
+                uint32_t shift = 14 - exp;
+                uint32_t half = mant >> shift;
+                uint32_t rem = mant & ((1u << shift) - 1);
+                uint32_t mid = 1u << (shift - 1);
+                if (rem > mid || (rem == mid && (half & 1)))
+                    half++;
+                return sign | half;
+            }
+
+            // round to nearest even; a carry out of the mantissa correctly bumps the exponent
+            uint32_t half = ((uint32_t)exp << 10) | (mant >> 13);
+            uint32_t rem = mant & 0x1fff;
+            if (rem > 0x1000 || (rem == 0x1000 && (half & 1)))
+                half++;
+            return sign | half;
+#endif
+        }
+
+#if defined(BLASS_X86)
+        // for kernels of the AVX2 and AVX-512 variants, which can count on F16C
+        BLASS_TARGET_AVX2 inline float fp16_to_fp32_f16c(uint16_t h) {
+            return _cvtsh_ss(h);
+        }
+#endif
+
+        /**
+        * bfloat16 is the top half of a float, so widening is a shift; narrowing rounds to
+        * nearest even and keeps NaNs quiet.
+        */
+        inline float bf16_to_fp32(uint16_t h) {
+            uint32_t bits = (uint32_t)h << 16;
+            float f;
+            std::memcpy(&f, &bits, sizeof(f));
+            return f;
+        }
+
+        inline uint16_t fp32_to_bf16(float f) {
+            uint32_t x;
+            std::memcpy(&x, &f, sizeof(x));
+            if ((x & 0x7fffffff) > 0x7f800000)
+                return (x >> 16) | 0x40;
+            return (x + 0x7fff + ((x >> 16) & 1)) >> 16;
+        }
+
+#if defined(BLASS_X86)
+        BLASS_TARGET_AVX2 inline void fp16_to_fp32_row_f16c(const uint16_t* src, float* dst, size_t n) {
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+                _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + i))));
+            for (; i < n; i++)
+                dst[i] = _cvtsh_ss(src[i]);
+        }
+#endif
+
+        /**
+        * Widens n halves into dst, 8 per instruction with F16C on the AVX2 and AVX-512
+        * variants, e.g. F16 tensors of a model file at load.
+        */
+        inline void fp16_to_fp32_row(const uint16_t* src, float* dst, size_t n) {
+#if defined(BLASS_X86)
+            if (active_isa() >= isa::avx2) {
+                fp16_to_fp32_row_f16c(src, dst, n);
+                return;
+            }
+#endif
+            for (size_t i = 0; i < n; i++)
+                dst[i] = fp16_to_fp32(src[i]);
+        }
+
+        // plain shifts, which the compiler vectorizes
+        inline void bf16_to_fp32_row(const uint16_t* __restrict__ src, float* __restrict__ dst, size_t n) {
+            for (size_t i = 0; i < n; i++)
+                dst[i] = bf16_to_fp32(src[i]);
+        }
+
+        /**
+        * 16-bit storage types for packed weights. Kernels widen them to float in registers,
+        * so activations and accumulators stay in full precision.
+        */
+        struct f16 {
+            uint16_t bits;
+        };
+
+        struct bf16 {
+            uint16_t bits;
+        };
+
+        template <typename S>
+        constexpr bool is_half_storage_v = std::is_same_v<S, f16> || std::is_same_v<S, bf16>;
+
+        /**
+        * Converts between compute types and storage types; the identity when both agree.
+        */
+        template <typename To, typename From>
+        inline To convert_to(From x) {
+            if constexpr (std::is_same_v<To, From>)
+                return x;
+            else if constexpr (std::is_same_v<From, f16>)
+                return To(fp16_to_fp32(x.bits));
+            else if constexpr (std::is_same_v<From, bf16>)
+                return To(bf16_to_fp32(x.bits));
+            else if constexpr (std::is_same_v<To, f16>)
+                return f16{fp32_to_fp16(float(x))};
+            else if constexpr (std::is_same_v<To, bf16>)
+                return bf16{fp32_to_bf16(float(x))};
+            else
+                return To(x);
+        }
+    }
+}
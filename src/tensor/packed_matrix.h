@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+#include "blas.h"
+#include "gemm.h"
+#include "gemv.h"
+
+namespace blass {
+    /**
+    * Right-hand matrix of a matmul (K x N) stored once in the panel layout of the packed
+    * GEMM. Meant for weights: packing happens at load, and every matmul against it skips
+    * both the transpose/contiguous copy and the per-call packing of B.
+    * The storage type S may be kernel::f16 or kernel::bf16 for half-precision weights, which
+    * the kernels widen to T in registers; activations and results stay T.
+    * The panel layout depends on the kernel variant, so the matrix remembers the one that was
+    * active when it was packed and always multiplies with it.
+    */
+    template <typename T, typename S = T>
+    class PackedMatrix {
+    private:
+        std::shared_ptr<S[]> data;
+        size_t k = 0;
+        size_t n = 0;
+        kernel::isa target = kernel::isa::generic;
+
+        static PackedMatrix<T, S> allocate(size_t k, size_t n) {
+            PackedMatrix<T, S> packed;
+            packed.k = k;
+            packed.n = n;
+            packed.target = kernel::active_isa();
+
+            size_t size = kernel::dispatch_isa<T>(packed.target, [&](auto I) { return kernel::packed_b_size<I, T>(k, n); });
+            size_t bytes = (size * sizeof(S) + 63) / 64 * 64;
+            S* raw = static_cast<S*>(std::aligned_alloc(64, std::max<size_t>(bytes, 64)));
+            if (!raw) {
+                throw std::bad_alloc();
+            }
+            packed.data = std::shared_ptr<S[]>(raw, [](S* ptr) { std::free(ptr); });
+            return packed;
+        }
+
+    public:
+        PackedMatrix() {}
+
+        /**
+        * Packs a 2D tensor. With b_transposed the tensor is laid out as [N, K]
+        * (the GGUF / torch Linear convention), otherwise as [K, N].
+        */
+        static PackedMatrix<T, S> from_tensor(const Tensor<T>& b, bool b_transposed = false) {
+            if (b.get_shape().size() != 2) {
+                throw std::invalid_argument("PackedMatrix can only be built from a 2D tensor, got shape " + utils::to_string_vec(b.get_shape()));
+            }
+
+            PackedMatrix<T, S> packed = allocate(b.get_shape(b_transposed), b.get_shape(!b_transposed));
+            size_t rsb = b.get_stride(b_transposed ? 1 : 0);
+            size_t csb = b.get_stride(b_transposed ? 0 : 1);
+            kernel::dispatch_isa<T>(packed.target, [&](auto I) {
+                kernel::pack_b<I, T>(packed.k, packed.n, b.get_data(), rsb, csb, packed.data.get());
+            });
+
+            return packed;
+        }
+
+        /**
+        * Packs n rows of k contiguous elements already in the storage type, the [N, K] layout
+        * of a GGUF weight, without going through a T tensor.
+        */
+        static PackedMatrix<T, S> from_rows(const S* rows, size_t n, size_t k) {
+            PackedMatrix<T, S> packed = allocate(k, n);
+            kernel::dispatch_isa<T>(packed.target, [&](auto I) {
+                kernel::pack_b<I, T>(k, n, rows, 1, k, packed.data.get());
+            });
+            return packed;
+        }
+
+        /**
+        * Uses packed data already in target's panel layout in place, e.g. a matrix mapped
+        * from a weight cache file; owner keeps it alive. data must be 64-byte aligned.
+        */
+        static PackedMatrix<T, S> borrow(kernel::isa target, size_t k, size_t n, const S* data, std::shared_ptr<const void> owner) {
+            if (target > kernel::detect_isa()) {
+                throw std::invalid_argument(std::string("Cannot use a matrix packed for ") + kernel::isa_name(target) +
+                                            " on a CPU whose best kernels are " + kernel::isa_name(kernel::detect_isa()));
+            }
+            if ((uintptr_t)data % 64 != 0)
+                throw std::invalid_argument("Packed matrix data must be 64-byte aligned");
+
+            PackedMatrix<T, S> packed;
+            packed.k = k;
+            packed.n = n;
+            packed.target = target;
+            packed.data = std::shared_ptr<S[]>(std::const_pointer_cast<void>(owner), const_cast<S*>(data));
+            return packed;
+        }
+
+        /**
+        * Unpacks column j (row j of the [N, K] weight) into out[0..K), e.g. for embedding lookups.
+        */
+        void unpack_column(size_t j, T* out) const {
+            kernel::dispatch_isa<T>(target, [&](auto I) {
+                using P = kernel::gemm_params<T, I>;
+                for (size_t pc = 0; pc < k; pc += P::KC) {
+                    size_t kc = std::min(P::KC, k - pc);
+                    const S* panel = data.get() + kernel::packed_b_offset<I, T>(k, n, pc, j / P::NR * P::NR);
+                    for (size_t p = 0; p < kc; p++)
+                        out[pc + p] = kernel::convert_to<T>(panel[p * P::NR + j % P::NR]);
+                }
+            });
+        }
+
+        size_t rows() const {
+            return k;
+        }
+
+        size_t cols() const {
+            return n;
+        }
+
+        bool empty() const {
+            return !data;
+        }
+
+        // elements of S in the packed layout
+        size_t size() const {
+            return kernel::dispatch_isa<T>(target, [&](auto I) { return kernel::packed_b_size<I, T>(k, n); });
+        }
+
+        /**
+        * Kernel variant whose panel layout the data is in.
+        */
+        kernel::isa get_isa() const {
+            return target;
+        }
+
+        const S* get_data() const {
+            return data.get();
+        }
+    };
+
+    /**
+    * c[..., N] = alpha * a[..., K] x b[K, N] + beta * c, in place. All leading dimensions of a
+    * are folded into the row dimension, so a batch of sequences is a single GEMM against the
+    * packed weight; c must be contiguous. beta = 1 turns the product into a fused residual add,
+    * epi fuses bias, activation and elementwise products into the output tiles.
+    */
+    template <typename T, typename S>
+    void gemm(const Tensor<T>& a_raw, const PackedMatrix<T, S>& b, Tensor<T>& c,
+              T alpha = T(1), T beta = T(0), Epilogue<T> epi = {}) {
+        if (a_raw.get_shape().empty() || a_raw.get_shape().back() != b.rows()) {
+            throw std::invalid_argument("Inner dimensions must match for matmul, multiplying shape " +
+                                        utils::to_string_vec(a_raw.get_shape()) + " by packed [" +
+                                        std::to_string(b.rows()) + ", " + std::to_string(b.cols()) + "]");
+        }
+
+        std::vector<size_t> c_shape = a_raw.get_shape();
+        c_shape.back() = b.cols();
+        if (c.get_shape() != c_shape || !c.is_contiguous()) {
+            throw std::invalid_argument("Output of a packed gemm must be a contiguous tensor of shape " +
+                                        utils::to_string_vec(c_shape) + ", got " + utils::to_string_vec(c.get_shape()));
+        }
+
+        Tensor<T> a = a_raw.contiguous();
+        size_t k = b.rows();
+        size_t n = b.cols();
+        size_t m = n == 0 ? 0 : c.size() / n;
+
+        if (m == 0 || n == 0)
+            return;
+
+        kernel::epilogue<T> raw = epi.bind(c_shape);
+
+        kernel::dispatch_isa<T>(b.get_isa(), [&](auto I) {
+            if (m <= kernel::GEMV_MAX_ROWS) {
+                kernel::scaled_output(m, n, alpha, beta, c.get_data(), n, [&](T* out, size_t ld_out) {
+                    kernel::gemv_prepacked<I>(m, n, k, a.get_data(), k, b.get_data(), out, ld_out);
+                });
+                kernel::apply_epilogue(m, n, c.get_data(), n, &raw);
+            }
+            else {
+                if (beta != T(0))
+                    kernel::scale_c(m, n, beta, c.get_data(), n);
+                kernel::gemm_prepacked<I>(m, n, k, a.get_data(), k, 1, b.get_data(), c.get_data(), n, true, alpha, beta != T(0), &raw);
+            }
+        });
+    }
+
+    /**
+    * a[..., K] x b[K, N] -> [..., N] into a freshly allocated result, with an optional
+    * fused epilogue (e.g. {.bias = b_q} or {.act = kernel::activation::silu}).
+    */
+    template <typename T, typename S>
+    Tensor<T> matmul(const Tensor<T>& a, const PackedMatrix<T, S>& b, Epilogue<T> epi = {}) {
+        std::vector<size_t> result_shape = a.get_shape();
+        if (!result_shape.empty())
+            result_shape.back() = b.cols();
+
+        Tensor<T> result = Tensor<T>::from_shape(result_shape);
+        gemm(a, b, result, T(1), T(0), std::move(epi));
+        return result;
+    }
+}
@@ -0,0 +1,554 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "gemm.h"
+#include "gemv.h"
+#include "half.h"
+
+namespace blass {
+    namespace kernel {
+        /**
+        * Block-quantized weight formats, bit-compatible with the GGML/GGUF blocks of the same
+        * name. Every row of a quantized matrix is a run of whole blocks.
+        */
+        enum class quant_type {
+            q8_0,
+            q4_0,
+            q4_K
+        };
+
+        constexpr size_t QK8_0 = 32;
+        constexpr size_t QK4_0 = 32;
+        constexpr size_t QK_K = 256;
+
+        // x = d * q
+        struct block_q8_0 {
+            uint16_t d;
+            int8_t qs[QK8_0];
+        };
+
+        // x = d * (q - 8), element i in the low nibble of qs[i], element i + 16 in the high one
+        struct block_q4_0 {
+            uint16_t d;
+            uint8_t qs[QK4_0 / 2];
+        };
+
+        // 8 sub-blocks of 32 with 6-bit scales and mins: x = d * sc[j] * q - dmin * m[j]
+        struct block_q4_K {
+            uint16_t d;
+            uint16_t dmin;
+            uint8_t scales[12];
+            uint8_t qs[QK_K / 2];
+        };
+
+        static_assert(sizeof(block_q8_0) == 34, "block_q8_0 must match the GGUF layout");
+        static_assert(sizeof(block_q4_0) == 18, "block_q4_0 must match the GGUF layout");
+        static_assert(sizeof(block_q4_K) == 144, "block_q4_K must match the GGUF layout");
+
+        /**
+        * Activations quantized once per matmul call so the dot products can run on integers.
+        * sum caches the sum of qs, which the Q4_K minimums need.
+        */
+        struct block_q8_act {
+            float d;
+            int32_t sum;
+            int8_t qs[32];
+        };
+
+        inline size_t quant_block_size(quant_type type) {
+            return type == quant_type::q4_K ? QK_K : 32;
+        }
+
+        inline size_t quant_block_bytes(quant_type type) {
+            switch (type) {
+                case quant_type::q8_0: return sizeof(block_q8_0);
+                case quant_type::q4_0: return sizeof(block_q4_0);
+                default: return sizeof(block_q4_K);
+            }
+        }
+
+        inline size_t quant_row_bytes(quant_type type, size_t k) {
+            return k / quant_block_size(type) * quant_block_bytes(type);
+        }
+
+        inline void q4_K_scale_min(size_t j, const uint8_t* scales, uint8_t& sc, uint8_t& m) {
+            if (j < 4) {
+                sc = scales[j] & 63;
+                m = scales[j + 4] & 63;
+            }
+            else {
+                sc = (scales[j + 4] & 0xF) | ((scales[j - 4] >> 6) << 4);
+                m = (scales[j + 4] >> 4) | ((scales[j] >> 6) << 4);
+            }
+        }
+
+        /**
+        * Dequantizes elements [first, first + count) of one quantized row into out.
+        * Both first and count must be multiples of the block size.
+        */
+        inline void dequantize_row(quant_type type, const void* row, size_t first, size_t count, float* __restrict__ out) {
+            if (type == quant_type::q8_0) {
+                const block_q8_0* blocks = (const block_q8_0*)row + first / QK8_0;
+                for (size_t b = 0; b < count / QK8_0; b++) {
+                    float d = fp16_to_fp32(blocks[b].d);
+                    for (size_t l = 0; l < QK8_0; l++)
+                        out[b * QK8_0 + l] = d * blocks[b].qs[l];
+                }
+            }
+            else if (type == quant_type::q4_0) {
+                const block_q4_0* blocks = (const block_q4_0*)row + first / QK4_0;
+                for (size_t b = 0; b < count / QK4_0; b++) {
+                    float d = fp16_to_fp32(blocks[b].d);
+                    for (size_t l = 0; l < QK4_0 / 2; l++) {
+                        out[b * QK4_0 + l] = d * ((int)(blocks[b].qs[l] & 0xF) - 8);
+                        out[b * QK4_0 + l + QK4_0 / 2] = d * ((int)(blocks[b].qs[l] >> 4) - 8);
+                    }
+                }
+            }
+            else {
+                const block_q4_K* blocks = (const block_q4_K*)row + first / QK_K;
+                for (size_t b = 0; b < count / QK_K; b++) {
+                    float d = fp16_to_fp32(blocks[b].d);
+                    float dmin = fp16_to_fp32(blocks[b].dmin);
+                    const uint8_t* q = blocks[b].qs;
+                    float* y = out + b * QK_K;
+
+                    for (size_t j = 0; j < QK_K / 64; j++) {
+                        uint8_t sc, m;
+                        q4_K_scale_min(2 * j, blocks[b].scales, sc, m);
+                        float d1 = d * sc, m1 = dmin * m;
+                        q4_K_scale_min(2 * j + 1, blocks[b].scales, sc, m);
+                        float d2 = d * sc, m2 = dmin * m;
+
+                        for (size_t l = 0; l < 32; l++) {
+                            y[64 * j + l] = d1 * (q[32 * j + l] & 0xF) - m1;
+                            y[64 * j + 32 + l] = d2 * (q[32 * j + l] >> 4) - m2;
+                        }
+                    }
+                }
+            }
+        }
+
+        /**
+        * Quantizes one row of k floats (k a multiple of the block size) into out. Meant for
+        * building quantized weights offline or in tests; Q4_K uses a plain min/max fit rather
+        * than GGML's iterative search.
+        */
+        inline void quantize_row(quant_type type, const float* x, size_t k, void* out) {
+            if (type == quant_type::q8_0) {
+                block_q8_0* blocks = (block_q8_0*)out;
+                for (size_t b = 0; b < k / QK8_0; b++) {
+                    const float* xb = x + b * QK8_0;
+                    float amax = 0;
+                    for (size_t l = 0; l < QK8_0; l++)
+                        amax = std::max(amax, std::fabs(xb[l]));
+
+                    float d = amax / 127;
+                    float id = d ? 1.0f / d : 0.0f;
+                    blocks[b].d = fp32_to_fp16(d);
+                    for (size_t l = 0; l < QK8_0; l++)
+                        blocks[b].qs[l] = (int8_t)std::lround(xb[l] * id);
+                }
+            }
+            else if (type == quant_type::q4_0) {
+                block_q4_0* blocks = (block_q4_0*)out;
+                for (size_t b = 0; b < k / QK4_0; b++) {
+                    const float* xb = x + b * QK4_0;
+                    // the value of largest magnitude maps to -8, keeping its sign
+                    float max = 0;
+                    for (size_t l = 0; l < QK4_0; l++) {
+                        if (std::fabs(xb[l]) > std::fabs(max))
+                            max = xb[l];
+                    }
+
+                    float d = max / -8;
+                    float id = d ? 1.0f / d : 0.0f;
+                    blocks[b].d = fp32_to_fp16(d);
+                    for (size_t l = 0; l < QK4_0 / 2; l++) {
+                        uint8_t q0 = (uint8_t)std::min(15, (int)(xb[l] * id + 8.5f));
+                        uint8_t q1 = (uint8_t)std::min(15, (int)(xb[l + QK4_0 / 2] * id + 8.5f));
+                        blocks[b].qs[l] = q0 | (q1 << 4);
+                    }
+                }
+            }
+            else {
+                block_q4_K* blocks = (block_q4_K*)out;
+                for (size_t b = 0; b < k / QK_K; b++) {
+                    const float* xb = x + b * QK_K;
+                    float scales[8], mins[8];
+                    float max_scale = 0, max_min = 0;
+
+                    for (size_t j = 0; j < 8; j++) {
+                        float lo = 0, hi = 0;
+                        for (size_t l = 0; l < 32; l++) {
+                            lo = std::min(lo, xb[32 * j + l]);
+                            hi = std::max(hi, xb[32 * j + l]);
+                        }
+                        scales[j] = (hi - lo) / 15;
+                        mins[j] = -lo;
+                        max_scale = std::max(max_scale, scales[j]);
+                        max_min = std::max(max_min, mins[j]);
+                    }
+
+                    float d = max_scale / 63;
+                    float dmin = max_min / 63;
+                    blocks[b].d = fp32_to_fp16(d);
+                    blocks[b].dmin = fp32_to_fp16(dmin);
+                    // quantize against the values the kernels will actually see
+                    d = fp16_to_fp32(blocks[b].d);
+                    dmin = fp16_to_fp32(blocks[b].dmin);
+
+                    uint8_t ls[8], lm[8];
+                    for (size_t j = 0; j < 8; j++) {
+                        ls[j] = (uint8_t)std::clamp((long)std::lround(d ? scales[j] / d : 0.0f), 0L, 63L);
+                        lm[j] = (uint8_t)std::clamp((long)std::lround(dmin ? mins[j] / dmin : 0.0f), 0L, 63L);
+                    }
+
+                    std::fill_n(blocks[b].scales, 12, 0);
+                    for (size_t j = 0; j < 8; j++) {
+                        if (j < 4) {
+                            blocks[b].scales[j] = ls[j];
+                            blocks[b].scales[j + 4] = lm[j];
+                        }
+                        else {
+                            blocks[b].scales[j + 4] = (ls[j] & 0xF) | ((lm[j] & 0xF) << 4);
+                            blocks[b].scales[j - 4] |= (ls[j] >> 4) << 6;
+                            blocks[b].scales[j] |= (lm[j] >> 4) << 6;
+                        }
+                    }
+
+                    uint8_t q[QK_K];
+                    for (size_t j = 0; j < 8; j++) {
+                        float step = d * ls[j];
+                        float offset = dmin * lm[j];
+                        for (size_t l = 0; l < 32; l++) {
+                            long v = step ? std::lround((xb[32 * j + l] + offset) / step) : 0;
+                            q[32 * j + l] = (uint8_t)std::clamp(v, 0L, 15L);
+                        }
+                    }
+                    for (size_t j = 0; j < QK_K / 64; j++) {
+                        for (size_t l = 0; l < 32; l++)
+                            blocks[b].qs[32 * j + l] = q[64 * j + l] | (q[64 * j + 32 + l] << 4);
+                    }
+                }
+            }
+        }
+
+        /**
+        * Quantizes k activations (k a multiple of 32) into blocks of 32 int8 values.
+        */
+        inline void quantize_row_act(const float* x, size_t k, block_q8_act* out) {
+            for (size_t b = 0; b < k / 32; b++) {
+                const float* xb = x + b * 32;
+                float amax = 0;
+                for (size_t l = 0; l < 32; l++)
+                    amax = std::max(amax, std::fabs(xb[l]));
+
+                float d = amax / 127;
+                float id = d ? 1.0f / d : 0.0f;
+                int32_t sum = 0;
+                for (size_t l = 0; l < 32; l++) {
+                    out[b].qs[l] = (int8_t)std::lround(xb[l] * id);
+                    sum += out[b].qs[l];
+                }
+                out[b].d = d;
+                out[b].sum = sum;
+            }
+        }
+
+        /**
+        * Dot product of one quantized weight row of k elements with k quantized activations,
+        * multiplied on integers with one float scale per 32 elements.
+        */
+        inline float vec_dot_q8_0(size_t k, const block_q8_0* __restrict__ w, const block_q8_act* __restrict__ y) {
+            size_t nb = k / QK8_0;
+            float sum = 0;
+            for (size_t b = 0; b < nb; b++) {
+                int32_t isum = 0;
+                for (size_t l = 0; l < QK8_0; l++)
+                    isum += w[b].qs[l] * y[b].qs[l];
+                sum += fp16_to_fp32(w[b].d) * y[b].d * isum;
+            }
+            return sum;
+        }
+
+        inline float vec_dot_q4_0(size_t k, const block_q4_0* __restrict__ w, const block_q8_act* __restrict__ y) {
+            size_t nb = k / QK4_0;
+            float sum = 0;
+            for (size_t b = 0; b < nb; b++) {
+                int32_t isum = 0;
+                for (size_t l = 0; l < QK4_0 / 2; l++) {
+                    isum += ((int)(w[b].qs[l] & 0xF) - 8) * y[b].qs[l];
+                    isum += ((int)(w[b].qs[l] >> 4) - 8) * y[b].qs[l + QK4_0 / 2];
+                }
+                sum += fp16_to_fp32(w[b].d) * y[b].d * isum;
+            }
+            return sum;
+        }
+
+        inline float vec_dot_q4_K(size_t k, const block_q4_K* __restrict__ w, const block_q8_act* __restrict__ y) {
+            size_t nb = k / QK_K;
+            float sum = 0, min_sum = 0;
+            for (size_t b = 0; b < nb; b++) {
+                float d = fp16_to_fp32(w[b].d);
+                float dmin = fp16_to_fp32(w[b].dmin);
+                const block_q8_act* yb = y + b * (QK_K / 32);
+
+                for (size_t j = 0; j < QK_K / 64; j++) {
+                    uint8_t sc0, m0, sc1, m1;
+                    q4_K_scale_min(2 * j, w[b].scales, sc0, m0);
+                    q4_K_scale_min(2 * j + 1, w[b].scales, sc1, m1);
+                    const block_q8_act& y0 = yb[2 * j];
+                    const block_q8_act& y1 = yb[2 * j + 1];
+                    const uint8_t* q = w[b].qs + 32 * j;
+
+                    min_sum += dmin * (m0 * y0.d * y0.sum + m1 * y1.d * y1.sum);
+                    int32_t isum0 = 0, isum1 = 0;
+                    for (size_t l = 0; l < 32; l++) {
+                        isum0 += (q[l] & 0xF) * y0.qs[l];
+                        isum1 += (q[l] >> 4) * y1.qs[l];
+                    }
+                    sum += d * (sc0 * y0.d * isum0 + sc1 * y1.d * isum1);
+                }
+            }
+            return sum - min_sum;
+        }
+
+#if defined(BLASS_X86)
+        BLASS_TARGET_AVX2 inline float hsum_ps(__m256 v) {
+            __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+            sum4 = _mm_add_ss(sum4, _mm_movehdup_ps(sum4));
+            return _mm_cvtss_f32(sum4);
+        }
+
+        // 32 unsigned x signed byte products, summed pairwise into 8 int32 lanes
+        BLASS_TARGET_AVX2 inline __m256i dot_u8_i8(__m256i u, __m256i s) {
+            return _mm256_madd_epi16(_mm256_maddubs_epi16(u, s), _mm256_set1_epi16(1));
+        }
+
+        // same for signed x signed, moving the sign of x onto y so maddubs can be used
+        BLASS_TARGET_AVX2 inline __m256i dot_i8_i8(__m256i x, __m256i y) {
+            return dot_u8_i8(_mm256_sign_epi8(x, x), _mm256_sign_epi8(y, x));
+        }
+
+        // the same dot products with the blocks decoded in registers
+        BLASS_TARGET_AVX2 inline float vec_dot_q8_0_avx2(size_t k, const block_q8_0* __restrict__ w, const block_q8_act* __restrict__ y) {
+            size_t nb = k / QK8_0;
+            __m256 acc = _mm256_setzero_ps();
+            for (size_t b = 0; b < nb; b++) {
+                __m256i qw = _mm256_loadu_si256((const __m256i*)w[b].qs);
+                __m256i qy = _mm256_loadu_si256((const __m256i*)y[b].qs);
+                __m256 dot = _mm256_cvtepi32_ps(dot_i8_i8(qw, qy));
+                acc = _mm256_fmadd_ps(_mm256_set1_ps(fp16_to_fp32_f16c(w[b].d) * y[b].d), dot, acc);
+            }
+            return hsum_ps(acc);
+        }
+
+        BLASS_TARGET_AVX2 inline float vec_dot_q4_0_avx2(size_t k, const block_q4_0* __restrict__ w, const block_q8_act* __restrict__ y) {
+            size_t nb = k / QK4_0;
+            __m256 acc = _mm256_setzero_ps();
+            const __m256i low_mask = _mm256_set1_epi8(0xF);
+            for (size_t b = 0; b < nb; b++) {
+                __m128i raw = _mm_loadu_si128((const __m128i*)w[b].qs);
+                __m256i nibbles = _mm256_and_si256(_mm256_set_m128i(_mm_srli_epi16(raw, 4), raw), low_mask);
+                __m256i qw = _mm256_sub_epi8(nibbles, _mm256_set1_epi8(8));
+                __m256i qy = _mm256_loadu_si256((const __m256i*)y[b].qs);
+                __m256 dot = _mm256_cvtepi32_ps(dot_i8_i8(qw, qy));
+                acc = _mm256_fmadd_ps(_mm256_set1_ps(fp16_to_fp32_f16c(w[b].d) * y[b].d), dot, acc);
+            }
+            return hsum_ps(acc);
+        }
+
+        BLASS_TARGET_AVX2 inline float vec_dot_q4_K_avx2(size_t k, const block_q4_K* __restrict__ w, const block_q8_act* __restrict__ y) {
+            size_t nb = k / QK_K;
+            float min_sum = 0;
+            __m256 acc = _mm256_setzero_ps();
+            const __m256i low_mask = _mm256_set1_epi8(0xF);
+            for (size_t b = 0; b < nb; b++) {
+                float d = fp16_to_fp32_f16c(w[b].d);
+                float dmin = fp16_to_fp32_f16c(w[b].dmin);
+                const block_q8_act* yb = y + b * (QK_K / 32);
+
+                for (size_t j = 0; j < QK_K / 64; j++) {
+                    uint8_t sc0, m0, sc1, m1;
+                    q4_K_scale_min(2 * j, w[b].scales, sc0, m0);
+                    q4_K_scale_min(2 * j + 1, w[b].scales, sc1, m1);
+                    const block_q8_act& y0 = yb[2 * j];
+                    const block_q8_act& y1 = yb[2 * j + 1];
+                    const uint8_t* q = w[b].qs + 32 * j;
+
+                    min_sum += dmin * (m0 * y0.d * y0.sum + m1 * y1.d * y1.sum);
+                    __m256i raw = _mm256_loadu_si256((const __m256i*)q);
+                    __m256i lo = _mm256_and_si256(raw, low_mask);
+                    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(raw, 4), low_mask);
+                    __m256 dot0 = _mm256_cvtepi32_ps(dot_u8_i8(lo, _mm256_loadu_si256((const __m256i*)y0.qs)));
+                    __m256 dot1 = _mm256_cvtepi32_ps(dot_u8_i8(hi, _mm256_loadu_si256((const __m256i*)y1.qs)));
+                    acc = _mm256_fmadd_ps(_mm256_set1_ps(d * sc0 * y0.d), dot0, acc);
+                    acc = _mm256_fmadd_ps(_mm256_set1_ps(d * sc1 * y1.d), dot1, acc);
+                }
+            }
+            return hsum_ps(acc) - min_sum;
+        }
+#endif
+
+        /**
+        * Quantized dot product for the given kernel variant; every variant from AVX2 up
+        * uses the AVX2 kernels.
+        */
+        inline float vec_dot_quant(quant_type type, [[maybe_unused]] isa target, size_t k, const void* w, const block_q8_act* y) {
+#if defined(BLASS_X86)
+            if (target >= isa::avx2) {
+                switch (type) {
+                    case quant_type::q8_0: return vec_dot_q8_0_avx2(k, (const block_q8_0*)w, y);
+                    case quant_type::q4_0: return vec_dot_q4_0_avx2(k, (const block_q4_0*)w, y);
+                    default: return vec_dot_q4_K_avx2(k, (const block_q4_K*)w, y);
+                }
+            }
+#endif
+            switch (type) {
+                case quant_type::q8_0: return vec_dot_q8_0(k, (const block_q8_0*)w, y);
+                case quant_type::q4_0: return vec_dot_q4_0(k, (const block_q4_0*)w, y);
+                default: return vec_dot_q4_K(k, (const block_q4_K*)w, y);
+            }
+        }
+
+        /**
+        * C[m x n] = A[m x k] * W^T for m <= GEMV_MAX_ROWS, where W is n quantized rows of k
+        * elements, row j starting at w + j * row_bytes. The rows of A are quantized once up
+        * front; weight rows are split between threads and each is streamed exactly once.
+        */
+        inline void gemv_quant(size_t m, size_t n, size_t k, const float* a, size_t lda,
+                               quant_type type, const uint8_t* w, size_t row_bytes,
+                               float* c, size_t ldc, bool use_omp = true) {
+            size_t nb = k / 32;
+            block_q8_act* qa = workspace<block_q8_act, 0>(std::max<size_t>(m * nb, 1));
+            for (size_t i = 0; i < m; i++)
+                quantize_row_act(a + i * lda, k, qa + i * nb);
+
+            isa target = active_isa();
+            bool parallel = use_omp && n * k >= GEMV_OMP_THRESHOLD;
+
+            #pragma omp parallel if (parallel)
+            {
+                size_t begin, end;
+                thread_range(n, 16, begin, end);
+
+                for (size_t j = begin; j < end; j++) {
+                    const uint8_t* row = w + j * row_bytes;
+                    for (size_t p = 0; p < row_bytes; p += GEMV_PREFETCH_BYTES)
+                        prefetch_stream(row + row_bytes + p);
+
+                    for (size_t i = 0; i < m; i++)
+                        c[i * ldc + j] = vec_dot_quant(type, target, k, row, qa + i * nb);
+                }
+            }
+        }
+
+#if defined(BLASS_X86)
+        // dst[i * ld_dst + j] = src[j * ld_src + i] for an 8 x 8 block
+        BLASS_TARGET_AVX2 inline void transpose_8x8(const float* __restrict__ src, size_t ld_src, float* __restrict__ dst, size_t ld_dst) {
+            __m256 r[8], t[8];
+            for (size_t i = 0; i < 8; i++)
+                r[i] = _mm256_loadu_ps(src + i * ld_src);
+
+            for (size_t i = 0; i < 8; i += 2) {
+                t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+                t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+            }
+            for (size_t i = 0; i < 8; i += 4) {
+                r[i] = _mm256_shuffle_ps(t[i], t[i + 2], 0x44);
+                r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], 0xEE);
+                r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], 0x44);
+                r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], 0xEE);
+            }
+
+            for (size_t i = 0; i < 4; i++) {
+                _mm256_storeu_ps(dst + i * ld_dst, _mm256_permute2f128_ps(r[i], r[i + 4], 0x20));
+                _mm256_storeu_ps(dst + (i + 4) * ld_dst, _mm256_permute2f128_ps(r[i], r[i + 4], 0x31));
+            }
+        }
+#endif
+
+        /**
+        * Writes the transpose of an nr x kc row-major block (leading dimension ld_src) into a
+        * kc x NR panel, zero-filling columns nr..NR. From AVX2 up this runs as 8 x 8 register
+        * transposes, so both the reads and the writes stay contiguous.
+        */
+        template <isa I, size_t NR>
+        inline void transpose_to_panel(size_t nr, size_t kc, const float* __restrict__ src, size_t ld_src, float* __restrict__ dst) {
+            size_t kc8 = 0, nr8 = 0;
+#if defined(BLASS_X86)
+            if constexpr (I >= isa::avx2) {
+                kc8 = kc / 8 * 8;
+                nr8 = nr / 8 * 8;
+                for (size_t p = 0; p < kc8; p += 8)
+                    for (size_t j = 0; j < nr8; j += 8)
+                        transpose_8x8(src + j * ld_src + p, ld_src, dst + p * NR + j, NR);
+            }
+#endif
+            for (size_t p = 0; p < kc; p++) {
+                size_t j = p < kc8 ? nr8 : 0;
+                for (; j < nr; j++)
+                    dst[p * NR + j] = src[j * ld_src + p];
+                for (; j < NR; j++)
+                    dst[p * NR + j] = 0.0f;
+            }
+        }
+
+        /**
+        * C = alpha * A * W^T (+ C with accumulate) through the packed GEMM of variant I, for
+        * quantized W laid out as in gemv_quant. Each KC x NC panel of W^T is dequantized
+        * straight into the packed panel layout, so the full-precision weight never exists in
+        * memory. Rows are dequantized contiguously, then transposed into the panel.
+        */
+        template <isa I>
+        void gemm_quant(size_t m, size_t n, size_t k, const float* a, size_t rsa, size_t csa,
+                        quant_type type, const uint8_t* w, size_t row_bytes,
+                        float* c, size_t ldc, bool use_omp = true,
+                        float alpha = 1.0f, bool accumulate = false, const epilogue<float>* epi = nullptr) {
+            using P = gemm_params<float, I>;
+            constexpr size_t NR = P::NR;
+            static_assert(P::KC % QK_K == 0, "KC slices must cover whole quantization blocks");
+
+            float* packed_b = workspace<float, 1>(((std::min(n, P::NC) + NR - 1) / NR) * NR * P::KC);
+
+            auto dequant_panel = [&](size_t jc, size_t nc, size_t pc, size_t kc) -> const float* {
+                size_t n_panels = (nc + NR - 1) / NR;
+
+                #pragma omp for schedule(static)
+                for (size_t jr = 0; jr < n_panels; jr++) {
+                    alignas(64) float rows[NR * P::KC];
+                    size_t nr = std::min(NR, nc - jr * NR);
+
+                    for (size_t j = 0; j < nr; j++)
+                        dequantize_row(type, w + (jc + jr * NR + j) * row_bytes, pc, kc, rows + j * kc);
+                    transpose_to_panel<I, NR>(nr, kc, rows, kc, packed_b + jr * NR * kc);
+                }
+                return packed_b;
+            };
+
+            gemm_driver<I>(m, n, k, a, rsa, csa, dequant_panel, c, ldc, use_omp, alpha, accumulate, epi);
+        }
+
+        /**
+        * gemm_quant with the kernels of the active variant.
+        */
+        inline void gemm_quant(size_t m, size_t n, size_t k, const float* a, size_t rsa, size_t csa,
+                               quant_type type, const uint8_t* w, size_t row_bytes,
+                               float* c, size_t ldc, bool use_omp = true,
+                               float alpha = 1.0f, bool accumulate = false, const epilogue<float>* epi = nullptr) {
+            dispatch_isa<float>(active_isa(), [&](auto I) {
+                gemm_quant<I>(m, n, k, a, rsa, csa, type, w, row_bytes, c, ldc, use_omp, alpha, accumulate, epi);
+            });
+        }
+    }
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+
+#include "blas.h"
+#include "quant.h"
+
+namespace blass {
+    /**
+    * Right-hand matrix of a matmul (K x N) kept in a GGUF block-quantized format: N rows of
+    * K elements each (the [N, K] Linear layout), every row a run of whole blocks. Matmuls
+    * against it dequantize on the fly, so the weight stays 4-8 bits per element in memory.
+    */
+    class QuantizedMatrix {
+    private:
+        std::shared_ptr<uint8_t[]> data;
+        kernel::quant_type type = kernel::quant_type::q8_0;
+        size_t k = 0;
+        size_t n = 0;
+
+        static QuantizedMatrix with_shape(kernel::quant_type type, size_t n, size_t k) {
+            if (k % kernel::quant_block_size(type) != 0) {
+                throw std::invalid_argument("Quantized rows of " + std::to_string(k) + " elements are not a whole number of " +
+                                            std::to_string(kernel::quant_block_size(type)) + "-element blocks");
+            }
+
+            QuantizedMatrix q;
+            q.type = type;
+            q.k = k;
+            q.n = n;
+            return q;
+        }
+
+    public:
+        QuantizedMatrix() {}
+
+        /**
+        * Copies n rows of k elements of raw GGUF blocks.
+        */
+        static QuantizedMatrix from_blocks(kernel::quant_type type, size_t n, size_t k, const void* blocks) {
+            QuantizedMatrix q = with_shape(type, n, k);
+            size_t bytes = n * q.row_bytes();
+            q.data = std::shared_ptr<uint8_t[]>(new uint8_t[std::max<size_t>(bytes, 1)]);
+            std::memcpy(q.data.get(), blocks, bytes);
+            return q;
+        }
+
+        /**
+        * Uses n rows of k elements of GGUF blocks in place, e.g. straight from the mapped
+        * file: the blocks are already the layout the kernels read. owner keeps them alive.
+        */
+        static QuantizedMatrix borrow(kernel::quant_type type, size_t n, size_t k, const void* blocks, std::shared_ptr<const void> owner) {
+            QuantizedMatrix q = with_shape(type, n, k);
+            q.data = std::shared_ptr<uint8_t[]>(std::const_pointer_cast<void>(owner), (uint8_t*)blocks);
+            return q;
+        }
+
+        /**
+        * Quantizes a 2D float tensor laid out as [N, K].
+        */
+        static QuantizedMatrix quantize(const Tensor<float>& w_raw, kernel::quant_type type) {
+            if (w_raw.get_shape().size() != 2) {
+                throw std::invalid_argument("QuantizedMatrix can only be built from a 2D tensor, got shape " + utils::to_string_vec(w_raw.get_shape()));
+            }
+
+            Tensor<float> w = w_raw.contiguous();
+            size_t n = w.get_shape(0);
+            size_t k = w.get_shape(1);
+            if (k % kernel::quant_block_size(type) != 0) {
+                throw std::invalid_argument("Cannot quantize rows of " + std::to_string(k) + " elements into " +
+                                            std::to_string(kernel::quant_block_size(type)) + "-element blocks");
+            }
+
+            QuantizedMatrix q;
+            q.type = type;
+            q.k = k;
+            q.n = n;
+            q.data = std::shared_ptr<uint8_t[]>(new uint8_t[std::max<size_t>(n * q.row_bytes(), 1)]);
+            for (size_t j = 0; j < n; j++)
+                kernel::quantize_row(type, w.get_data() + j * k, k, q.data.get() + j * q.row_bytes());
+            return q;
+        }
+
+        /**
+        * Dequantizes row j (output column j of the matmul) into out[0..K).
+        */
+        void dequantize_row(size_t j, float* out) const {
+            kernel::dequantize_row(type, data.get() + j * row_bytes(), 0, k, out);
+        }
+
+        /**
+        * The full-precision [N, K] matrix.
+        */
+        Tensor<float> dequantize() const {
+            Tensor<float> w = Tensor<float>::from_shape({n, k});
+            for (size_t j = 0; j < n; j++)
+                dequantize_row(j, w.get_data() + j * k);
+            return w;
+        }
+
+        size_t rows() const {
+            return k;
+        }
+
+        size_t cols() const {
+            return n;
+        }
+
+        size_t row_bytes() const {
+            return kernel::quant_row_bytes(type, k);
+        }
+
+        kernel::quant_type get_type() const {
+            return type;
+        }
+
+        bool empty() const {
+            return !data;
+        }
+
+        const uint8_t* get_data() const {
+            return data.get();
+        }
+    };
+
+    /**
+    * c[..., N] = alpha * a[..., K] x b[K, N] + beta * c, in place, for a quantized b. Up to
+    * GEMV_MAX_ROWS rows run as integer dot products against activations quantized to 8 bits,
+    * larger products dequantize b panel by panel into the packed GEMM.
+    */
+    inline void gemm(const Tensor<float>& a_raw, const QuantizedMatrix& b, Tensor<float>& c,
+                     float alpha = 1.0f, float beta = 0.0f, Epilogue<float> epi = {}) {
+        if (a_raw.get_shape().empty() || a_raw.get_shape().back() != b.rows()) {
+            throw std::invalid_argument("Inner dimensions must match for matmul, multiplying shape " +
+                                        utils::to_string_vec(a_raw.get_shape()) + " by quantized [" +
+                                        std::to_string(b.rows()) + ", " + std::to_string(b.cols()) + "]");
+        }
+
+        std::vector<size_t> c_shape = a_raw.get_shape();
+        c_shape.back() = b.cols();
+        if (c.get_shape() != c_shape || !c.is_contiguous()) {
+            throw std::invalid_argument("Output of a quantized gemm must be a contiguous tensor of shape " +
+                                        utils::to_string_vec(c_shape) + ", got " + utils::to_string_vec(c.get_shape()));
+        }
+
+        Tensor<float> a = a_raw.contiguous();
+        size_t k = b.rows();
+        size_t n = b.cols();
+        size_t m = n == 0 ? 0 : c.size() / n;
+
+        if (m == 0 || n == 0)
+            return;
+
+        kernel::epilogue<float> raw = epi.bind(c_shape);
+
+        if (m <= kernel::GEMV_MAX_ROWS) {
+            kernel::scaled_output(m, n, alpha, beta, c.get_data(), n, [&](float* out, size_t ld_out) {
+                kernel::gemv_quant(m, n, k, a.get_data(), k, b.get_type(), b.get_data(), b.row_bytes(), out, ld_out);
+            });
+            kernel::apply_epilogue(m, n, c.get_data(), n, &raw);
+        }
+        else {
+            if (beta != 0.0f)
+                kernel::scale_c(m, n, beta, c.get_data(), n);
+            kernel::gemm_quant(m, n, k, a.get_data(), k, 1, b.get_type(), b.get_data(), b.row_bytes(),
+                               c.get_data(), n, true, alpha, beta != 0.0f, &raw);
+        }
+    }
+
+    /**
+    * a[..., K] x b[K, N] -> [..., N] for a quantized b, with an optional fused epilogue.
+    */
+    inline Tensor<float> matmul(const Tensor<float>& a, const QuantizedMatrix& b, Epilogue<float> epi = {}) {
+        std::vector<size_t> result_shape = a.get_shape();
+        if (!result_shape.empty())
+            result_shape.back() = b.cols();
+
+        Tensor<float> result = Tensor<float>::from_shape(result_shape);
+        gemm(a, b, result, 1.0f, 0.0f, std::move(epi));
+        return result;
+    }
+}
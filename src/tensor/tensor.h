@@ -54,7 +54,7 @@ namespace blass {
         std::shared_ptr<T[]> data;
         std::vector<size_t> shape;
         std::vector<size_t> strides; // strides[i] = product of shape[i+1..end] = amount to walk to next index in dimension i
-        size_t sz;
+        size_t sz = 0;
 
         template <typename U>
         void deduce_shape_from_list(const std::initializer_list<U>& list, std::vector<size_t>& shape_vec) {
@@ -110,6 +110,10 @@ namespace blass {
             return tensor;
         }
 
+        static Tensor<T> fill_random(const std::vector<size_t>& shape_, const T& min_value, const T& max_value) {
+            return rand(shape_, min_value, max_value);
+        }
+
         static Tensor<T> rand(const std::vector<size_t>& shape_, const T& min_value, const T& max_value) {
             Tensor<T> tensor(shape_);
             float min_val_f = static_cast<float>(min_value);
@@ -186,6 +190,15 @@ namespace blass {
                 sz *= dim;
         }
 
+        /**
+        * A contiguous tensor over memory it does not own, e.g. part of a memory-mapped file.
+        * owner is kept alive as long as the tensor or any view of it is, and data itself is
+        * never freed or copied.
+        */
+        static Tensor<T> borrow(T* data_, const std::vector<size_t>& shape_, std::shared_ptr<const void> owner) {
+            return Tensor<T>(std::shared_ptr<T[]>(std::const_pointer_cast<void>(owner), data_), shape_);
+        }
+
         template <typename U>
         Tensor(std::initializer_list<U> list) {
             init_from_list(list);
@@ -377,7 +390,7 @@ namespace blass {
         Tensor<T> transpose(const std::vector<size_t>& perm) const;
         Tensor<T> transpose() const;
         Tensor<T> transpose2D() const;
-        Tensor<T> view(const std::vector<int>& new_shape) const;
+        Tensor<T> view(const std::vector<int64_t>& new_shape) const;
         Tensor<T> clone() const;
 
         // broadcasting and elementwise operations
@@ -409,4 +422,7 @@ namespace blass {
 }
 
 #include "tensor_op.h"
-#include "tensor_impl.h"
\ No newline at end of file
+#include "tensor_impl.h"
+#include "blas.h"
+#include "packed_matrix.h"
+#include "quantized_matrix.h"
\ No newline at end of file
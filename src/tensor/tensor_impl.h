@@ -133,8 +133,8 @@ namespace blass {
     }
 
     template <typename T>
-    Tensor<T> Tensor<T>::view(const std::vector<int>& new_shape) const {
-        std::vector<int> final_shape = new_shape;
+    Tensor<T> Tensor<T>::view(const std::vector<int64_t>& new_shape) const {
+        std::vector<int64_t> final_shape = new_shape;
         size_t new_sz = 1;
 
         // Handle negative dimension -> Infer the size
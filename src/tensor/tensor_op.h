@@ -5,6 +5,7 @@
 #include <iostream>
 
 #include "../utils/utils.h"
+#include "gemm_batched.h"
 
 namespace blass {
     std::vector<size_t> broadcast_shape(const std::vector<size_t>& shape_a, const std::vector<size_t>& shape_b) {
@@ -53,9 +54,22 @@ namespace blass {
         Tensor<T> result = Tensor<T>::from_shape(shape);
 
         if (shape.size() == 1) {
-            #pragma omp parallel for simd
-            for (size_t i = 0; i < shape[0]; i++) {
-                result.data[i] = utils::scalar_op<op>(a.data[i], b.data[i]);
+            T* __restrict__ ptr_a = a.data.get();
+            T* __restrict__ ptr_b = b.data.get();
+            T* __restrict__ ptr_res = result.data.get();
+
+            #pragma omp parallel
+            {
+                size_t begin, end;
+                kernel::thread_range(shape[0], 16, begin, end);
+
+                // inner loops are compiled for the active instruction set (see kernel::run_isa)
+                kernel::run_isa([&] {
+                    #pragma omp simd
+                    for (size_t i = begin; i < end; i++) {
+                        ptr_res[i] = utils::scalar_op<op>(ptr_a[i], ptr_b[i]);
+                    }
+                });
             }
         }
         else {
@@ -98,38 +112,40 @@ namespace blass {
                 size_t a_stride = a.strides[dim_cut];
                 size_t b_stride = b.strides[dim_cut];
 
-                if (a_stride == 1 && b_stride == 1) {
-                    #pragma omp simd if (omp_inner)
-                    for (size_t i = 0; i < inner_size; i++) {
-                        ptr_res[i] = utils::scalar_op<op>(ptr_a[i], ptr_b[i]);
-                    }
-                } else if (a_stride == 1 && b_stride == 0) {
-                    T b_val = ptr_b[0];
+                kernel::run_isa([&] {
+                    if (a_stride == 1 && b_stride == 1) {
+                        #pragma omp simd if (omp_inner)
+                        for (size_t i = 0; i < inner_size; i++) {
+                            ptr_res[i] = utils::scalar_op<op>(ptr_a[i], ptr_b[i]);
+                        }
+                    } else if (a_stride == 1 && b_stride == 0) {
+                        T b_val = ptr_b[0];
                     
-                    #pragma omp simd if (omp_inner)
-                    for (size_t i = 0; i < inner_size; i++) {
-                        ptr_res[i] = utils::scalar_op<op>(ptr_a[i], b_val);
-                    }
-                } else if (a_stride == 0 && b_stride == 1) {
-                    T a_val = ptr_a[0];
-
-                    #pragma omp simd if (omp_inner)
-                    for (size_t i = 0; i < inner_size; i++) {
-                        ptr_res[i] = utils::scalar_op<op>(a_val, ptr_b[i]);
+                        #pragma omp simd if (omp_inner)
+                        for (size_t i = 0; i < inner_size; i++) {
+                            ptr_res[i] = utils::scalar_op<op>(ptr_a[i], b_val);
+                        }
+                    } else if (a_stride == 0 && b_stride == 1) {
+                        T a_val = ptr_a[0];
+
+                        #pragma omp simd if (omp_inner)
+                        for (size_t i = 0; i < inner_size; i++) {
+                            ptr_res[i] = utils::scalar_op<op>(a_val, ptr_b[i]);
+                        }
+                    } else if (a_stride == 0 && b_stride == 0) {
+                        T val = utils::scalar_op<op>(ptr_a[0], ptr_b[0]);
+
+                        #pragma omp simd if (omp_inner)
+                        for (size_t i = 0; i < inner_size; i++) {
+                            ptr_res[i] = val;
+                        }
+                    } else {
+                        #pragma omp simd if (omp_inner)
+                        for (size_t i = 0; i < inner_size; i++) {
+                            ptr_res[i] = utils::scalar_op<op>(ptr_a[i * a_stride], ptr_b[i * b_stride]);
+                        }
                     }
-                } else if (a_stride == 0 && b_stride == 0) {
-                    T val = utils::scalar_op<op>(ptr_a[0], ptr_b[0]);
-
-                    #pragma omp simd if (omp_inner)
-                    for (size_t i = 0; i < inner_size; i++) {
-                        ptr_res[i] = val;
-                    }
-                } else {
-                    #pragma omp simd if (omp_inner)
-                    for (size_t i = 0; i < inner_size; i++) {
-                        ptr_res[i] = utils::scalar_op<op>(ptr_a[i * a_stride], ptr_b[i * b_stride]);
-                    }
-                }
+                });
             }
         }
         return result;
@@ -265,10 +281,6 @@ namespace blass {
 
     template <typename T>
     Tensor<T> matmul_2d(const Tensor<T> &a, const Tensor<T> &b, bool b_transposed_, bool use_omp) {
-        if (!a.is_contiguous()) {
-            return matmul_2d(a.contiguous(), b, b_transposed_, use_omp);
-        }
-
         assert(a.get_shape().size() == 2 && b.get_shape().size() == 2 && "Both tensors must be 2D for matmul_2d");
         assert(a.get_shape(1) == b.get_shape(b_transposed_) && "Inner dimensions must match for matmul_2d");
 
@@ -278,68 +290,13 @@ namespace blass {
 
         Tensor<T> result = Tensor<T>::from_shape({m, p});
 
-        Tensor<T> b_transposed;
-        if (!b_transposed_)
-            b_transposed = b.transpose(); // assumes transpose does automatic contiguous
-        else 
-            b_transposed = b.contiguous();
-
-        if (m * p < 32) {
-            for (size_t i = 0; i < m; ++i) {
-                T* __restrict__ ptr_res_row = result.data.get() + i * result.strides[0];
-                T* __restrict__ ptr_a_row = a.data.get() + i * a.strides[0];
-
-                for (size_t j = 0; j < p; ++j) {
-                    T* __restrict__ ptr_b_row = b_transposed.data.get() + j * b_transposed.strides[0];
-
-                    T sum = 0;
-
-                    #pragma omp parallel for simd reduction(+:sum) if (use_omp)
-                    for (size_t k = 0; k < n; ++k)
-                        sum += ptr_a_row[k] * ptr_b_row[k];
-
-                    ptr_res_row[j] = sum;
-                }
-            }
-        }
-        else if (m >= p) {
-            #pragma omp parallel for if (use_omp)
-            for (size_t i = 0; i < m; ++i) {
-                T* __restrict__ ptr_res_row = result.data.get() + i * result.strides[0];
-                T* __restrict__ ptr_a_row = a.data.get() + i * a.strides[0];
-
-                for (size_t j = 0; j < p; ++j) {
-                    T* __restrict__ ptr_b_row = b_transposed.data.get() + j * b_transposed.strides[0];
-
-                    T sum = 0;
-
-                    #pragma omp simd reduction(+:sum)
-                    for (size_t k = 0; k < n; ++k)
-                        sum += ptr_a_row[k] * ptr_b_row[k];
-
-                    ptr_res_row[j] = sum;
-                }
-            }
-        } 
-        else {
-            #pragma omp parallel for if (use_omp)
-            for (size_t j = 0; j < p; ++j) {
-                T* __restrict__ ptr_res_col = result.data.get() + j;
-                T* __restrict__ ptr_b_row = b_transposed.data.get() + j * b_transposed.strides[0];
-                
-                for (size_t i = 0; i < m; ++i) {
-                    T* __restrict__ ptr_a_row = a.data.get() + i * a.strides[0];
-
-                    T sum = 0;
-
-                    #pragma omp simd reduction(+:sum)
-                    for (size_t k = 0; k < n; ++k)
-                        sum += ptr_a_row[k] * ptr_b_row[k];
+        // B(k, j) sits at b[k * rsb + j * csb], so transposed and strided views are packed
+        // straight from their storage without a transpose() or contiguous() copy
+        size_t rsb = b.strides[b_transposed_ ? 1 : 0];
+        size_t csb = b.strides[b_transposed_ ? 0 : 1];
 
-                    ptr_res_col[i * result.strides[0]] = sum;
-                }
-            }
-        }
+        kernel::gemm_auto(m, p, n, a.data.get(), a.strides[0], a.strides[1], b.data.get(), rsb, csb,
+                          result.data.get(), result.strides[0], use_omp);
 
         return result;
     }
@@ -396,41 +353,61 @@ namespace blass {
         for (size_t dim : batch_result_shape)
             batch_size *= dim;
 
-        size_t batch_stride = a.shape[a.shape.size() - 2] * b.shape[b.shape.size() - (b_transposed_ ? 2 : 1)];
-        
+        size_t nb = batch_result_shape.size();
+        size_t m = a.shape[a.shape.size() - 2];
+        size_t k = a.shape[a.shape.size() - 1];
+        size_t n = result_shape.back();
+
         const auto& sa = a_broadcasted.strides;
         const auto& sb = b_broadcasted.strides;
+        size_t rsb = sb[nb + (b_transposed_ ? 1 : 0)];
+        size_t csb = sb[nb + (b_transposed_ ? 0 : 1)];
+
+        // merge batch dimensions that step through memory uniformly in a, b and the result,
+        // innermost first; broadcast dimensions (stride 0) merge with each other as well
+        struct batch_dim {
+            size_t size, stride_a, stride_b, stride_c;
+        };
+        std::vector<batch_dim> dims;
+        for (size_t d = nb; d-- > 0;) {
+            size_t size = batch_result_shape[d];
+            if (size == 1)
+                continue;
+
+            batch_dim next{size, sa[d], sb[d], result.strides[d]};
+            if (!dims.empty()) {
+                batch_dim& inner = dims.back();
+                if (next.stride_a == inner.stride_a * inner.size &&
+                    next.stride_b == inner.stride_b * inner.size &&
+                    next.stride_c == inner.stride_c * inner.size) {
+                    inner.size *= size;
+                    continue;
+                }
+            }
+            dims.push_back(next);
+        }
+        if (dims.empty())
+            dims.push_back({1, 0, 0, 0});
 
-        bool use_omp_batch = batch_size >= 32;
-
-        #pragma omp parallel for if(use_omp_batch)
-        for (size_t i = 0; i < batch_size; ++i) {
-            std::vector<size_t> idx(batch_result_shape.size(), 0);
+        // the innermost merged dimension is one strided-batched call, any remaining ones are looped over
+        const batch_dim& inner = dims.front();
+        size_t outer_size = batch_size / inner.size;
 
+        for (size_t i = 0; i < outer_size; ++i) {
             size_t tmp = i;
-            size_t offset_a = 0, offset_b = 0;
-            for (int dim = batch_result_shape.size() - 1; dim >= 0; --dim) {
-                size_t idx = tmp % batch_result_shape[dim];
-                offset_a += idx * sa[dim];
-                offset_b += idx * sb[dim];
-                tmp /= batch_result_shape[dim];
+            size_t offset_a = 0, offset_b = 0, offset_c = 0;
+            for (size_t d = 1; d < dims.size(); ++d) {
+                size_t idx = tmp % dims[d].size;
+                offset_a += idx * dims[d].stride_a;
+                offset_b += idx * dims[d].stride_b;
+                offset_c += idx * dims[d].stride_c;
+                tmp /= dims[d].size;
             }
 
-            std::shared_ptr<T[]> ptr_a = std::shared_ptr<T[]>(a_broadcasted.data, a_broadcasted.data.get() + offset_a);
-            std::shared_ptr<T[]> ptr_b = std::shared_ptr<T[]>(b_broadcasted.data, b_broadcasted.data.get() + offset_b);
-            T* __restrict__ ptr_res = result.data.get() + i * batch_stride;
-
-            Tensor<T> a_slice(ptr_a, 
-                            {a.shape[a.shape.size() - 2], a.shape[a.shape.size() - 1]});
-            Tensor<T> b_slice(ptr_b, 
-                                {b.shape[b.shape.size() - 2], b.shape[b.shape.size() - 1]});
-
-            Tensor<T> mat_result = matmul_2d(a_slice, b_slice, b_transposed_, !use_omp_batch);
-            T* __restrict__ mat_result_ptr = mat_result.data.get();
-            
-            #pragma omp simd
-            for (size_t j = 0; j < mat_result.size(); ++j)
-                ptr_res[j] = mat_result_ptr[j];
+            kernel::gemm_strided_batched(inner.size, m, n, k,
+                                         a_broadcasted.data.get() + offset_a, inner.stride_a, sa[nb], sa[nb + 1],
+                                         b_broadcasted.data.get() + offset_b, inner.stride_b, rsb, csb,
+                                         result.data.get() + offset_c, inner.stride_c, result.strides[nb]);
         }
         return result;
     }
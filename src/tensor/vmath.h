@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace blass {
+    namespace kernel {
+        /**
+        * exp(x) for float as straight-line arithmetic, so loops calling it vectorize under
+        * omp simd for whatever instruction set they are compiled for. x = n ln2 + r with
+        * |r| <= ln2 / 2, exp(r) from a degree-6 polynomial (Cephes expf coefficients), and
+        * 2^n built in the exponent bits in two halves so n = 128 does not overflow early.
+        * Max error 1 ULP over the normal range; underflows to 0 below -87.33 (no
+        * subnormals), +inf above 88.72, NaN in NaN out.
+        */
+        inline float exp_approx(float x) {
+            const float log2e = 1.44269504088896341f;
+            const float ln2_hi = 0.693359375f;
+            const float ln2_lo = -2.12194440e-4f;
+            // adding 1.5 * 2^23 rounds to the nearest integer
+            const float round_magic = 12582912.0f;
+
+            // plain compares rather than fmin/fmax: their NaN rules keep GCC from vectorizing
+            float xc = x < -87.33654f ? -87.33654f : x;
+            xc = xc > 88.72284f ? 88.72284f : xc;
+            float n = (xc * log2e + round_magic) - round_magic;
+            float r = xc - n * ln2_hi - n * ln2_lo;
+
+            float p = 1.9875691500e-4f;
+            p = p * r + 1.3981999507e-3f;
+            p = p * r + 8.3334519073e-3f;
+            p = p * r + 4.1665795894e-2f;
+            p = p * r + 1.6666665459e-1f;
+            p = p * r + 5.0000001201e-1f;
+            p = p * r * r + r + 1.0f;
+
+            int32_t ni = (int32_t)n;
+            int32_t half = ni >> 1;
+            float s1 = std::bit_cast<float>((half + 127) << 23);
+            float s2 = std::bit_cast<float>((ni - half + 127) << 23);
+            float y = p * s1 * s2;
+
+            y = x < -87.33654f ? 0.0f : y;
+            y = x > 88.72284f ? std::numeric_limits<float>::infinity() : y;
+            return x != x ? x : y;
+        }
+
+        /**
+        * Vectorizable exp for the nn kernels: exp_approx for float, std::exp otherwise.
+        */
+        template <typename T>
+        inline T fast_exp(T x) {
+            if constexpr (std::is_same_v<T, float>)
+                return exp_approx(x);
+            else
+                return std::exp(x);
+        }
+
+        // 1 / (1 + exp(-x)); max error 2 ULP for float
+        template <typename T>
+        inline T fast_sigmoid(T x) {
+            return T(1) / (T(1) + fast_exp(-x));
+        }
+
+        // x * sigmoid(x); max error 2 ULP for float
+        template <typename T>
+        inline T fast_silu(T x) {
+            return x / (T(1) + fast_exp(-x));
+        }
+
+        /**
+        * 1 / sqrt(x). sqrt is a correctly rounded vector instruction on every target we
+        * build for, so this is one division away from exact (max error 1 ULP); the bit-trick
+        * estimate plus Newton steps would be both slower to converge and less accurate.
+        */
+        template <typename T>
+        inline T fast_rsqrt(T x) {
+            return T(1) / std::sqrt(x);
+        }
+
+        // largest of x[0..n), -inf when empty; NaNs are skipped
+        template <typename T>
+        inline T max_row(const T* x, size_t n) {
+            T max_val = -std::numeric_limits<T>::infinity();
+            #pragma omp simd reduction(max:max_val)
+            for (size_t j = 0; j < n; j++)
+                max_val = x[j] > max_val ? x[j] : max_val;
+            return max_val;
+        }
+
+        /**
+        * Index of the first largest element of x[0..n), n if there is none (empty or all
+        * NaN). One vectorized pass keeps the best 64-element block, only it is scanned.
+        */
+        template <typename T>
+        inline size_t argmax_row(const T* x, size_t n) {
+            constexpr size_t BLOCK = 64;
+            T best = -std::numeric_limits<T>::infinity();
+            size_t best_block = n;
+            for (size_t j0 = 0; j0 < n; j0 += BLOCK) {
+                T block_max = max_row(x + j0, std::min(BLOCK, n - j0));
+                if (block_max > best || (best_block == n && block_max == best)) {
+                    best = block_max;
+                    best_block = j0;
+                }
+            }
+
+            if (best_block == n)
+                return n;
+            for (size_t j = best_block; j < n; j++) {
+                if (x[j] == best)
+                    return j;
+            }
+            return n;
+        }
+
+        /**
+        * out[0..n) = softmax(x[0..n)); out may alias x.
+        */
+        template <typename T>
+        inline void softmax_row(const T* x, T* out, size_t n) {
+            T max_val = max_row(x, n);
+
+            T sum = 0;
+            #pragma omp simd reduction(+:sum)
+            for (size_t j = 0; j < n; j++) {
+                out[j] = fast_exp(x[j] - max_val);
+                sum += out[j];
+            }
+
+            T inv_sum = T(1) / sum;
+            #pragma omp simd
+            for (size_t j = 0; j < n; j++)
+                out[j] *= inv_sum;
+        }
+
+        /**
+        * out[0..n) = x / rms(x) * weight with rms(x) = sqrt(mean(x^2) + eps); out may alias x.
+        */
+        template <typename T>
+        inline void rmsnorm_row(const T* x, const T* __restrict__ weight, T* out, size_t n, T eps) {
+            T sum_sq = 0;
+            #pragma omp simd reduction(+:sum_sq)
+            for (size_t j = 0; j < n; j++)
+                sum_sq += x[j] * x[j];
+
+            T inv_rms = fast_rsqrt(sum_sq / T(n) + eps);
+            #pragma omp simd
+            for (size_t j = 0; j < n; j++)
+                out[j] = x[j] * inv_rms * weight[j];
+        }
+
+        // out[0..n) = silu(x[0..n)); out may alias x
+        template <typename T>
+        inline void silu_row(const T* x, T* out, size_t n) {
+            #pragma omp simd
+            for (size_t j = 0; j < n; j++)
+                out[j] = fast_silu(x[j]);
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include "../src/nn/attention.h"
+
+using namespace blass;
+
+namespace {
+    // softmax(q k^T / sqrt(d)) v one query row at a time, with query i at position past_len + i
+    Tensor<float> reference_attention(const Tensor<float>& q, const Tensor<float>& k, const Tensor<float>& v, size_t past_len) {
+        size_t batch_size = q.get_shape(0);
+        size_t seq_len = q.get_shape(1);
+        size_t n_heads = q.get_shape(2);
+        size_t head_dim = q.get_shape(3);
+        size_t group = n_heads / k.get_shape(2);
+
+        Tensor<float> out = Tensor<float>::from_shape({batch_size, seq_len, n_heads, head_dim});
+        for (size_t b = 0; b < batch_size; b++) {
+            for (size_t i = 0; i < seq_len; i++) {
+                for (size_t h = 0; h < n_heads; h++) {
+                    size_t n_keys = past_len + i + 1;
+                    std::vector<double> scores(n_keys);
+                    double max_score = -1e300;
+                    for (size_t j = 0; j < n_keys; j++) {
+                        double dot = 0;
+                        for (size_t d = 0; d < head_dim; d++)
+                            dot += (double)q(b, i, h, d) * k(b, j, h / group, d);
+                        scores[j] = dot / std::sqrt((double)head_dim);
+                        max_score = std::max(max_score, scores[j]);
+                    }
+
+                    double sum = 0;
+                    for (double& s : scores) {
+                        s = std::exp(s - max_score);
+                        sum += s;
+                    }
+                    for (size_t d = 0; d < head_dim; d++) {
+                        double acc = 0;
+                        for (size_t j = 0; j < n_keys; j++)
+                            acc += scores[j] * v(b, j, h / group, d);
+                        out(b, i, h, d) = acc / sum;
+                    }
+                }
+            }
+        }
+        return out;
+    }
+
+    void expect_close(const Tensor<float>& result, const Tensor<float>& expected) {
+        ASSERT_EQ(result.get_shape(), expected.get_shape());
+        Tensor<float> r = result.contiguous();
+        Tensor<float> e = expected.contiguous();
+        for (size_t i = 0; i < r.size(); i++)
+            EXPECT_NEAR(r.get_data()[i], e.get_data()[i], 1e-5f) << " at flat index " << i;
+    }
+}
+
+TEST(AttentionTest, FusedMatchesReference) {
+    // 37 queries end in a partial tile, 70 cached positions span two key tiles before them
+    for (size_t past_len : {0, 70}) {
+        size_t seq_len = 37;
+        Tensor<float> q = Tensor<float>::rand({2, seq_len, 3, 64}, -1.0f, 1.0f);
+        Tensor<float> k = Tensor<float>::rand({2, past_len + seq_len, 3, 64}, -1.0f, 1.0f);
+        Tensor<float> v = Tensor<float>::rand({2, past_len + seq_len, 3, 64}, -1.0f, 1.0f);
+
+        expect_close(nn::functional::causal_attention(q, k, v, past_len), reference_attention(q, k, v, past_len));
+    }
+}
+
+TEST(AttentionTest, FusedGroupedQuery) {
+    // 14 query heads over 2 KV heads, as in Qwen2, with no copy of K/V per head
+    for (size_t past_len : {0, 50}) {
+        size_t seq_len = 19;
+        Tensor<float> q = Tensor<float>::rand({1, seq_len, 14, 64}, -1.0f, 1.0f);
+        Tensor<float> k = Tensor<float>::rand({1, past_len + seq_len, 2, 64}, -1.0f, 1.0f);
+        Tensor<float> v = Tensor<float>::rand({1, past_len + seq_len, 2, 64}, -1.0f, 1.0f);
+
+        expect_close(nn::functional::causal_attention(q, k, v, past_len), reference_attention(q, k, v, past_len));
+    }
+
+    Tensor<float> q = Tensor<float>::rand({1, 4, 6, 16}, -1.0f, 1.0f);
+    Tensor<float> k = Tensor<float>::rand({1, 4, 4, 16}, -1.0f, 1.0f);
+    EXPECT_THROW(nn::functional::causal_attention(q, k, k), std::invalid_argument);
+}
+
+TEST(AttentionTest, FusedReadsStridedKeys) {
+    // keys and values as the KV cache hands them out: a prefix view of a larger buffer
+    nn::KVCache<float> cache(1, 2, 2, 16, 64);
+    Tensor<float> k = Tensor<float>::rand({2, 20, 2, 16}, -1.0f, 1.0f);
+    Tensor<float> v = Tensor<float>::rand({2, 20, 2, 16}, -1.0f, 1.0f);
+    cache.append(0, k, v);
+
+    Tensor<float> q = Tensor<float>::rand({2, 5, 2, 16}, -1.0f, 1.0f);
+    Tensor<float> result = nn::functional::causal_attention(q, cache.get_keys(0, 20), cache.get_values(0, 20), 15);
+    expect_close(result, reference_attention(q, k, v, 15));
+}
+
+TEST(AttentionTest, PagedMatchesReference) {
+    auto pool = std::make_shared<nn::KVBlockPool<float>>(1, 2, 32, 8);
+    nn::PagedKVCache<float> cache(pool);
+    Tensor<float> k = Tensor<float>::rand({1, 29, 2, 32}, -1.0f, 1.0f);
+    Tensor<float> v = Tensor<float>::rand({1, 29, 2, 32}, -1.0f, 1.0f);
+    cache.append(0, k, v);
+
+    // 6 query heads share the 2 KV heads in groups of 3
+    Tensor<float> q = Tensor<float>::rand({1, 4, 6, 32}, -1.0f, 1.0f);
+    expect_close(nn::functional::paged_attention(q, cache, 0, 25), reference_attention(q, k, v, 25));
+}
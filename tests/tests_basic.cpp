@@ -74,4 +74,23 @@ TEST(Basic, View) {
             EXPECT_DOUBLE_EQ(b(i, j), get_value(data, i, j, row)) << " at index (" << i << ", " << j << ") when viewed back";
         }
     }
+}
+
+TEST(Basic, BorrowedStorage) {
+    auto file = std::make_shared<std::vector<float>>(24);
+    for (size_t i = 0; i < 24; ++i)
+        (*file)[i] = (float)i;
+    std::weak_ptr<std::vector<float>> watch = file;
+
+    Tensor<float> a = Tensor<float>::borrow(file->data() + 4, {4, 5}, file);
+    file.reset();
+    EXPECT_EQ(a(1, 2), 11.0f);
+
+    // views keep the owner alive too; nothing is freed until the last one goes
+    Tensor<float> row = a[3];
+    a = Tensor<float>();
+    EXPECT_FALSE(watch.expired());
+    EXPECT_EQ(row(4), 23.0f);
+    row = Tensor<float>();
+    EXPECT_TRUE(watch.expired());
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include "../src/tensor/tensor.h"
+#include "../src/nn/modules.h"
 #include "../src/utils/utils.h"
 
 using namespace blass;
@@ -213,4 +214,92 @@ TEST(ElemwiseTest, AddTensorNonContiguousView2) {
             }
         }
     }
-}
\ No newline at end of file
+}
+
+namespace {
+    // distance in representable floats between a and b
+    int64_t ulp_distance(float a, float b) {
+        auto ordered = [](float x) {
+            int32_t i;
+            std::memcpy(&i, &x, sizeof(i));
+            return i < 0 ? (int64_t)INT32_MIN - i : (int64_t)i;
+        };
+        return std::abs(ordered(a) - ordered(b));
+    }
+}
+
+TEST(ElemwiseTest, VectorMathUlpError) {
+    int64_t worst_exp = 0, worst_silu = 0;
+    // every 4099th bit pattern of the finite floats, i.e. about a million of them
+    for (uint64_t bits = 0; bits < (1ull << 32); bits += 4099) {
+        float x;
+        uint32_t b = (uint32_t)bits;
+        std::memcpy(&x, &b, sizeof(x));
+        if (!std::isfinite(x))
+            continue;
+
+        double e = std::exp((double)x);
+        if (x > -87.3f && x < 88.7f && e >= std::numeric_limits<float>::min())
+            worst_exp = std::max(worst_exp, ulp_distance(kernel::exp_approx(x), (float)e));
+
+        double silu = (double)x / (1.0 + std::exp(-(double)x));
+        if (std::abs(x) < 80.0f && std::abs(silu) >= std::numeric_limits<float>::min())
+            worst_silu = std::max(worst_silu, ulp_distance(kernel::fast_silu(x), (float)silu));
+    }
+    EXPECT_LE(worst_exp, 1);
+    EXPECT_LE(worst_silu, 2);
+
+    EXPECT_EQ(kernel::exp_approx(-std::numeric_limits<float>::infinity()), 0.0f);
+    EXPECT_EQ(kernel::exp_approx(-100.0f), 0.0f);
+    EXPECT_EQ(kernel::exp_approx(100.0f), std::numeric_limits<float>::infinity());
+    EXPECT_TRUE(std::isnan(kernel::exp_approx(std::numeric_limits<float>::quiet_NaN())));
+}
+
+TEST(ElemwiseTest, SoftmaxSiLURMSNorm) {
+    Tensor<float> x = Tensor<float>::rand({5, 37}, -20.0f, 20.0f);
+    // a masked score, as attention produces
+    Tensor<float> scores = x.clone();
+    scores(2, 3) = -std::numeric_limits<float>::infinity();
+
+    nn::SiLU<float> silu;
+    nn::RMSNorm<float> norm(37, 1e-6f);
+
+    Tensor<float> soft = nn::functional::softmax(scores);
+    Tensor<float> act = silu(x);
+    Tensor<float> normed = norm(x);
+
+    for (size_t i = 0; i < 5; i++) {
+        double max_val = -1e300, sum = 0, sum_sq = 0;
+        for (size_t j = 0; j < 37; j++)
+            max_val = std::max(max_val, (double)scores(i, j));
+        for (size_t j = 0; j < 37; j++) {
+            sum += std::exp(scores(i, j) - max_val);
+            sum_sq += (double)x(i, j) * x(i, j);
+        }
+
+        for (size_t j = 0; j < 37; j++) {
+            EXPECT_NEAR(soft(i, j), std::exp(scores(i, j) - max_val) / sum, 1e-6);
+            EXPECT_NEAR(act(i, j), x(i, j) / (1.0 + std::exp(-(double)x(i, j))), 1e-5);
+            EXPECT_NEAR(normed(i, j), x(i, j) / std::sqrt(sum_sq / 37 + 1e-6) * norm.weight(j), 1e-5);
+        }
+    }
+
+    // the in-place and out-parameter forms agree with the allocating ones
+    Tensor<float> in_place = scores.clone();
+    nn::functional::softmax_inplace(in_place);
+    Tensor<float> into;
+    norm.forward(x, into);
+    for (size_t i = 0; i < x.size(); i++) {
+        EXPECT_EQ(in_place.get_data()[i], soft.get_data()[i]);
+        EXPECT_EQ(into.get_data()[i], normed.get_data()[i]);
+    }
+
+    // non-contiguous input
+    Tensor<float> soft_t = nn::functional::softmax(scores.transpose());
+    for (size_t i = 0; i < 37; i++) {
+        double sum = 0;
+        for (size_t j = 0; j < 5; j++)
+            sum += soft_t(i, j);
+        EXPECT_NEAR(sum, 1.0, 1e-5);
+    }
+}
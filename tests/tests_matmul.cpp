@@ -63,4 +63,444 @@ TEST(MatMulTest, MatMulBatchedBroadcasted) {
             }
         }
     }
-}
\ No newline at end of file
+}
+
+TEST(MatMulTest, MatMulBatchedOuterBroadcast) {
+    // both operands broadcast along different batch dimensions, so the batch does not fold into one stride
+    Tensor<double> a = Tensor<double>::fill_random({3, 1, 5, 7}, 0.0, 10.0);
+    Tensor<double> b = Tensor<double>::fill_random({1, 4, 7, 6}, 0.0, 10.0);
+
+    Tensor<double> result = matmul(a, b);
+    ASSERT_EQ(result.get_shape(), std::vector<size_t>({3, 4, 5, 6}));
+
+    for (size_t x = 0; x < 3; ++x) {
+        for (size_t y = 0; y < 4; ++y) {
+            for (size_t i = 0; i < 5; ++i) {
+                for (size_t j = 0; j < 6; ++j) {
+                    double expected_value = 0.0;
+                    for (size_t k = 0; k < 7; ++k) {
+                        expected_value += a(x, 0, i, k) * b(0, y, k, j);
+                    }
+                    EXPECT_NEAR(result(x, y, i, j), expected_value, EPSILON)
+                        << " at index (" << x << ", " << y << ", " << i << ", " << j << ")";
+                }
+            }
+        }
+    }
+}
+
+TEST(MatMulTest, MatMulBatchedTransposedTiles) {
+    // tall products are split into row tiles; B is used through its transposed layout
+    Tensor<double> a = Tensor<double>::fill_random({4, 200, 30}, 0.0, 10.0);
+    Tensor<double> b = Tensor<double>::fill_random({4, 40, 30}, 0.0, 10.0);
+
+    Tensor<double> result = matmul(a, b, true);
+
+    for (size_t batch = 0; batch < 4; ++batch) {
+        for (size_t i = 0; i < 200; ++i) {
+            for (size_t j = 0; j < 40; ++j) {
+                double expected_value = 0.0;
+                for (size_t k = 0; k < 30; ++k) {
+                    expected_value += a(batch, i, k) * b(batch, j, k);
+                }
+                EXPECT_NEAR(result(batch, i, j), expected_value, 1e-8)
+                    << " at index (" << batch << ", " << i << ", " << j << ")";
+            }
+        }
+    }
+}
+
+TEST(MatMulTest, MatMul2DTransposedB) {
+    Tensor<double> a = Tensor<double>::fill_random({37, 45}, 0.0, 10.0);
+    Tensor<double> b = Tensor<double>::fill_random({53, 45}, 0.0, 10.0);
+
+    Tensor<double> result = matmul(a, b, true);
+
+    for (size_t i = 0; i < a.get_shape(0); ++i) {
+        for (size_t j = 0; j < b.get_shape(0); ++j) {
+            double expected_value = 0.0;
+            for (size_t k = 0; k < a.get_shape(1); ++k) {
+                expected_value += a(i, k) * b(j, k);
+            }
+            EXPECT_NEAR(result(i, j), expected_value, EPSILON)
+                << " at index (" << i << ", " << j << ")";
+        }
+    }
+}
+
+TEST(MatMulTest, MatMul2DFloatBlocked) {
+    // spans several MC/KC/NC blocks and leaves partial register tiles on every edge
+    size_t M = 157, K = 531, N = 2085;
+    Tensor<float> a = Tensor<float>::fill_random({M, K}, -1.0f, 1.0f);
+    Tensor<float> b = Tensor<float>::fill_random({K, N}, -1.0f, 1.0f);
+
+    Tensor<float> result = matmul(a, b);
+
+    for (size_t i = 0; i < M; ++i) {
+        for (size_t j = 0; j < N; ++j) {
+            double expected_value = 0.0;
+            for (size_t k = 0; k < K; ++k) {
+                expected_value += (double)a(i, k) * b(k, j);
+            }
+            EXPECT_NEAR(result(i, j), expected_value, 1e-3)
+                << " at index (" << i << ", " << j << ")";
+        }
+    }
+}
+
+TEST(MatMulTest, MatMulPackedMatrix) {
+    Tensor<double> a = Tensor<double>::fill_random({3, 20, 300}, 0.0, 10.0);
+    Tensor<double> w = Tensor<double>::fill_random({90, 300}, 0.0, 10.0);
+
+    PackedMatrix<double> packed = PackedMatrix<double>::from_tensor(w, true);
+    EXPECT_EQ(packed.rows(), 300u);
+    EXPECT_EQ(packed.cols(), 90u);
+
+    Tensor<double> result = matmul(a, packed);
+    ASSERT_EQ(result.get_shape(), std::vector<size_t>({3, 20, 90}));
+
+    for (size_t batch = 0; batch < a.get_shape(0); ++batch) {
+        for (size_t i = 0; i < a.get_shape(1); ++i) {
+            for (size_t j = 0; j < w.get_shape(0); ++j) {
+                double expected_value = 0.0;
+                for (size_t k = 0; k < a.get_shape(2); ++k) {
+                    expected_value += a(batch, i, k) * w(j, k);
+                }
+                EXPECT_NEAR(result(batch, i, j), expected_value, 1e-8)
+                    << " at index (" << batch << ", " << i << ", " << j << ")";
+            }
+        }
+    }
+}
+
+TEST(MatMulTest, MatMulVectorRows) {
+    // few-row activations take the GEMV paths; check plain, transposed and packed weights
+    for (size_t m : {1, 3}) {
+        Tensor<double> x = Tensor<double>::fill_random({m, 257}, 0.0, 10.0);
+        Tensor<double> w = Tensor<double>::fill_random({75, 257}, 0.0, 10.0);
+        Tensor<double> w_t = w.transpose();
+
+        Tensor<double> result_t = matmul(x, w, true);
+        Tensor<double> result = matmul(x, w_t);
+        Tensor<double> result_packed = matmul(x, PackedMatrix<double>::from_tensor(w, true));
+
+        for (size_t i = 0; i < m; ++i) {
+            for (size_t j = 0; j < w.get_shape(0); ++j) {
+                double expected_value = 0.0;
+                for (size_t k = 0; k < x.get_shape(1); ++k) {
+                    expected_value += x(i, k) * w(j, k);
+                }
+                EXPECT_NEAR(result_t(i, j), expected_value, 1e-8) << " at index (" << i << ", " << j << ")";
+                EXPECT_NEAR(result(i, j), expected_value, 1e-8) << " at index (" << i << ", " << j << ")";
+                EXPECT_NEAR(result_packed(i, j), expected_value, 1e-8) << " at index (" << i << ", " << j << ")";
+            }
+        }
+    }
+}
+
+TEST(MatMulTest, MatMulSkinnyShapes) {
+    // huge k with a handful of outputs goes through split-K, k == 1 through the outer product
+    Tensor<double> a = Tensor<double>::fill_random({2, 50000}, 0.0, 1.0);
+    Tensor<double> b = Tensor<double>::fill_random({3, 50000}, 0.0, 1.0);
+
+    Tensor<double> result_t = matmul(a, b, true);
+    Tensor<double> result = matmul(a, b.transpose());
+
+    for (size_t i = 0; i < 2; ++i) {
+        for (size_t j = 0; j < 3; ++j) {
+            double expected_value = 0.0;
+            for (size_t k = 0; k < a.get_shape(1); ++k) {
+                expected_value += a(i, k) * b(j, k);
+            }
+            EXPECT_NEAR(result_t(i, j), expected_value, 1e-6) << " at index (" << i << ", " << j << ")";
+            EXPECT_NEAR(result(i, j), expected_value, 1e-6) << " at index (" << i << ", " << j << ")";
+        }
+    }
+
+    Tensor<double> u = Tensor<double>::fill_random({300, 1}, 0.0, 10.0);
+    Tensor<double> v = Tensor<double>::fill_random({1, 211}, 0.0, 10.0);
+
+    Tensor<double> outer = matmul(u, v);
+    Tensor<double> outer_t = matmul(u, v.transpose(), true);
+
+    for (size_t i = 0; i < 300; ++i) {
+        for (size_t j = 0; j < 211; ++j) {
+            EXPECT_NEAR(outer(i, j), u(i, 0) * v(0, j), EPSILON) << " at index (" << i << ", " << j << ")";
+            EXPECT_NEAR(outer_t(i, j), u(i, 0) * v(0, j), EPSILON) << " at index (" << i << ", " << j << ")";
+        }
+    }
+}
+
+TEST(MatMulTest, GemmAlphaBetaTransposes) {
+    // every transA/transB combination on shapes that hit the GEMV and packed paths, accumulating into C
+    for (size_t m : {3, 37}) {
+        size_t n = 29, k = 41;
+        for (bool trans_a : {false, true}) {
+            for (bool trans_b : {false, true}) {
+                Tensor<double> a = Tensor<double>::fill_random({trans_a ? k : m, trans_a ? m : k}, -1.0, 1.0);
+                Tensor<double> b = Tensor<double>::fill_random({trans_b ? n : k, trans_b ? k : n}, -1.0, 1.0);
+                Tensor<double> c = Tensor<double>::fill_random({m, n}, -1.0, 1.0);
+                Tensor<double> c_initial = c.clone();
+
+                gemm(trans_a, trans_b, m, n, k, 0.5, a.get_data(), a.get_shape(1),
+                     b.get_data(), b.get_shape(1), 2.0, c.get_data(), n);
+
+                for (size_t i = 0; i < m; ++i) {
+                    for (size_t j = 0; j < n; ++j) {
+                        double expected_value = 0.0;
+                        for (size_t p = 0; p < k; ++p) {
+                            expected_value += (trans_a ? a(p, i) : a(i, p)) * (trans_b ? b(j, p) : b(p, j));
+                        }
+                        expected_value = 0.5 * expected_value + 2.0 * c_initial(i, j);
+                        EXPECT_NEAR(c(i, j), expected_value, 1e-9)
+                            << " at index (" << i << ", " << j << ") with m = " << m << ", trans_a = " << trans_a << ", trans_b = " << trans_b;
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(MatMulTest, GemmInPlaceResidual) {
+    // strided views in, fused residual add (beta = 1) out, for plain and packed weights
+    for (size_t m : {2, 20}) {
+        Tensor<double> x_storage = Tensor<double>::fill_random({64, m}, 0.0, 1.0);
+        Tensor<double> x(x_storage.get_data_ptr(), {m, 64}, {1, m});
+        Tensor<double> w = Tensor<double>::fill_random({48, 64}, 0.0, 1.0);
+        Tensor<double> residual = Tensor<double>::fill_random({m, 48}, 0.0, 1.0);
+
+        Tensor<double> out = residual.clone();
+        gemm(x, w, out, 1.0, 1.0, true);
+
+        Tensor<double> out_packed = residual.clone();
+        gemm(x, PackedMatrix<double>::from_tensor(w, true), out_packed, 1.0, 1.0);
+
+        for (size_t i = 0; i < m; ++i) {
+            for (size_t j = 0; j < 48; ++j) {
+                double expected_value = residual(i, j);
+                for (size_t k = 0; k < 64; ++k) {
+                    expected_value += x(i, k) * w(j, k);
+                }
+                EXPECT_NEAR(out(i, j), expected_value, 1e-9) << " at index (" << i << ", " << j << ")";
+                EXPECT_NEAR(out_packed(i, j), expected_value, 1e-9) << " at index (" << i << ", " << j << ")";
+            }
+        }
+    }
+}
+
+TEST(MatMulTest, GemmFusedEpilogue) {
+    // act(x W + bias) * mul + residual, through the tiled GEMM (m = 37) and the GEMV paths (m = 2)
+    for (size_t m : {2, 37}) {
+        for (kernel::activation act : {kernel::activation::silu, kernel::activation::gelu}) {
+            Tensor<double> x = Tensor<double>::fill_random({m, 45}, -1.0, 1.0);
+            Tensor<double> w = Tensor<double>::fill_random({70, 45}, -1.0, 1.0);
+            Tensor<double> bias = Tensor<double>::fill_random({70}, -1.0, 1.0);
+            Tensor<double> mul = Tensor<double>::fill_random({m, 70}, -1.0, 1.0);
+            Tensor<double> residual = Tensor<double>::fill_random({m, 70}, -1.0, 1.0);
+
+            Epilogue<double> epi{.bias = bias, .act = act, .mul = mul, .residual = residual};
+
+            Tensor<double> out = Tensor<double>::from_shape({m, 70});
+            gemm(x, w, out, 1.0, 0.0, true, epi);
+            Tensor<double> out_packed = matmul(x, PackedMatrix<double>::from_tensor(w, true), epi);
+
+            for (size_t i = 0; i < m; ++i) {
+                for (size_t j = 0; j < 70; ++j) {
+                    double v = bias(j);
+                    for (size_t k = 0; k < 45; ++k) {
+                        v += x(i, k) * w(j, k);
+                    }
+                    if (act == kernel::activation::silu)
+                        v = v / (1.0 + std::exp(-v));
+                    else
+                        v = 0.5 * v * (1.0 + std::tanh(std::sqrt(2.0 / M_PI) * (v + 0.044715 * v * v * v)));
+                    double expected_value = v * mul(i, j) + residual(i, j);
+
+                    EXPECT_NEAR(out(i, j), expected_value, 1e-9) << " at index (" << i << ", " << j << ")";
+                    EXPECT_NEAR(out_packed(i, j), expected_value, 1e-9) << " at index (" << i << ", " << j << ")";
+                }
+            }
+        }
+    }
+}
+
+TEST(MatMulTest, MatMulQuantized) {
+    // the tiled path (m = 37) only dequantizes the weight, the GEMV path (m = 2) also
+    // quantizes the activations to 8 bits, so it is checked against a looser bound
+    for (kernel::quant_type type : {kernel::quant_type::q8_0, kernel::quant_type::q4_0, kernel::quant_type::q4_K}) {
+        Tensor<float> w = Tensor<float>::fill_random({70, 512}, -1.0f, 1.0f);
+        QuantizedMatrix q = QuantizedMatrix::quantize(w, type);
+        EXPECT_EQ(q.rows(), 512u);
+        EXPECT_EQ(q.cols(), 70u);
+
+        Tensor<float> w_dq = q.dequantize();
+        float max_err = type == kernel::quant_type::q8_0 ? 0.01f : 0.15f;
+        for (size_t j = 0; j < 70; ++j) {
+            for (size_t k = 0; k < 512; ++k) {
+                ASSERT_NEAR(w_dq(j, k), w(j, k), max_err) << " at index (" << j << ", " << k << ")";
+            }
+        }
+
+        for (size_t m : {2, 37}) {
+            Tensor<float> x = Tensor<float>::fill_random({m, 512}, -1.0f, 1.0f);
+            Tensor<float> bias = Tensor<float>::fill_random({70}, -1.0f, 1.0f);
+            Tensor<float> result = matmul(x, q, Epilogue<float>{.bias = bias});
+
+            for (size_t i = 0; i < m; ++i) {
+                for (size_t j = 0; j < 70; ++j) {
+                    double expected_value = bias(j);
+                    double magnitude = 0.0;
+                    for (size_t k = 0; k < 512; ++k) {
+                        expected_value += (double)x(i, k) * w_dq(j, k);
+                        magnitude += std::fabs(x(i, k) * w_dq(j, k));
+                    }
+                    double tolerance = m <= kernel::GEMV_MAX_ROWS ? 0.01 * magnitude : 1e-4 * magnitude;
+                    EXPECT_NEAR(result(i, j), expected_value, tolerance) << " at index (" << i << ", " << j << ")";
+                }
+            }
+        }
+    }
+}
+
+TEST(MatMulTest, QuantizedBorrowsBlocksInPlace) {
+    Tensor<float> w = Tensor<float>::fill_random({70, 512}, -1.0f, 1.0f);
+    QuantizedMatrix copied = QuantizedMatrix::quantize(w, kernel::quant_type::q8_0);
+
+    // stands in for a file mapping: alive exactly as long as something borrows from it
+    auto file = std::make_shared<std::vector<uint8_t>>(copied.get_data(), copied.get_data() + 70 * copied.row_bytes());
+    std::weak_ptr<std::vector<uint8_t>> watch = file;
+    QuantizedMatrix borrowed = QuantizedMatrix::borrow(kernel::quant_type::q8_0, 70, 512, file->data(), file);
+    EXPECT_EQ(borrowed.get_data(), file->data());
+    file.reset();
+    EXPECT_FALSE(watch.expired());
+
+    Tensor<float> x = Tensor<float>::fill_random({37, 512}, -1.0f, 1.0f);
+    Tensor<float> expected = matmul(x, copied);
+    Tensor<float> result = matmul(x, borrowed);
+    for (size_t i = 0; i < 37; ++i) {
+        for (size_t j = 0; j < 70; ++j)
+            EXPECT_FLOAT_EQ(result(i, j), expected(i, j)) << " at index (" << i << ", " << j << ")";
+    }
+
+    borrowed = QuantizedMatrix();
+    EXPECT_TRUE(watch.expired());
+}
+
+TEST(MatMulTest, MatMulHalfPrecisionWeights) {
+    // F16/BF16 storage is widened inside the kernels; compare against the rounded weights
+    // through the GEMV (m = 3) and the tiled (m = 37) paths, with a K tail past one KC slice
+    Tensor<float> w = Tensor<float>::fill_random({70, 300}, -1.0f, 1.0f);
+    auto w_f16 = PackedMatrix<float, kernel::f16>::from_tensor(w, true);
+    auto w_bf16 = PackedMatrix<float, kernel::bf16>::from_tensor(w, true);
+
+    std::vector<float> column(300);
+    w_bf16.unpack_column(45, column.data());
+    for (size_t k = 0; k < 300; ++k) {
+        EXPECT_EQ(column[k], kernel::bf16_to_fp32(kernel::fp32_to_bf16(w(45, k)))) << " at index " << k;
+    }
+
+    for (size_t m : {3, 37}) {
+        Tensor<float> x = Tensor<float>::fill_random({m, 300}, -1.0f, 1.0f);
+        Tensor<float> result_f16 = matmul(x, w_f16);
+        Tensor<float> result_bf16 = matmul(x, w_bf16);
+
+        for (size_t i = 0; i < m; ++i) {
+            for (size_t j = 0; j < 70; ++j) {
+                double expected_f16 = 0.0, expected_bf16 = 0.0;
+                for (size_t k = 0; k < 300; ++k) {
+                    expected_f16 += (double)x(i, k) * kernel::fp16_to_fp32(kernel::fp32_to_fp16(w(j, k)));
+                    expected_bf16 += (double)x(i, k) * kernel::bf16_to_fp32(kernel::fp32_to_bf16(w(j, k)));
+                }
+                EXPECT_NEAR(result_f16(i, j), expected_f16, 1e-4) << " at index (" << i << ", " << j << ")";
+                EXPECT_NEAR(result_bf16(i, j), expected_bf16, 1e-4) << " at index (" << i << ", " << j << ")";
+            }
+        }
+    }
+}
+
+TEST(MatMulTest, KernelVariantsAgree) {
+    // every variant the CPU supports must reproduce the generic kernels on the packed GEMM,
+    // GEMV, half-precision and quantized paths; results differ only by summation order
+    kernel::isa saved = kernel::active_isa();
+    Tensor<float> w = Tensor<float>::fill_random({70, 300}, -1.0f, 1.0f);
+    auto w_q = QuantizedMatrix::quantize(Tensor<float>::fill_random({70, 512}, -1.0f, 1.0f), kernel::quant_type::q4_K);
+    std::vector<Tensor<float>> xs, xs_q;
+    for (size_t m : {2, 37}) {
+        xs.push_back(Tensor<float>::fill_random({m, 300}, -1.0f, 1.0f));
+        xs_q.push_back(Tensor<float>::fill_random({m, 512}, -1.0f, 1.0f));
+    }
+
+    auto run = [&] {
+        std::vector<Tensor<float>> out;
+        for (size_t t = 0; t < xs.size(); ++t) {
+            size_t m = xs[t].get_shape(0);
+            Tensor<float> c = Tensor<float>::from_shape({m, 70});
+            gemm(false, true, m, 70, 300, 1.0f, xs[t].get_data(), 300, w.get_data(), 300, 0.0f, c.get_data(), 70);
+            out.push_back(c);
+            out.push_back(matmul(xs[t], PackedMatrix<float, kernel::f16>::from_tensor(w, true)));
+            out.push_back(matmul(xs_q[t], w_q));
+        }
+        return out;
+    };
+
+    kernel::set_isa(kernel::isa::generic);
+    std::vector<Tensor<float>> expected = run();
+
+    for (kernel::isa target : {kernel::isa::sse42, kernel::isa::avx2, kernel::isa::avx512}) {
+        if (target > kernel::detect_isa())
+            continue;
+        kernel::set_isa(target);
+        std::vector<Tensor<float>> result = run();
+        for (size_t r = 0; r < result.size(); ++r) {
+            for (size_t i = 0; i < result[r].size(); ++i) {
+                EXPECT_NEAR(result[r].get_data()[i], expected[r].get_data()[i], 1e-3)
+                    << kernel::isa_name(target) << " result " << r << " at index " << i;
+            }
+        }
+    }
+    kernel::set_isa(saved);
+
+#if defined(BLASS_X86)
+    // the SSE path widens half floats without F16C: check every bit pattern
+    alignas(16) kernel::f16 h[4];
+    alignas(16) float wide[4];
+    for (uint32_t bits = 0; bits < 0x10000; bits += 4) {
+        for (uint32_t l = 0; l < 4; ++l)
+            h[l].bits = bits + l;
+        _mm_store_ps(wide, kernel::load_b_sse(h));
+        for (uint32_t l = 0; l < 4; ++l) {
+            float ref = kernel::fp16_to_fp32(bits + l);
+            if (std::isnan(ref))
+                EXPECT_TRUE(std::isnan(wide[l])) << " for half bits " << bits + l;
+            else
+                EXPECT_EQ(wide[l], ref) << " for half bits " << bits + l;
+        }
+    }
+#endif
+}
+
+TEST(MatMulTest, HalfRowConversion) {
+    // every bit pattern, with a length that leaves a tail after the 8-wide F16C steps
+    std::vector<uint16_t> h(0x10000 + 5);
+    for (size_t i = 0; i < h.size(); ++i)
+        h[i] = (uint16_t)i;
+
+    kernel::isa saved = kernel::active_isa();
+    for (kernel::isa target : {kernel::isa::generic, saved}) {
+        kernel::set_isa(target);
+        std::vector<float> wide(h.size());
+        kernel::fp16_to_fp32_row(h.data(), wide.data(), h.size());
+        for (size_t i = 0; i < h.size(); ++i) {
+            float ref = kernel::fp16_to_fp32(h[i]);
+            if (std::isnan(ref))
+                EXPECT_TRUE(std::isnan(wide[i])) << kernel::isa_name(target) << " for half bits " << h[i];
+            else
+                EXPECT_EQ(wide[i], ref) << kernel::isa_name(target) << " for half bits " << h[i];
+        }
+
+        kernel::bf16_to_fp32_row(h.data(), wide.data(), h.size());
+        for (size_t i = 0; i < h.size(); ++i)
+            EXPECT_EQ(std::bit_cast<uint32_t>(wide[i]), std::bit_cast<uint32_t>(kernel::bf16_to_fp32(h[i])));
+    }
+    kernel::set_isa(saved);
+}
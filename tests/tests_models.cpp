@@ -0,0 +1,659 @@
+#include <gtest/gtest.h>
+#include "../src/nn/models.h"
+#include "../src/nn/scheduler.h"
+
+using namespace blass;
+
+namespace {
+    // a Qwen2-0.5B shaped block with small random F32 weights
+    std::shared_ptr<models::Qwen2Block> random_block() {
+        auto block = std::make_shared<models::Qwen2Block>();
+        std::vector<std::pair<std::string, std::vector<uint64_t>>> params = {
+            {"attn_q.weight", {896, 896}}, {"attn_q.bias", {896}},
+            {"attn_k.weight", {128, 896}}, {"attn_k.bias", {128}},
+            {"attn_v.weight", {128, 896}}, {"attn_v.bias", {128}},
+            {"attn_output.weight", {896, 896}},
+            {"ffn_gate.weight", {4864, 896}}, {"ffn_up.weight", {4864, 896}},
+            {"ffn_down.weight", {896, 4864}},
+        };
+
+        for (auto& [name, dims] : params) {
+            std::vector<size_t> shape(dims.begin(), dims.end());
+            Tensor<float> w = Tensor<float>::rand(shape, -0.06f, 0.06f);
+            gguf_loader::tensor_data data{gguf_loader::GGML_TYPE_F32, dims, 0, w.get_data()};
+            block->init_param(name, data);
+        }
+        return block;
+    }
+
+    // little-endian GGUF pieces appended to a byte buffer
+    struct GGUFBytes {
+        std::string bytes;
+
+        template <typename T>
+        GGUFBytes& put(T value) {
+            bytes.append((const char*)&value, sizeof(T));
+            return *this;
+        }
+
+        GGUFBytes& put_string(const std::string& s) {
+            put<uint64_t>(s.size());
+            bytes += s;
+            return *this;
+        }
+
+        GGUFBytes& key(const std::string& name, gguf_loader::gguf_metadata_value_type type) {
+            put_string(name);
+            return put<uint32_t>(type);
+        }
+    };
+
+    // a file in the test temp dir, removed however the test leaves its scope
+    struct TempFile {
+        std::string path;
+
+        explicit TempFile(const std::string& name) : path(::testing::TempDir() + name) {}
+
+        ~TempFile() {
+            std::remove(path.c_str());
+        }
+    };
+
+    struct SparseTensor {
+        std::string name;
+        // GGUF order, innermost dimension first
+        std::vector<uint64_t> dims;
+        // of the data from the start of the data section
+        uint64_t offset;
+    };
+
+    /**
+    * Writes a GGUF of F32 tensors whose data section is a hole except for the patches
+    * (data section offset, values), so a file of many GiB takes no disk space. Returns
+    * false when the filesystem cannot hold a file that large.
+    */
+    bool write_sparse_gguf(const std::string& path, const std::vector<SparseTensor>& tensors,
+                           const std::vector<std::pair<uint64_t, std::vector<float>>>& patches) {
+        GGUFBytes f;
+        f.bytes = "GGUF";
+        f.put<uint32_t>(3).put<uint64_t>(tensors.size()).put<uint64_t>(0);
+        uint64_t data_bytes = 0;
+        for (const SparseTensor& t : tensors) {
+            f.put_string(t.name).put<uint32_t>(t.dims.size());
+            uint64_t elems = 1;
+            for (uint64_t d : t.dims) {
+                f.put<uint64_t>(d);
+                elems *= d;
+            }
+            f.put<uint32_t>(gguf_loader::GGML_TYPE_F32).put<uint64_t>(t.offset);
+            data_bytes = std::max(data_bytes, t.offset + elems * sizeof(float));
+        }
+        f.bytes.resize((f.bytes.size() + 31) / 32 * 32);
+        uint64_t data_start = f.bytes.size();
+
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1)
+            return false;
+        bool ok = pwrite(fd, f.bytes.data(), f.bytes.size(), 0) == (ssize_t)f.bytes.size() &&
+                  ftruncate(fd, data_start + data_bytes) == 0;
+        for (const auto& [offset, values] : patches) {
+            size_t bytes = values.size() * sizeof(float);
+            ok = ok && pwrite(fd, values.data(), bytes, data_start + offset) == (ssize_t)bytes;
+        }
+        close(fd);
+        return ok;
+    }
+
+    // positions [begin, end) of a [1, seq, hidden] tensor
+    Tensor<float> positions(const Tensor<float>& x, size_t begin, size_t end) {
+        size_t hidden = x.get_shape(2);
+        Tensor<float> out = Tensor<float>::from_shape({1, end - begin, hidden});
+        std::memcpy(out.get_data(), x.get_data() + begin * hidden, (end - begin) * hidden * sizeof(float));
+        return out;
+    }
+
+    /**
+    * A Qwen2Model with random weights, a vocab-token embedding and narrow 64-wide FFNs,
+    * small enough to generate with in a test. Matrices are F16 so that batched and
+    * single-token passes differ only in summation order; the embedding is small next to
+    * what the blocks add, so greedy decoding does not just repeat the last token.
+    */
+    std::unique_ptr<models::Qwen2Model> random_model(size_t vocab) {
+        auto model = std::make_unique<models::Qwen2Model>();
+        auto load = [&](const std::string& name, const Tensor<float>& w) {
+            std::vector<uint64_t> dims(w.get_shape().begin(), w.get_shape().end());
+            gguf_loader::tensor_data data{gguf_loader::GGML_TYPE_F32, dims, 0, (void*)w.get_data()};
+            std::vector<kernel::f16> half;
+            if (dims.size() == 2) {
+                for (size_t i = 0; i < w.size(); i++)
+                    half.push_back(kernel::convert_to<kernel::f16>(w.get_data()[i]));
+                data.type = gguf_loader::GGML_TYPE_F16;
+                data.data = half.data();
+            }
+            model->load_param(name, data);
+        };
+
+        load("token_embd.weight", Tensor<float>::rand({vocab, 896}, -0.05f, 0.05f));
+        load("output_norm.weight", Tensor<float>::fill({896}, 1.0f));
+        std::vector<std::pair<std::string, std::vector<size_t>>> params = {
+            {"attn_q.weight", {896, 896}}, {"attn_q.bias", {896}},
+            {"attn_k.weight", {128, 896}}, {"attn_k.bias", {128}},
+            {"attn_v.weight", {128, 896}}, {"attn_v.bias", {128}},
+            {"attn_output.weight", {896, 896}},
+            {"ffn_gate.weight", {64, 896}}, {"ffn_up.weight", {64, 896}},
+            {"ffn_down.weight", {896, 64}},
+        };
+        for (int i = 0; i < 24; i++) {
+            std::string prefix = "blk." + std::to_string(i) + ".";
+            load(prefix + "attn_norm.weight", Tensor<float>::fill({896}, 1.0f));
+            load(prefix + "ffn_norm.weight", Tensor<float>::fill({896}, 1.0f));
+            for (auto& [name, shape] : params)
+                load(prefix + name, Tensor<float>::rand(shape, -0.15f, 0.15f));
+        }
+        return model;
+    }
+}
+
+TEST(KVCacheTest, AppendGrowsAndKeepsHistory) {
+    nn::KVCache<float> cache(2, 2, 3, 4);
+    EXPECT_EQ(cache.size(), 0u);
+
+    // 40 single-position steps force several reallocations
+    for (size_t step = 0; step < 40; step++) {
+        for (size_t layer = 0; layer < 2; layer++) {
+            Tensor<float> k = Tensor<float>::fill({2, 1, 3, 4}, float(step * 10 + layer));
+            Tensor<float> v = Tensor<float>::fill({2, 1, 3, 4}, -float(step * 10 + layer));
+            cache.append(layer, k, v);
+        }
+        cache.advance(1);
+    }
+    EXPECT_EQ(cache.size(), 40u);
+    EXPECT_GE(cache.get_capacity(), 40u);
+
+    Tensor<float> keys = cache.get_keys(1, 40);
+    Tensor<float> values = cache.get_values(1, 40);
+    ASSERT_EQ(keys.get_shape(), (std::vector<size_t>{2, 40, 3, 4}));
+    for (size_t b = 0; b < 2; b++) {
+        for (size_t s = 0; s < 40; s++) {
+            EXPECT_EQ(keys(b, s, 2, 3), float(s * 10 + 1)) << " at batch " << b << ", position " << s;
+            EXPECT_EQ(values(b, s, 0, 0), -float(s * 10 + 1)) << " at batch " << b << ", position " << s;
+        }
+    }
+
+    cache.clear();
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_THROW(cache.append(0, Tensor<float>::from_shape({2, 1, 3, 5}), Tensor<float>::from_shape({2, 1, 3, 5})),
+                 std::invalid_argument);
+}
+
+TEST(Qwen2Test, IncrementalDecodeMatchesFullSequence) {
+    auto block = random_block();
+    size_t seq_len = 7;
+    size_t prompt_len = 4;
+    Tensor<float> input = Tensor<float>::rand({1, seq_len, 896}, -1.0f, 1.0f);
+
+    Tensor<float> expected = block->forward(input);
+
+    nn::KVCache<float> cache(1, 1, 2, 64);
+    std::vector<Tensor<float>> steps;
+    steps.push_back(block->forward(positions(input, 0, prompt_len), cache, 0));
+    cache.advance(prompt_len);
+    for (size_t s = prompt_len; s < seq_len; s++) {
+        steps.push_back(block->forward(positions(input, s, s + 1), cache, 0));
+        cache.advance(1);
+    }
+    EXPECT_EQ(cache.size(), seq_len);
+
+    size_t s = 0;
+    for (const Tensor<float>& step : steps) {
+        for (size_t i = 0; i < step.get_shape(1); i++, s++) {
+            for (size_t j = 0; j < 896; j++) {
+                EXPECT_NEAR(step(0, i, j), expected(0, s, j), 1e-3f) << " at position " << s << ", channel " << j;
+            }
+        }
+    }
+}
+
+TEST(KVCacheTest, PagedCacheTakesAndReturnsBlocks) {
+    auto pool = std::make_shared<nn::KVBlockPool<float>>(2, 3, 4, 8, 5);
+    {
+        nn::PagedKVCache<float> a(pool);
+        nn::PagedKVCache<float> b(pool);
+
+        // 13 positions of a span two blocks, the 3 of b take one
+        for (size_t layer = 0; layer < 2; layer++) {
+            Tensor<float> k = Tensor<float>::rand({1, 13, 3, 4}, -1.0f, 1.0f);
+            a.append(layer, k, k * 2.0f);
+            b.append(layer, Tensor<float>::fill({1, 3, 3, 4}, 1.0f), Tensor<float>::fill({1, 3, 3, 4}, 2.0f));
+
+            // position 9 sits in slot 1 of the second block
+            const float* stored = pool->keys(a.get_block_table()[1], layer) + 1 * 12;
+            for (size_t j = 0; j < 12; j++)
+                EXPECT_EQ(stored[j], k.get_data()[9 * 12 + j]);
+        }
+        a.advance(13);
+        b.advance(3);
+        EXPECT_EQ(a.get_block_table().size(), 2u);
+        EXPECT_EQ(pool->blocks_in_use(), 3u);
+
+        // 3 + 6 positions need a second block for b
+        Tensor<float> more = Tensor<float>::fill({1, 6, 3, 4}, 3.0f);
+        b.append(0, more, more);
+        EXPECT_EQ(pool->blocks_in_use(), 4u);
+
+        a.clear();
+        EXPECT_EQ(pool->blocks_in_use(), 2u);
+
+        Tensor<float> too_many = Tensor<float>::fill({1, 48, 3, 4}, 0.0f);
+        EXPECT_THROW(a.append(0, too_many, too_many), std::runtime_error);
+    }
+    // caches hand their blocks back when they go away, and the pool recycles them
+    EXPECT_EQ(pool->blocks_in_use(), 0u);
+    EXPECT_EQ(pool->blocks_allocated(), 5u);
+}
+
+TEST(Qwen2Test, PagedDecodeMatchesFullSequence) {
+    auto block = random_block();
+    size_t seq_len = 21;
+    size_t prompt_len = 9;
+    Tensor<float> input = Tensor<float>::rand({1, seq_len, 896}, -1.0f, 1.0f);
+
+    Tensor<float> expected = block->forward(input);
+
+    // 4-position blocks so the sequence spans several of them
+    auto pool = std::make_shared<nn::KVBlockPool<float>>(1, 2, 64, 4);
+    nn::PagedKVCache<float> cache(pool);
+    std::vector<Tensor<float>> steps;
+    steps.push_back(block->forward(positions(input, 0, prompt_len), cache, 0));
+    cache.advance(prompt_len);
+    for (size_t s = prompt_len; s < seq_len; s++) {
+        steps.push_back(block->forward(positions(input, s, s + 1), cache, 0));
+        cache.advance(1);
+    }
+    EXPECT_EQ(pool->blocks_in_use(), 6u);
+
+    size_t s = 0;
+    for (const Tensor<float>& step : steps) {
+        for (size_t i = 0; i < step.get_shape(1); i++, s++) {
+            for (size_t j = 0; j < 896; j++) {
+                EXPECT_NEAR(step(0, i, j), expected(0, s, j), 1e-3f) << " at position " << s << ", channel " << j;
+            }
+        }
+    }
+}
+
+TEST(Qwen2Test, BatchedStepMatchesSeparateSequences) {
+    auto block = random_block();
+    auto pool = std::make_shared<nn::KVBlockPool<float>>(1, 2, 64, 4);
+    Tensor<float> a = Tensor<float>::rand({1, 7, 896}, -1.0f, 1.0f);
+    Tensor<float> b = Tensor<float>::rand({1, 10, 896}, -1.0f, 1.0f);
+
+    // a has a 6-token history and decodes one token, b has 5 and runs 5 more at once
+    nn::PagedKVCache<float> a_kv(pool), b_kv(pool);
+    block->forward(positions(a, 0, 6), a_kv, 0);
+    a_kv.advance(6);
+    block->forward(positions(b, 0, 5), b_kv, 0);
+    b_kv.advance(5);
+
+    nn::PagedBatch<float> batch;
+    batch.add(a_kv, 1);
+    batch.add(b_kv, 5);
+    EXPECT_EQ(batch.positions(), (std::vector<size_t>{6, 5, 6, 7, 8, 9}));
+    Tensor<float> input = Tensor<float>::from_shape({1, 6, 896});
+    std::memcpy(input.get_data(), a.get_data() + 6 * 896, 896 * sizeof(float));
+    std::memcpy(input.get_data() + 896, b.get_data() + 5 * 896, 5 * 896 * sizeof(float));
+    Tensor<float> batched = block->forward(input, batch, 0);
+    batch.advance(6);
+    EXPECT_EQ(a_kv.size(), 7u);
+    EXPECT_EQ(b_kv.size(), 10u);
+
+    Tensor<float> a_expected = block->forward(a);
+    Tensor<float> b_expected = block->forward(b);
+    for (size_t j = 0; j < 896; j++) {
+        EXPECT_NEAR(batched(0, 0, j), a_expected(0, 6, j), 1e-3f) << " at channel " << j;
+        for (size_t i = 0; i < 5; i++)
+            EXPECT_NEAR(batched(0, 1 + i, j), b_expected(0, 5 + i, j), 1e-3f) << " at position " << 5 + i << ", channel " << j;
+    }
+}
+
+TEST(SchedulerTest, MatchesSequentialGeneration) {
+    auto model = random_model(64);
+    std::vector<std::vector<int>> prompts = {{3, 14, 15, 9, 26, 5}, {35, 8, 9, 7, 9, 32, 3, 8, 46}, {2, 6, 43, 38, 32}};
+    size_t new_tokens = 5;
+
+    // every prompt alone through prefill and decode
+    std::vector<std::vector<int>> expected;
+    for (const std::vector<int>& prompt : prompts) {
+        nn::PagedKVCache<float> seq = model->new_sequence();
+        nn::Sampler greedy(nn::SamplingParams{.temperature = 0.0f});
+        std::vector<int> tokens = {model->prefill(prompt, seq, greedy)};
+        while (tokens.size() < new_tokens)
+            tokens.push_back(model->decode(tokens.back(), seq, greedy));
+        expected.push_back(tokens);
+    }
+
+    // all of them sharing each step, the second one stopping at its second token (or at
+    // its first, should greedy decoding repeat it)
+    int stop_token = expected[1][1];
+    std::vector<int> stopped(expected[1].begin(), std::find(expected[1].begin(), expected[1].end(), stop_token) + 1);
+    models::Scheduler scheduler(*model);
+    for (size_t i = 0; i < prompts.size(); i++) {
+        models::GenerationRequest request{prompts[i], new_tokens};
+        if (i == 1)
+            request.stop_token = stop_token;
+        EXPECT_EQ(scheduler.submit(request), i);
+    }
+    std::vector<models::GenerationResult> results = scheduler.run();
+    ASSERT_EQ(results.size(), prompts.size());
+    for (const models::GenerationResult& result : results) {
+        ASSERT_LT(result.id, prompts.size());
+        EXPECT_EQ(result.prompt, prompts[result.id]);
+        if (result.id == 1) {
+            EXPECT_TRUE(result.stopped);
+            EXPECT_EQ(result.tokens, stopped);
+        }
+        else {
+            EXPECT_FALSE(result.stopped);
+            EXPECT_EQ(result.tokens, expected[result.id]) << " for request " << result.id;
+        }
+    }
+    // the stopped request finished first, and the finished ones gave all their blocks back
+    EXPECT_EQ(results.front().id, 1u);
+    EXPECT_EQ(model->get_kv_pool().blocks_in_use(), 0u);
+
+    // 6 + 9 prompt tokens do not fit a 10-token step, so the second prompt waits a step
+    models::Scheduler capped(*model, 16, 10);
+    capped.submit({prompts[0], new_tokens});
+    capped.submit({prompts[1], new_tokens});
+    EXPECT_TRUE(capped.step().empty());
+    EXPECT_EQ(capped.num_running(), 1u);
+    EXPECT_EQ(capped.num_waiting(), 1u);
+    capped.step();
+    EXPECT_EQ(capped.num_running(), 2u);
+    EXPECT_EQ(capped.num_waiting(), 0u);
+
+    results = capped.run();
+    ASSERT_EQ(results.size(), 2u);
+    for (const models::GenerationResult& result : results)
+        EXPECT_EQ(result.tokens, expected[result.id]) << " for request " << result.id;
+    EXPECT_TRUE(capped.idle());
+    EXPECT_EQ(model->get_kv_pool().blocks_in_use(), 0u);
+}
+
+TEST(RotaryEmbeddingTest, MatchesDirectRotation) {
+    // 4 cached positions to start with, so offset 3000 has to grow the tables
+    nn::RotaryEmbedding<float> rotary(16, 4, 10000.0f);
+    Tensor<float> x = Tensor<float>::rand({2, 5, 3, 16}, -1.0f, 1.0f);
+
+    for (size_t offset : {0, 3000}) {
+        Tensor<float> rotated = x.clone();
+        rotary.apply(rotated, offset);
+        EXPECT_GE(rotary.get_max_positions(), offset + 5);
+
+        for (size_t b = 0; b < 2; b++) {
+            for (size_t s = 0; s < 5; s++) {
+                for (size_t h = 0; h < 3; h++) {
+                    for (size_t d = 0; d < 8; d++) {
+                        double angle = (offset + s) * std::pow(10000.0, -(double)(2 * d) / 16);
+                        double x0 = x(b, s, h, d), x1 = x(b, s, h, d + 8);
+                        EXPECT_NEAR(rotated(b, s, h, d), x0 * std::cos(angle) - x1 * std::sin(angle), 1e-5);
+                        EXPECT_NEAR(rotated(b, s, h, d + 8), x0 * std::sin(angle) + x1 * std::cos(angle), 1e-5);
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(RotaryEmbeddingTest, PositionIds) {
+    nn::RotaryEmbedding<float> rotary(8);
+    Tensor<float> x = Tensor<float>::rand({2, 3, 2, 8}, -1.0f, 1.0f);
+
+    // one position per sequence index is the same as an offset
+    Tensor<float> by_offset = x.clone();
+    rotary.apply(by_offset, 7);
+    Tensor<float> by_ids = x.clone();
+    rotary.apply(by_ids, std::vector<size_t>{7, 8, 9});
+    for (size_t i = 0; i < x.size(); i++)
+        EXPECT_EQ(by_ids.get_data()[i], by_offset.get_data()[i]);
+
+    // one per (batch, index): every batch row at its own position
+    Tensor<float> ragged = x.clone();
+    rotary.apply(ragged, std::vector<size_t>{7, 8, 9, 0, 1, 2});
+    Tensor<float> second = x.at(1).view({1, 3, 2, 8}).clone();
+    rotary.apply(second, 0);
+    for (size_t i = 0; i < 3 * 2 * 8; i++) {
+        EXPECT_EQ(ragged.get_data()[i], by_offset.get_data()[i]);
+        EXPECT_EQ(ragged.get_data()[3 * 2 * 8 + i], second.get_data()[i]);
+    }
+
+    EXPECT_THROW(rotary.apply(ragged, std::vector<size_t>{1, 2}), std::invalid_argument);
+}
+
+TEST(SwiGLUTest, MatchesSeparateProjections) {
+    size_t hidden = 32;
+    size_t ffn_dim = 48;
+    Tensor<float> w_gate = Tensor<float>::rand({ffn_dim, hidden}, -0.2f, 0.2f);
+    Tensor<float> w_up = Tensor<float>::rand({ffn_dim, hidden}, -0.2f, 0.2f);
+    Tensor<float> w_down = Tensor<float>::rand({hidden, ffn_dim}, -0.2f, 0.2f);
+
+    Tensor<float> w_gate_up = Tensor<float>::from_shape({2 * ffn_dim, hidden});
+    std::memcpy(w_gate_up.get_data(), w_gate.get_data(), ffn_dim * hidden * sizeof(float));
+    std::memcpy(w_gate_up.get_data() + ffn_dim * hidden, w_up.get_data(), ffn_dim * hidden * sizeof(float));
+    nn::SwiGLU<float, models::Weight> ffn(PackedMatrix<float>::from_tensor(w_gate_up, true), PackedMatrix<float>::from_tensor(w_down, true));
+    EXPECT_EQ(ffn.get_ffn_dim(), ffn_dim);
+
+    // more rows than one tile, the last tile partial
+    size_t n_rows = nn::SWIGLU_BLOCK_ROWS + 5;
+    Tensor<float> x = Tensor<float>::rand({1, n_rows, hidden}, -1.0f, 1.0f);
+    Tensor<float> residual = Tensor<float>::rand({1, n_rows, hidden}, -1.0f, 1.0f);
+    Tensor<float> out = ffn(x);
+    Tensor<float> added = residual.clone();
+    ffn.forward(x, added, 1.0f);
+
+    for (size_t i = 0; i < n_rows; i++) {
+        std::vector<double> h(ffn_dim);
+        for (size_t f = 0; f < ffn_dim; f++) {
+            double g = 0, u = 0;
+            for (size_t d = 0; d < hidden; d++) {
+                g += (double)x(0, i, d) * w_gate(f, d);
+                u += (double)x(0, i, d) * w_up(f, d);
+            }
+            h[f] = g / (1.0 + std::exp(-g)) * u;
+        }
+        for (size_t d = 0; d < hidden; d++) {
+            double expected = 0;
+            for (size_t f = 0; f < ffn_dim; f++)
+                expected += h[f] * w_down(d, f);
+            EXPECT_NEAR(out(0, i, d), expected, 1e-4) << " at row " << i << ", channel " << d;
+            EXPECT_NEAR(added(0, i, d), expected + residual(0, i, d), 1e-4) << " at row " << i << ", channel " << d;
+        }
+    }
+
+    Tensor<float> wrong = Tensor<float>::from_shape({1, n_rows, hidden});
+    EXPECT_THROW(ffn.forward(x.view({(int)n_rows, (int)hidden}), wrong, 0.0f), std::invalid_argument);
+}
+
+TEST(WeightCacheTest, RoundTripsWeightsAndTokenizer) {
+    TempFile file("blass_weight_cache_test.blwc");
+    auto block = random_block();
+    QuantizedMatrix q8 = QuantizedMatrix::quantize(Tensor<float>::rand({64, 96}, -1.0f, 1.0f), kernel::quant_type::q8_0);
+    tokenizer::Tokenizer tk({"a", "b", "ab", "\xc4\xa0x"}, {{"a", "b"}}, {1, 1, 1, 3});
+
+    weight_cache::Writer out;
+    block->save(out, "blk.0.");
+    out.add("q8.weight", q8);
+    out.add(tk);
+    EXPECT_THROW(out.add("q8.weight", q8), std::invalid_argument);
+    out.write(file.path, 42, 7);
+
+    EXPECT_EQ(weight_cache::Reader::open(file.path, 43), nullptr);
+    EXPECT_EQ(weight_cache::Reader::open(file.path + ".missing", 42), nullptr);
+    std::shared_ptr<weight_cache::Reader> in = weight_cache::Reader::open(file.path, 42);
+    ASSERT_NE(in, nullptr);
+    EXPECT_EQ(in->get_content_hash(), 7u);
+
+    // the same packed bytes, so the same results bit for bit
+    models::Qwen2Block cached;
+    cached.load(*in, "blk.0.");
+    Tensor<float> x = Tensor<float>::rand({1, 5, 896}, -1.0f, 1.0f);
+    Tensor<float> expected = block->forward(x);
+    Tensor<float> result = cached.forward(x);
+    for (size_t i = 0; i < expected.size(); i++)
+        ASSERT_EQ(result.get_data()[i], expected.get_data()[i]) << " at index " << i;
+
+    QuantizedMatrix q8_cached = in->quantized("q8.weight");
+    EXPECT_EQ(q8_cached.get_type(), kernel::quant_type::q8_0);
+    EXPECT_EQ(std::memcmp(q8_cached.get_data(), q8.get_data(), q8.cols() * q8.row_bytes()), 0);
+    EXPECT_THROW(in->tensor("q8.weight"), std::runtime_error);
+    EXPECT_THROW(in->tensor("nothing"), std::runtime_error);
+
+    tokenizer::Tokenizer tk_cached = in->tokenizer();
+    EXPECT_EQ(tk_cached.get_tokens(), tk.get_tokens());
+    EXPECT_EQ(tk_cached.get_merges(), tk.get_merges());
+    EXPECT_EQ(tk_cached.get_token_type(), tk.get_token_type());
+}
+
+TEST(WeightCacheTest, ContentHashSeesEditsTheFingerprintMisses) {
+    TempFile file("blass_content_hash_test.gguf");
+    std::vector<uint8_t> bytes(3 * ((size_t)1 << 20) + 5);
+    for (size_t i = 0; i < bytes.size(); i++)
+        bytes[i] = (uint8_t)(i * 131 + 7);
+    auto write = [&]() {
+        std::ofstream out(file.path, std::ios::binary | std::ios::trunc);
+        out.write((const char*)bytes.data(), bytes.size());
+    };
+
+    write();
+    struct stat sb;
+    ASSERT_EQ(stat(file.path.c_str(), &sb), 0);
+    uint64_t source = weight_cache::fingerprint(file.path.c_str());
+    uint64_t content = weight_cache::content_hash(file.path.c_str());
+    EXPECT_EQ(weight_cache::content_hash(file.path.c_str()), content);
+
+    // one byte in the middle MiB, written back with the old mtime as cp -p would
+    bytes[bytes.size() / 2] ^= 1;
+    write();
+    struct timespec times[2] = {sb.st_atim, sb.st_mtim};
+    ASSERT_EQ(utimensat(AT_FDCWD, file.path.c_str(), times, 0), 0);
+    EXPECT_EQ(weight_cache::fingerprint(file.path.c_str()), source);
+    EXPECT_NE(weight_cache::content_hash(file.path.c_str()), content);
+
+    // the chunk tail is hashed as well
+    bytes[bytes.size() / 2] ^= 1;
+    bytes.back() ^= 1;
+    write();
+    EXPECT_NE(weight_cache::content_hash(file.path.c_str()), content);
+}
+
+TEST(GGUFReaderTest, MetadataViewsDecodeOnDemand) {
+    TempFile file("blass_metadata_test.gguf");
+    GGUFBytes f;
+    f.bytes = "GGUF";
+    f.put<uint32_t>(3).put<uint64_t>(1).put<uint64_t>(6);
+    f.key("general.architecture", gguf_loader::GGUF_METADATA_VALUE_TYPE_STRING).put_string("qwen2");
+    f.key("qwen2.block_count", gguf_loader::GGUF_METADATA_VALUE_TYPE_UINT32).put<uint32_t>(24);
+    f.key("qwen2.rope.freq_base", gguf_loader::GGUF_METADATA_VALUE_TYPE_FLOAT32).put<float>(1e6f);
+    f.key("tokenizer.ggml.tokens", gguf_loader::GGUF_METADATA_VALUE_TYPE_ARRAY);
+    f.put<uint32_t>(gguf_loader::GGUF_METADATA_VALUE_TYPE_STRING).put<uint64_t>(3);
+    f.put_string("a").put_string("b").put_string("ab");
+    f.key("tokenizer.ggml.merges", gguf_loader::GGUF_METADATA_VALUE_TYPE_ARRAY);
+    f.put<uint32_t>(gguf_loader::GGUF_METADATA_VALUE_TYPE_STRING).put<uint64_t>(1).put_string("a b");
+    f.key("tokenizer.ggml.token_type", gguf_loader::GGUF_METADATA_VALUE_TYPE_ARRAY);
+    f.put<uint32_t>(gguf_loader::GGUF_METADATA_VALUE_TYPE_INT32).put<uint64_t>(3).put<int32_t>(1).put<int32_t>(1).put<int32_t>(3);
+    f.put_string("x.weight").put<uint32_t>(1).put<uint64_t>(4).put<uint32_t>(gguf_loader::GGML_TYPE_F32).put<uint64_t>(0);
+    f.bytes.resize((f.bytes.size() + 31) / 32 * 32);
+    for (float v : {1.0f, 2.0f, 3.0f, 4.0f})
+        f.put<float>(v);
+    std::ofstream(file.path, std::ios::binary) << f.bytes;
+
+    gguf_loader::GGUFModel model(file.path.c_str());
+    ASSERT_EQ(model.metadata.size(), 6u);
+    EXPECT_EQ(model.metadata[0].first, "general.architecture");
+    EXPECT_EQ(model.find_metadata("general.architecture")->get_string(), "qwen2");
+    EXPECT_EQ(model.find_metadata("qwen2.block_count")->get<uint32_t>(), 24u);
+    EXPECT_EQ(model.find_metadata("qwen2.rope.freq_base")->get<float>(), 1e6f);
+    EXPECT_EQ(model.find_metadata("missing"), nullptr);
+    EXPECT_THROW(model.find_metadata("qwen2.block_count")->get<int32_t>(), std::runtime_error);
+    EXPECT_THROW(model.find_metadata("qwen2.block_count")->get_string(), std::runtime_error);
+
+    gguf_loader::GGUFArray types = model.find_metadata("tokenizer.ggml.token_type")->get_array();
+    EXPECT_EQ(types.size(), 3u);
+    EXPECT_EQ(types.get<int32_t>(2), 3);
+    EXPECT_THROW(types.get<int32_t>(3), std::out_of_range);
+    EXPECT_THROW(types.get<uint32_t>(0), std::runtime_error);
+    EXPECT_EQ(model.find_metadata("tokenizer.ggml.tokens")->to_string(), "[a, b, ab]");
+
+    EXPECT_EQ(model.tk.get_tokens(), (std::vector<std::string>{"a", "b", "ab"}));
+    EXPECT_EQ(model.tk.get_merges(), (std::vector<std::pair<std::string, std::string>>{{"a", "b"}}));
+    EXPECT_EQ(model.tk.get_token_type(), (std::vector<int>{1, 1, 3}));
+    ASSERT_EQ(model.tensors.size(), 1u);
+    EXPECT_EQ(((const float*)model.tensors[0].second.data)[3], 4.0f);
+
+    // a string whose length points past the end of the file
+    std::string truncated = f.bytes.substr(0, 24) + GGUFBytes().key("k", gguf_loader::GGUF_METADATA_VALUE_TYPE_STRING).put<uint64_t>(1000).bytes;
+    std::ofstream(file.path, std::ios::binary | std::ios::trunc) << truncated;
+    EXPECT_THROW(gguf_loader::GGUFModel(file.path.c_str()), std::runtime_error);
+}
+
+TEST(GGUFReaderTest, LoadsTensorsPast4GiB) {
+    TempFile file("blass_sparse_test.gguf");
+    uint64_t gib = (uint64_t)1 << 30;
+    uint64_t wide = ((uint64_t)1 << 32) + 32;
+    std::vector<SparseTensor> tensors = {
+        {"near.weight", {4}, 0},
+        {"far.weight", {8, 2}, 5 * gib},
+        // more elements than a 32-bit dimension holds
+        {"wide.weight", {wide}, 6 * gib},
+    };
+    std::vector<std::pair<uint64_t, std::vector<float>>> patches = {
+        {0, {1.0f, 2.0f, 3.0f, 4.0f}},
+        {5 * gib + 15 * sizeof(float), {-7.0f}},
+        {6 * gib + (wide - 2) * sizeof(float), {0.5f, 0.25f}},
+    };
+    if (!write_sparse_gguf(file.path, tensors, patches))
+        GTEST_SKIP() << "cannot create a sparse " << (6 * gib + wide * 4) / gib << " GiB file in " << ::testing::TempDir();
+
+    {
+        gguf_loader::GGUFModel model(file.path.c_str());
+        ASSERT_EQ(model.tensors.size(), 3u);
+        const gguf_loader::tensor_data& near = model.tensors[0].second;
+        const gguf_loader::tensor_data& far = model.tensors[1].second;
+        const gguf_loader::tensor_data& big = model.tensors[2].second;
+        EXPECT_EQ(((const float*)near.data)[3], 4.0f);
+        EXPECT_EQ(far.offset, 5 * gib);
+        EXPECT_EQ(far.dims, (std::vector<uint64_t>{2, 8}));
+        EXPECT_EQ((const char*)far.data - (const char*)near.data, (std::ptrdiff_t)(5 * gib));
+        EXPECT_EQ(((const float*)far.data)[15], -7.0f);
+        EXPECT_EQ(big.dims, (std::vector<uint64_t>{wide}));
+
+        // used in place as a Tensor, whose shape and indexing are 64-bit as well
+        Tensor<float> param;
+        models::Qwen2Block().load_tensor_f32(param, big);
+        EXPECT_EQ(param.size(), wide);
+        EXPECT_EQ(param(wide - 2), 0.5f);
+        Tensor<float> rows = param.view({-1, 32});
+        EXPECT_EQ(rows.get_shape(), (std::vector<size_t>{wide / 32, 32}));
+        EXPECT_EQ(rows(wide / 32 - 1, 31), 0.25f);
+    }
+}
+
+TEST(GGUFReaderTest, RejectsTensorDataPastTheEnd) {
+    TempFile file("blass_truncated_test.gguf");
+    uint64_t gib = (uint64_t)1 << 30;
+
+    // the last tensor's data is cut short by one float
+    ASSERT_TRUE(write_sparse_gguf(file.path, {{"near.weight", {4}, 0}, {"far.weight", {8}, 5 * gib}}, {}));
+    struct stat sb;
+    ASSERT_EQ(stat(file.path.c_str(), &sb), 0);
+    ASSERT_EQ(truncate(file.path.c_str(), sb.st_size - sizeof(float)), 0);
+    EXPECT_THROW(gguf_loader::GGUFModel(file.path.c_str()), std::runtime_error);
+
+    // 2^33 * 2^33 elements wraps to 0 in 64 bits, which must not pass as an empty tensor
+    ASSERT_TRUE(write_sparse_gguf(file.path, {{"huge.weight", {(uint64_t)1 << 33, (uint64_t)1 << 33}, 0}}, {}));
+    EXPECT_THROW(gguf_loader::GGUFModel(file.path.c_str()), std::runtime_error);
+
+    // an offset near 2^64 that wraps around when added to the data start
+    ASSERT_TRUE(write_sparse_gguf(file.path, {{"wrap.weight", {8}, UINT64_MAX - 31}}, {}));
+    EXPECT_THROW(gguf_loader::GGUFModel(file.path.c_str()), std::runtime_error);
+}
@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include "../src/nn/sampling.h"
+
+using namespace blass;
+
+namespace {
+    // vocab-sized logits on a coarse grid, so many values tie, with a few NaNs
+    std::vector<float> make_logits(size_t n) {
+        Tensor<float> r = Tensor<float>::rand({n}, -20.0f, 20.0f);
+        std::vector<float> logits(r.get_data(), r.get_data() + n);
+        for (float& x : logits)
+            x = std::round(x * 8.0f) / 8.0f;
+        for (size_t i = 5; i < n; i += n / 7)
+            logits[i] = std::numeric_limits<float>::quiet_NaN();
+        return logits;
+    }
+}
+
+TEST(SamplingTest, ArgmaxPicksFirstLargest) {
+    std::vector<float> logits = make_logits(151936);
+    size_t expected = 0;
+    for (size_t i = 0; i < logits.size(); i++) {
+        if (logits[i] > logits[expected] || logits[expected] != logits[expected])
+            expected = i;
+    }
+    EXPECT_EQ(nn::functional::argmax(logits.data(), logits.size()), expected);
+
+    // the winner in the last element of the last block
+    logits.back() = 100.0f;
+    EXPECT_EQ(nn::functional::argmax(logits.data(), logits.size()), logits.size() - 1);
+
+    std::vector<float> small = {std::numeric_limits<float>::quiet_NaN(), -1.0f, 3.0f, 3.0f};
+    EXPECT_EQ(nn::functional::argmax(small.data(), small.size()), 2u);
+}
+
+TEST(SamplingTest, TopKMatchesFullSort) {
+    std::vector<float> logits = make_logits(151936);
+    std::vector<std::pair<float, size_t>> sorted;
+    for (size_t i = 0; i < logits.size(); i++) {
+        if (logits[i] == logits[i])
+            sorted.push_back({logits[i], i});
+    }
+    std::sort(sorted.begin(), sorted.end(), nn::functional::ranks_before<float>);
+
+    for (size_t k : {1, 10, 1000}) {
+        std::vector<std::pair<float, size_t>> top = nn::functional::top_k(logits.data(), logits.size(), k);
+        ASSERT_EQ(top.size(), k);
+        for (size_t i = 0; i < k; i++) {
+            EXPECT_EQ(top[i].first, sorted[i].first) << " at rank " << i << " of " << k;
+            EXPECT_EQ(top[i].second, sorted[i].second) << " at rank " << i << " of " << k;
+        }
+    }
+
+    // k beyond the non-NaN entries returns all of them
+    std::vector<float> small = {2.0f, std::numeric_limits<float>::quiet_NaN(), 5.0f};
+    std::vector<std::pair<float, size_t>> top = nn::functional::top_k(small.data(), small.size(), 10);
+    ASSERT_EQ(top.size(), 2u);
+    EXPECT_EQ(top[0].second, 2u);
+    EXPECT_EQ(top[1].second, 0u);
+}
+
+TEST(SamplerTest, GreedyAndTopOnePickArgmax) {
+    std::vector<float> logits = make_logits(151936);
+    size_t expected = nn::functional::argmax(logits.data(), logits.size());
+
+    nn::Sampler greedy(nn::SamplingParams{.temperature = 0.0f}, 1);
+    nn::Sampler top_one(nn::SamplingParams{.temperature = 2.0f, .top_k = 1}, 1);
+    EXPECT_EQ(greedy.sample(logits.data(), logits.size()), expected);
+    EXPECT_EQ(top_one.sample(logits.data(), logits.size()), expected);
+}
+
+TEST(SamplerTest, FrequenciesFollowSoftmax) {
+    // probabilities 0.5, 0.3, 0.15, 0.05 at temperature 1
+    std::vector<float> probs = {0.5f, 0.3f, 0.15f, 0.05f};
+    std::vector<float> logits;
+    for (float p : probs)
+        logits.push_back(std::log(p));
+
+    size_t draws = 40000;
+    auto frequencies = [&](nn::SamplingParams params) {
+        nn::Sampler sampler(params, 42);
+        std::vector<double> seen(probs.size());
+        for (size_t i = 0; i < draws; i++) {
+            std::vector<float> row = logits;
+            seen[sampler.sample(row.data(), row.size())] += 1.0 / draws;
+        }
+        return seen;
+    };
+
+    // the whole distribution, then with top-k, top-p and min-p cuts renormalised
+    std::vector<double> all = frequencies({.top_k = 0});
+    for (size_t i = 0; i < probs.size(); i++)
+        EXPECT_NEAR(all[i], probs[i], 0.01) << " for token " << i;
+
+    std::vector<double> top_3 = frequencies({.top_k = 3});
+    EXPECT_NEAR(top_3[0], 0.5 / 0.95, 0.01);
+    EXPECT_EQ(top_3[3], 0.0);
+
+    // 0.5 < 0.7 <= 0.5 + 0.3
+    std::vector<double> top_p = frequencies({.top_k = 0, .top_p = 0.7f});
+    EXPECT_NEAR(top_p[0], 0.5 / 0.8, 0.01);
+    EXPECT_EQ(top_p[2], 0.0);
+
+    // 0.15 / 0.5 < 0.4 <= 0.3 / 0.5
+    std::vector<double> min_p = frequencies({.top_k = 0, .min_p = 0.4f});
+    EXPECT_NEAR(min_p[1], 0.3 / 0.8, 0.01);
+    EXPECT_EQ(min_p[2], 0.0);
+
+    // a temperature of 2 flattens them to sqrt(p), renormalised
+    std::vector<double> hot = frequencies({.temperature = 2.0f, .top_k = 0});
+    double norm = 0;
+    for (float p : probs)
+        norm += std::sqrt(p);
+    EXPECT_NEAR(hot[3], std::sqrt(0.05) / norm, 0.01);
+}
+
+TEST(SamplerTest, TopPGrowsCandidatesWithoutTopK) {
+    // 1000 equally likely tokens: top-p 0.5 keeps exactly the first 500
+    std::vector<float> logits(1000, 0.0f);
+    nn::Sampler sampler({.top_k = 0, .top_p = 0.5f}, 3);
+    size_t highest = 0;
+    for (size_t i = 0; i < 2000; i++) {
+        std::vector<float> row = logits;
+        highest = std::max(highest, sampler.sample(row.data(), row.size()));
+    }
+    EXPECT_LT(highest, 500u);
+    EXPECT_GT(highest, 400u);
+}
+
+TEST(SamplerTest, PenaltiesAndSeeds) {
+    nn::Sampler sampler({.temperature = 0.0f, .repetition_penalty = 1.5f}, 0);
+    std::vector<float> logits = {2.0f, 1.9f, -1.0f};
+
+    // token 0 wins until it has been seen: 2 / 1.5 < 1.9
+    std::vector<float> row = logits;
+    EXPECT_EQ(sampler.sample(row.data(), row.size()), 0u);
+    row = logits;
+    EXPECT_EQ(sampler.sample(row.data(), row.size()), 1u);
+    EXPECT_NEAR(row[0], 2.0f / 1.5f, 1e-6);
+
+    nn::Sampler counted({.temperature = 0.0f, .frequency_penalty = 0.05f}, 0);
+    counted.accept(0);
+    row = logits;
+    EXPECT_EQ(counted.sample(row.data(), row.size()), 0u);
+    counted.accept(0);
+    row = logits;
+    EXPECT_EQ(counted.sample(row.data(), row.size()), 1u);
+    counted.reset();
+    row = logits;
+    EXPECT_EQ(counted.sample(row.data(), row.size()), 0u);
+
+    // the same seed replays the same tokens
+    std::vector<float> vocab = make_logits(151936);
+    nn::Sampler a({.top_k = 0, .top_p = 0.95f}, 7);
+    nn::Sampler b({.top_k = 0, .top_p = 0.95f}, 7);
+    for (size_t i = 0; i < 20; i++) {
+        std::vector<float> row_a = vocab, row_b = vocab;
+        EXPECT_EQ(a.sample(row_a.data(), row_a.size()), b.sample(row_b.data(), row_b.size()));
+    }
+}